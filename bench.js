@@ -0,0 +1,130 @@
+// Microbenchmarks for call and conversion overhead.
+// Build with `node-gyp build` (produces the PyNodeBench target) and run
+// `node bench.js [--out results.json] [--filter name] [--scale 0.1]`.
+// Prints one JSON document so runs can be diffed between commits.
+import { createRequire } from "node:module"
+import { writeFileSync } from "node:fs"
+
+const require = createRequire(import.meta.url)
+const pynode = require("./build/Release/PyNodeBench")
+const { bench } = pynode
+
+const args = process.argv.slice(2)
+const option = (name, def) => {
+  const i = args.indexOf(name)
+  return i >= 0 ? args[i + 1] : def
+}
+const outFile = option('--out')
+const filter = option('--filter')
+const scale = Number(option('--scale', 1))
+
+pynode.startInterpreter()
+pynode.appendSysPath('./test_files')
+const mod = pynode.openFile('bench')
+const noop = mod.__getattr__('noop')
+const identity = mod.__getattr__('identity')
+const callJs = mod.__getattr__('call_js')
+const sameObject = mod.__getattr__('return_same_object').__call__()
+
+const range = n => Array.from({ length: n }, (_, i) => i)
+const nested = {
+  id: 1,
+  name: 'nested',
+  tags: ['a', 'b', 'c'],
+  child: { x: 1.5, y: -2.25, child: { list: [1, 2, 3], flag: true } }
+}
+const largeInts = range(100000)
+const largeFloats = largeInts.map(i => i + 0.5)
+const payload = { ids: range(100), weights: range(100).map(i => i / 100), tag: 'fixed' }
+const typedIdentity = identity.__typed__([{ ids: 'int[]', weights: 'float[]', tag: 'str' }], { ids: 'int[]', weights: 'float[]', tag: 'str' })
+
+const gc = typeof global.gc === 'function' ? global.gc : () => {}
+
+// Runs fn(iterations) -> elapsed ns and records ns/op, Python allocations/op
+// and the JS heap delta over the whole run
+const measure = async (name, iterations, fn) => {
+  if (filter && !name.includes(filter)) {
+    return null
+  }
+  iterations = Math.max(1, Math.round(iterations * scale))
+  await fn(Math.min(iterations, 100)) // warm up
+  gc()
+  const heapBefore = process.memoryUsage().heapUsed
+  bench.beginAllocations()
+  const ns = await fn(iterations)
+  const pyAllocations = bench.endAllocations()
+  const heapAfter = process.memoryUsage().heapUsed
+  return {
+    name,
+    iterations,
+    nsPerOp: ns / iterations,
+    pyAllocationsPerOp: pyAllocations / iterations,
+    jsHeapDeltaBytes: heapAfter - heapBefore
+  }
+}
+
+const timeLoop = fn => async iterations => {
+  const start = process.hrtime.bigint()
+  for (let i = 0; i < iterations; i++) {
+    fn()
+  }
+  return Number(process.hrtime.bigint() - start)
+}
+
+const timeAsync = fn => async iterations => {
+  const start = process.hrtime.bigint()
+  for (let i = 0; i < iterations; i++) {
+    await fn()
+  }
+  return Number(process.hrtime.bigint() - start)
+}
+
+const cases = [
+  ['call.sync.noop', 200000, timeLoop(() => noop.__call__())],
+  ['call.sync.identity_int', 200000, timeLoop(() => identity.__call__(42))],
+  // Same fixed shape payload converted dynamically and through __typed__ schemas
+  ['call.sync.identity_payload', 50000, timeLoop(() => identity.__call__(payload))],
+  ['call.typed.identity_payload', 50000, timeLoop(() => typedIdentity.__call__(payload))],
+  ['call.async_promise.noop', 20000, timeAsync(() => noop.__callasync_promise__())],
+  // One async call whose Python side calls back into JS n times, so the per-op
+  // time is dominated by WrapJSInteractionFromAsyncThread round trips
+  ['call.js_from_worker', 20000, async iterations => {
+    const start = process.hrtime.bigint()
+    await callJs.__callasync_promise__(() => {}, iterations)
+    return Number(process.hrtime.bigint() - start)
+  }],
+  ['to_python.int', 1000000, n => bench.convertToPython(42, n)],
+  ['to_python.float', 1000000, n => bench.convertToPython(4.2, n)],
+  ['to_python.string', 1000000, n => bench.convertToPython('a moderately sized string', n)],
+  ['to_python.nested_dict', 100000, n => bench.convertToPython(nested, n)],
+  ['to_python.array_100k_int', 20, n => bench.convertToPython(largeInts, n)],
+  ['to_python.array_100k_float', 20, n => bench.convertToPython(largeFloats, n)],
+  ['from_python.int', 1000000, n => bench.convertFromPython(42, n)],
+  ['from_python.float', 1000000, n => bench.convertFromPython(4.2, n)],
+  ['from_python.string', 1000000, n => bench.convertFromPython('a moderately sized string', n)],
+  ['from_python.nested_dict', 100000, n => bench.convertFromPython(nested, n)],
+  ['from_python.array_100k_int', 20, n => bench.convertFromPython(largeInts, n)],
+  ['from_python.array_100k_float', 20, n => bench.convertFromPython(largeFloats, n)],
+  ['from_python.identity_lookup', 1000000, n => bench.convertFromPython(sameObject, n)],
+]
+
+const results = []
+for (const [name, iterations, fn] of cases) {
+  const result = await measure(name, iterations, fn)
+  if (result) {
+    results.push(result)
+  }
+}
+
+const report = JSON.stringify({
+  timestamp: new Date().toISOString(),
+  node: process.version,
+  python: pynode.import('sys').__getattr__('version'),
+  platform: `${process.platform}-${process.arch}`,
+  results
+}, null, 2)
+
+if (outFile) {
+  writeFileSync(outFile, report)
+}
+console.log(report)
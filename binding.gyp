@@ -1,65 +1,97 @@
 {
+  "variables": {
+    "pynode_sources": [
+      "src/main.cpp",
+      "src/helpers.cpp",
+      "src/pynode.cpp",
+      "src/worker.cpp",
+      "src/pywrapper.cpp",
+      "src/jswrapper.cpp",
+      "src/tracing.cpp",
+      "src/pyerror.cpp",
+      "src/channel.cpp",
+      "src/columnar.cpp",
+      "src/memory.cpp",
+      "src/cycles.cpp",
+      "src/dispatch.cpp",
+      "src/shm.cpp",
+      "src/allocations.cpp",
+      "src/memoize.cpp",
+      "src/attrcache.cpp",
+      "src/proxy.cpp",
+      "src/stream.cpp",
+      "src/autodispatch.cpp",
+      "src/schema.cpp",
+      "src/json.cpp",
+      "src/conversion.cpp"
+    ]
+  },
+  "target_defaults": {
+    'include_dirs': [
+      "<!@(node -p \"require('node-addon-api').include\")"
+    ],
+    'dependencies': ["<!(node -p \"require('node-addon-api').gyp\")"],
+    'cflags!': [ '-fno-exceptions' ],
+    'cflags_cc!': [ '-fno-exceptions' ],
+    'cflags+': [ '-g' ],
+    'cflags_cc+': [ '-g' ],
+    'xcode_settings': {
+      'GCC_ENABLE_CPP_EXCEPTIONS': 'YES',
+      'CLANG_CXX_LIBRARY': 'libc++',
+      'MACOSX_DEPLOYMENT_TARGET': '10.7',
+    },
+    'msvs_settings': {
+      'VCCLCompilerTool': { 'ExceptionHandling': 1 },
+    },
+    "conditions": [
+      ['OS=="mac"', {
+        'cflags+': ['-fvisibility=hidden'],
+        'xcode_settings': {
+          'GCC_SYMBOLS_PRIVATE_EXTERN': 'YES', # -fvisibility=hidden
+        }
+      }],
+      ['OS=="win"', {
+        "variables": {
+          "PY_HOME%": "<!(IF NOT DEFINED PY_HOME (\"%PYTHON%\" -c \"import sysconfig;print(sysconfig.get_paths()['data'])\") ELSE (echo %PY_HOME%))"
+        },
+        "include_dirs": [
+          "<!(echo <(PY_HOME)\\include)"
+        ],
+        "msvs_settings": {
+          "VCLinkerTool": {
+            "AdditionalLibraryDirectories": "<!(echo <(PY_HOME)\\libs)"
+          }
+        }
+      }],
+      ['OS!="win"', {
+        'cflags+': ['-Wno-missing-field-initializers'],
+        "variables": {
+          "PY_INCLUDE%": "<!(if [ -z \"$PY_INCLUDE\" ]; then echo $(\"$PYTHON\" build_include.py); else echo $PY_INCLUDE; fi)",
+          "PY_LIBS%": "<!(if [ -z \"$PY_LIBS\" ]; then echo $(\"$PYTHON\" build_ldflags.py); else echo $PY_LIBS; fi)"
+        },
+        "include_dirs": [
+          "<(PY_INCLUDE)"
+        ],
+        "libraries": [
+          "<(PY_LIBS)",
+        ]
+      }],
+      ['OS=="linux"', {
+        # shm_open lives in librt before glibc 2.34
+        "libraries": [ "-lrt" ]
+      }]
+    ]
+  },
   "targets": [
     {
       "target_name": "PyNode",
-      "sources": [
-        "src/main.cpp",
-        "src/helpers.cpp",
-        "src/pynode.cpp",
-        "src/worker.cpp",
-        "src/pywrapper.cpp",
-        "src/jswrapper.cpp"
-      ],
-      'include_dirs': [
-        "<!@(node -p \"require('node-addon-api').include\")"
-      ],
-      'dependencies': ["<!(node -p \"require('node-addon-api').gyp\")"],
-      'cflags!': [ '-fno-exceptions' ],
-      'cflags_cc!': [ '-fno-exceptions' ],
-      'cflags+': [ '-g' ],
-      'cflags_cc+': [ '-g' ],
-      'xcode_settings': {
-        'GCC_ENABLE_CPP_EXCEPTIONS': 'YES',
-        'CLANG_CXX_LIBRARY': 'libc++',
-        'MACOSX_DEPLOYMENT_TARGET': '10.7',
-      },
-      'msvs_settings': {
-        'VCCLCompilerTool': { 'ExceptionHandling': 1 },
-      },
-      "conditions": [
-        ['OS=="mac"', {
-          'cflags+': ['-fvisibility=hidden'],
-          'xcode_settings': {
-            'GCC_SYMBOLS_PRIVATE_EXTERN': 'YES', # -fvisibility=hidden
-          }
-        }],
-        ['OS=="win"', {
-          "variables": {
-            "PY_HOME%": "<!(IF NOT DEFINED PY_HOME (\"%PYTHON%\" -c \"import sysconfig;print(sysconfig.get_paths()['data'])\") ELSE (echo %PY_HOME%))"
-          },
-          "include_dirs": [
-            "<!(echo <(PY_HOME)\\include)"
-          ],
-          "msvs_settings": {
-            "VCLinkerTool": {
-              "AdditionalLibraryDirectories": "<!(echo <(PY_HOME)\\libs)"
-            }
-          }
-        }],
-        ['OS!="win"', {
-          'cflags+': ['-Wno-missing-field-initializers'],
-          "variables": {
-            "PY_INCLUDE%": "<!(if [ -z \"$PY_INCLUDE\" ]; then echo $(\"$PYTHON\" build_include.py); else echo $PY_INCLUDE; fi)",
-            "PY_LIBS%": "<!(if [ -z \"$PY_LIBS\" ]; then echo $(\"$PYTHON\" build_ldflags.py); else echo $PY_LIBS; fi)"
-          },
-          "include_dirs": [
-            "<(PY_INCLUDE)"
-          ],
-          "libraries": [
-            "<(PY_LIBS)",
-          ]
-        }]
-      ]
+      "sources": [ "<@(pynode_sources)" ]
+    },
+    {
+      # Same addon plus native conversion microbenchmarks, driven by bench.js
+      "target_name": "PyNodeBench",
+      "sources": [ "<@(pynode_sources)", "src/bench.cpp" ],
+      "defines": [ "PYNODE_BENCHMARK" ]
     }
   ]
 }
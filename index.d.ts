@@ -3,22 +3,279 @@ declare module "@lmagder/pynode" {
     readonly __call__: (...args: PyNodeValue[]) => PyNodeValue;
     readonly __callasync__: (...args: [...PyNodeValue[], (error: string | null, result?: PyNodeValue) => void]) => void;
     readonly __callasync_promise__: (...args: PyNodeValue[]) => Promise<PyNodeValue>;
+    /** Like __callasync_promise__ but converts the record set result to columns */
+    readonly __callasync_columns__: (...args: PyNodeValue[]) => Promise<PyNodeColumns>;
+    /**
+     * Like __callasync_promise__, but callables that average under
+     * inlineThresholdUs run on the JS thread, batched per microtask
+     */
+    readonly __callauto__: (...args: PyNodeValue[]) => Promise<PyNodeValue>;
+    /**
+     * Parses the JSON body on the worker thread straight into Python objects,
+     * calls with it as the first argument and resolves with the result
+     * serialized to a JSON Buffer. A Buffer body is read in place, so leave
+     * it alone until the promise settles.
+     */
+    readonly __calljson__: (body: string | ArrayBufferView | ArrayBuffer, ...args: PyNodeValue[]) => Promise<Buffer>;
+    readonly __columns__: () => PyNodeColumns;
+    readonly __memoize__: (options?: PyNodeMemoizeOptions) => PyNodeMemoized;
+    /** Converts arguments (and the result, if given) through schemas instead of probing each value */
+    readonly __typed__: (args: (PyNodeSchema | PyNodeSchemaSpec)[], result?: PyNodeSchema | PyNodeSchemaSpec) => PyNodeTyped;
+    /** Proxy reading attributes as properties and calling through apply; wrapped results are proxied too */
+    readonly __proxy__: () => any;
     readonly __getattr__: (field: string) => PyNodeValue;
     readonly __setattr__: (field: string, value: PyNodeValue) => void;
     readonly __repr__: (field: string) => string;
     readonly __pytype__: string;
   };
-  export type PyNodeValue = null | number | string | boolean | PyNodeWrappedPythonObject | PyNodeValue[] | { [key: string]: PyNodeValue };
+  export class PythonError extends Error {
+    readonly pyType: string;
+    readonly pyMessage: string;
+    readonly pyException: PyNodeValue;
+  }
+  /**
+   * SPSC ring shared with Python, where it converts to a pynode.Channel.
+   * header[0] (head) and header[1] (tail) are free running uint32 byte
+   * counters, header[2] is non zero once closed. Records are a little endian
+   * uint32 length followed by the payload, wrapping around `data`.
+   */
+  export type PyNodeChannel = {
+    readonly buffer: ArrayBuffer;
+    readonly header: Int32Array;
+    readonly data: Uint8Array;
+    readonly capacity: number;
+    /** Appends a record, returns false if there is not enough free space */
+    readonly write: (record: string | ArrayBufferView) => boolean;
+    /** Wakes a blocked Python consumer after writing with Atomics directly */
+    readonly notify: () => void;
+    readonly close: () => void;
+  };
+  /**
+   * Record set in columnar form. Arrow numeric columns alias the Arrow
+   * buffers without copying, strings come back dictionary encoded with
+   * -1 indices for nulls. validity only has entries for columns with nulls.
+   */
+  export type PyNodeColumns = {
+    readonly length: number;
+    readonly columns: { [name: string]: ArrayBufferView | PyNodeValue[] | { dictionary: string[]; indices: Int32Array } };
+    readonly validity: { [name: string]: Uint8Array };
+  };
+  export type PyNodeValue = null | number | string | boolean | PyNodeWrappedPythonObject | PyNodeChannel | PyNodeValue[] | { [key: string]: PyNodeValue };
+
+  export type PyNodeInterpreterOptions = {
+    /** Directory for a shared bytecode cache (PyConfig.pycache_prefix) */
+    pycachePrefix?: string;
+    /** Modules imported in the background once the interpreter is up */
+    preload?: string[];
+  };
 
+  export type PyNodeMemoryPressureOptions = {
+    /** Report wrappers of large objects (buffer size or .nbytes) as V8 external memory, off by default */
+    reportExternalMemory?: boolean;
+    minReportBytes?: number;
+    /** Run gc.collect(pythonGeneration) on a pool thread after V8 collections and watch for growth, off by default */
+    collectPython?: boolean;
+    pythonGeneration?: 0 | 1 | 2;
+    minCollectIntervalMs?: number;
+    /** With collectPython, process growth seen by Python collections that triggers global.gc (or an external memory nudge), 0 disables */
+    growthThresholdBytes?: number;
+  };
+  export type PyNodeMemoryPressureStatus = Required<PyNodeMemoryPressureOptions> & {
+    readonly wrapperBytes: number;
+    readonly pythonCollections: number;
+    readonly v8Notifications: number;
+  };
+  export type PyNodeAutoDispatchOptions = {
+    /** Average Python time per call below which calls run inline */
+    inlineThresholdUs?: number;
+    /** Average above which inlined callables go back to the thread pool */
+    offloadThresholdUs?: number;
+    /** Weight of the newest sample in the moving average */
+    smoothing?: number;
+    /** Inline time per batch, later calls of the batch are offloaded */
+    batchBudgetUs?: number;
+  };
+  export type PyNodeAutoDispatchStatus = Required<PyNodeAutoDispatchOptions> & {
+    readonly inlineCalls: number;
+    readonly offloadedCalls: number;
+    readonly batches: number;
+    readonly overBudget: number;
+  };
+  export type PyNodeConversionOptions = {
+    /** Elements converted per HandleScope in lists and dicts */
+    chunkSize?: number;
+    /** Async list results at least this long convert across event loop turns, 0 disables */
+    incrementalThreshold?: number;
+    /** Conversion time per turn for those */
+    timeBudgetMs?: number;
+  };
+  export type PyNodeConversionStatus = Required<PyNodeConversionOptions> & {
+    readonly incrementalConversions: number;
+    readonly slices: number;
+  };
   export type PyNode = {
-    readonly startInterpreter: (venvPython?: string) => void;
+    readonly startInterpreter: {
+      (venvPython?: string, options?: PyNodeInterpreterOptions): void;
+      (options: PyNodeInterpreterOptions): void;
+    };
+    /**
+     * Starts Python on a libuv pool thread, which then becomes Python's main
+     * thread: main thread only APIs such as signal.signal will fail when
+     * used from JS calls. Other pynode functions throw until this settles.
+     */
+    readonly startInterpreterAsync: {
+      (venvPython?: string, options?: PyNodeInterpreterOptions): Promise<void>;
+      (options: PyNodeInterpreterOptions): Promise<void>;
+    };
     readonly appendSysPath: (path: string) => void;
     readonly openFile: (filename: string) => PyNodeWrappedPythonObject;
     readonly import: (name: string) => PyNodeWrappedPythonObject;
+    readonly importAsync: (name: string) => Promise<PyNodeWrappedPythonObject>;
     readonly eval: (expr: string) => number;
+    readonly compile: (source: string, mode?: "exec" | "eval" | "single", filename?: string) => PyNodeWrappedPythonObject;
+    /**
+     * Converts instances of ctor (exact prototype match) as converter(value)
+     * instead of wrapping them, eg Map => Object.fromEntries(value). Pass
+     * null to unregister. Python code can do the reverse with
+     * pynode.register_converter(type, fn).
+     */
+    /**
+     * Lets V8 free reference cycles that run through Python objects only
+     * kept alive by JS. Walks every tracked Python object, so call it
+     * periodically rather than per request.
+     */
+    readonly collectCycles: () => { objects: number; weak: number; restored: number; released: number };
+    readonly configureMemoryPressure: (options?: PyNodeMemoryPressureOptions) => PyNodeMemoryPressureStatus;
+    readonly configureAutoDispatch: (options?: PyNodeAutoDispatchOptions) => PyNodeAutoDispatchStatus;
+    readonly configureConversion: (options?: PyNodeConversionOptions) => PyNodeConversionStatus;
+    readonly registerToPython: (ctor: Function, converter: ((value: any) => any) | null) => void;
+    readonly evaluate: (code: string | PyNodeWrappedPythonObject, globals?: object, locals?: object) => PyNodeValue;
+    readonly PythonError: typeof PythonError;
+    readonly createChannel: (size: number) => PyNodeChannel;
+    readonly getStats: () => PyNodeStats;
+    /** Compiles a schema once for use with __typed__ */
+    readonly schema: (spec: PyNodeSchemaSpec) => PyNodeSchema;
+    /** Wraps a Readable or (async) iterable of strings and buffers for Python, where it is a pynode.JSStream */
+    readonly createStream: (source: AsyncIterable<any> | Iterable<any>, options?: { highWaterMark?: number }) => PyNodeStream;
+    readonly startTracing: (options?: { pythonFrames?: boolean; maxEvents?: number }) => void;
+    readonly stopTracing: (filename: string) => number;
+    readonly enableAllocationTracking: (enable?: boolean) => void;
+    readonly getAllocationStats: () => PyNodeAllocationStats;
+    readonly openSharedMemory: (name: string, size: number, create?: boolean) => ArrayBuffer;
+    readonly unlinkSharedMemory: (name: string) => void;
   };
 
+  export interface PyNodeCallAllocations {
+    calls: number;
+    /** Bytes allocated during the calls */
+    allocated: number;
+    /** Largest net allocation reached during a single call */
+    peak: number;
+    /** Net bytes still allocated when the calls returned */
+    retained: number;
+  }
+
+  export interface PyNodeAllocationStats {
+    enabled: boolean;
+    /** Bytes allocated since tracking was enabled that are still live */
+    liveBytes: number;
+    totals: PyNodeCallAllocations;
+    last?: PyNodeCallAllocations & { name: string };
+    byCallable: Record<string, PyNodeCallAllocations>;
+  }
+
+  export interface PyNodeMemoizeOptions {
+    /** Least recently used entries are evicted past this, defaults to 1024 */
+    maxEntries?: number;
+    /** Entries expire this long after their result arrived, 0 (default) never */
+    ttlMs?: number;
+    /** Calls whose encoded arguments are larger bypass the cache, defaults to 64KiB */
+    maxKeyBytes?: number;
+  }
+
+  /** Keeps the Python result, every hit gets a freshly converted copy */
+  export interface PyNodeMemoized {
+    __call__(...args: any[]): PyNodeValue;
+    __callasync__(...args: [...any[], (err: Error | null, result?: PyNodeValue) => void]): void;
+    __callasync_promise__(...args: any[]): Promise<PyNodeValue>;
+    stats(): { hits: number; misses: number; uncacheable: number; evictions: number; entries: number; hitRate: number };
+    clear(): void;
+  }
+
+  /**
+   * 'int' | 'float' | 'str' | 'bool' | 'any', suffixed with '[]' for a list
+   * and '?' to allow null/None, [element] for a list or {field: spec}
+   */
+  export type PyNodeSchemaSpec = string | [PyNodeSchemaSpec] | { [field: string]: PyNodeSchemaSpec };
+
+  export interface PyNodeSchema {
+    toString(): string;
+  }
+
+  /** Mismatching values throw (or reject with) a TypeError naming the path */
+  export interface PyNodeTyped {
+    __call__(...args: any[]): PyNodeValue;
+    __callasync_promise__(...args: any[]): Promise<PyNodeValue>;
+  }
+
+  /** Chunks are prefetched up to highWaterMark bytes (1MiB by default) */
+  export interface PyNodeStream {}
+
+  export interface PyNodeStats {
+    /** Live PyNode instances across all worker threads */
+    envs: number;
+    /** Python objects of this env with a live JS wrapper */
+    objectMappings?: number;
+    weakRefs?: number;
+    /** sys.getallocatedblocks() */
+    pyAllocatedBlocks?: number;
+    /** sys.gettotalrefcount(), debug builds of Python only */
+    pyTotalRefcount?: number;
+  }
+
   export const pynode: PyNode;
 
+  export interface PyNodePoolOptions {
+    /** Number of worker processes, defaults to the CPU count */
+    size?: number;
+    /** Python executable, defaults to $PYTHON or python3 */
+    python?: string;
+    sysPath?: string[];
+    /** Modules imported in every worker at startup */
+    preload?: string[];
+    env?: Record<string, string>;
+    /** Bytes of shared memory per worker for arguments and results */
+    segmentSize?: number;
+    healthCheckIntervalMs?: number;
+    /** Kill and restart a worker that doesn't answer a ping in time, eg one stuck in a call holding the GIL */
+    healthCheckTimeoutMs?: number;
+    /** Kill and restart a worker whose call takes longer than this, 0 to disable */
+    callTimeoutMs?: number;
+    restart?: boolean;
+    restartDelayMs?: number;
+  }
+
+  export class PoolPythonError extends Error {
+    readonly pyType: string;
+    readonly pyMessage: string;
+  }
+
+  export class PoolPythonObject {
+    __getattr__(name: string): PoolPythonObject;
+    __callasync_promise__(...args: any[]): Promise<any>;
+    __callasync__(...args: [...any[], (err: Error | null, result?: any) => void]): void;
+    /** Fetches the value itself (handles come back as PoolPythonObject) */
+    __resolve__(): Promise<any>;
+    readonly __worker__: number | undefined;
+  }
+
+  export class PyNodePool {
+    constructor(options?: PyNodePoolOptions);
+    import(name: string, options?: { worker?: number }): PoolPythonObject;
+    close(): Promise<void>;
+  }
+
+  export const createPool: (options?: PyNodePoolOptions) => PyNodePool;
+
   export default pynode;
 }
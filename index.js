@@ -3,3 +3,4 @@ import { createRequire } from "node:module";
 const require = createRequire(import.meta.url);
 
 export const pynode = require("./build/Release/PyNode");
+export { createPool, PyNodePool, PoolPythonObject, PoolPythonError } from "./pool.js";
@@ -0,0 +1,614 @@
+// Pool of child Python processes behind the async half of the
+// PyNodeWrappedPythonObject API. CPU bound handlers scale across cores and a
+// crashing extension only takes down its own worker, which is restarted.
+// Arguments and results go through a shared memory segment per worker (inline
+// on the pipe when they don't fit) using the usual conversion rules; Python
+// objects that don't convert stay in their worker and come back as handles.
+import { createRequire } from "node:module"
+import { spawn } from "node:child_process"
+import { cpus } from "node:os"
+import { randomBytes } from "node:crypto"
+import { fileURLToPath } from "node:url"
+import { dirname, join, resolve } from "node:path"
+
+const require = createRequire(import.meta.url)
+const native = require("./build/Release/PyNode")
+
+const OP_CALL = 1
+const OP_PING = 2
+const OP_RESULT = 3
+const OP_ERROR = 4
+const OP_PONG = 5
+const OP_RELEASE = 6
+const OP_READY = 7
+
+const FLAG_SHM = 1
+const HEADER_SIZE = 16
+
+const T_NONE = 0
+const T_FALSE = 1
+const T_TRUE = 2
+const T_INT = 3
+const T_FLOAT = 4
+const T_STR = 5
+const T_LIST = 6
+const T_DICT = 7
+const T_BIGINT = 8
+const T_HANDLE = 9
+const T_BYTES = 10
+
+const WORKER_SCRIPT = join(dirname(fileURLToPath(import.meta.url)), "pool_worker.py")
+
+// Segments only need their name until the worker has attached, whatever is
+// still linked when the process exits goes with it
+const linkedSegments = new Set()
+process.on('exit', () => {
+  for (const name of linkedSegments) {
+    native.unlinkSharedMemory(name)
+  }
+})
+
+const textEncoder = new TextEncoder()
+const textDecoder = new TextDecoder()
+
+export class PoolPythonError extends Error {
+  constructor(pyType, pyMessage, pyTraceback) {
+    super(`<class '${pyType}'>: ${pyMessage}`)
+    this.name = 'PythonError'
+    this.pyType = pyType
+    this.pyMessage = pyMessage
+    this.stack = `${this.name}: ${this.message}\n${pyTraceback}`
+  }
+}
+
+class Overflow extends Error {}
+
+// Writes into a fixed view (the shared segment) or, with grow set, a buffer
+// that doubles as needed
+class Writer {
+  constructor(bytes, grow) {
+    this.bytes = bytes
+    this.view = new DataView(bytes.buffer, bytes.byteOffset, bytes.byteLength)
+    this.grow = grow
+    this.pos = 0
+  }
+
+  reserve(n) {
+    if (this.pos + n <= this.bytes.length) {
+      return
+    }
+    if (!this.grow) {
+      throw new Overflow()
+    }
+    const bytes = new Uint8Array(Math.max(this.bytes.length * 2, this.pos + n))
+    bytes.set(this.bytes.subarray(0, this.pos))
+    this.bytes = bytes
+    this.view = new DataView(bytes.buffer)
+  }
+
+  u8(v) {
+    this.reserve(1)
+    this.bytes[this.pos++] = v
+  }
+
+  u32(v) {
+    this.reserve(4)
+    this.view.setUint32(this.pos, v, true)
+    this.pos += 4
+  }
+
+  f64(v) {
+    this.reserve(8)
+    this.view.setFloat64(this.pos, v, true)
+    this.pos += 8
+  }
+
+  raw(bytes) {
+    this.u32(bytes.length)
+    this.reserve(bytes.length)
+    this.bytes.set(bytes, this.pos)
+    this.pos += bytes.length
+  }
+
+  str(s) {
+    this.reserve(4 + s.length * 3)
+    const { written } = textEncoder.encodeInto(s, this.bytes.subarray(this.pos + 4))
+    this.view.setUint32(this.pos, written, true)
+    this.pos += 4 + written
+  }
+}
+
+const isPlainObject = (value) => {
+  const proto = Object.getPrototypeOf(value)
+  return proto === Object.prototype || proto === null
+}
+
+const encode = (value, w, worker) => {
+  if (value === null || value === undefined) {
+    w.u8(T_NONE)
+  } else if (typeof value === 'boolean') {
+    w.u8(value ? T_TRUE : T_FALSE)
+  } else if (typeof value === 'number') {
+    w.u8(Number.isInteger(value) ? T_INT : T_FLOAT)
+    w.f64(value)
+  } else if (typeof value === 'string') {
+    w.u8(T_STR)
+    w.str(value)
+  } else if (typeof value === 'bigint') {
+    w.u8(T_BIGINT)
+    w.str(value.toString())
+  } else if (Array.isArray(value)) {
+    w.u8(T_LIST)
+    w.u32(value.length)
+    for (const item of value) {
+      encode(item, w, worker)
+    }
+  } else if (ArrayBuffer.isView(value)) {
+    w.u8(T_BYTES)
+    w.raw(new Uint8Array(value.buffer, value.byteOffset, value.byteLength))
+  } else if (value instanceof PoolPythonObject) {
+    w.u8(T_HANDLE)
+    w.u32(value[HANDLE].handleFor(worker))
+  } else if (typeof value === 'object' && isPlainObject(value)) {
+    const keys = Object.keys(value)
+    w.u8(T_DICT)
+    w.u32(keys.length)
+    for (const key of keys) {
+      w.str(key)
+      encode(value[key], w, worker)
+    }
+  } else {
+    const kind = typeof value === 'object' ? value.constructor?.name ?? 'object' : typeof value
+    throw new TypeError(`A ${kind} can't be sent to a pool worker`)
+  }
+}
+
+const decode = (r, worker) => {
+  const tag = r.bytes[r.pos++]
+  switch (tag) {
+    case T_NONE:
+      return null
+    case T_FALSE:
+      return false
+    case T_TRUE:
+      return true
+    case T_INT:
+    case T_FLOAT: {
+      const v = r.view.getFloat64(r.pos, true)
+      r.pos += 8
+      return v
+    }
+    case T_STR: {
+      const length = r.view.getUint32(r.pos, true)
+      const s = textDecoder.decode(r.bytes.subarray(r.pos + 4, r.pos + 4 + length))
+      r.pos += 4 + length
+      return s
+    }
+    case T_BIGINT: {
+      const length = r.view.getUint32(r.pos, true)
+      const s = textDecoder.decode(r.bytes.subarray(r.pos + 4, r.pos + 4 + length))
+      r.pos += 4 + length
+      return BigInt(s)
+    }
+    case T_BYTES: {
+      const length = r.view.getUint32(r.pos, true)
+      const b = Buffer.from(r.bytes.subarray(r.pos + 4, r.pos + 4 + length))
+      r.pos += 4 + length
+      return b
+    }
+    case T_LIST: {
+      const count = r.view.getUint32(r.pos, true)
+      r.pos += 4
+      const items = new Array(count)
+      for (let i = 0; i < count; i++) {
+        items[i] = decode(r, worker)
+      }
+      return items
+    }
+    case T_DICT: {
+      const count = r.view.getUint32(r.pos, true)
+      r.pos += 4
+      const obj = {}
+      for (let i = 0; i < count; i++) {
+        const length = r.view.getUint32(r.pos, true)
+        const key = textDecoder.decode(r.bytes.subarray(r.pos + 4, r.pos + 4 + length))
+        r.pos += 4 + length
+        obj[key] = decode(r, worker)
+      }
+      return obj
+    }
+    case T_HANDLE: {
+      const handle = r.view.getUint32(r.pos, true)
+      r.pos += 4
+      return worker.adopt(handle)
+    }
+    default:
+      throw new Error(`Unknown value tag ${tag} from pool worker`)
+  }
+}
+
+const reader = (bytes) => ({ bytes, view: new DataView(bytes.buffer, bytes.byteOffset, bytes.byteLength), pos: 0 })
+
+const HANDLE = Symbol('pynode.pool.handle')
+
+// Where a PoolPythonObject points: a module (any worker, unless pinned) or a
+// handle living in one worker, plus an attribute path resolved on the way
+class Target {
+  constructor(pool, { module, handle, worker, generation, owner, path = [] }) {
+    this.pool = pool
+    this.module = module
+    this.handle = handle
+    this.worker = worker
+    this.generation = generation
+    // The object whose collection releases the handle, kept alive by everything derived from it
+    this.owner = owner
+    this.path = path
+  }
+
+  child(name) {
+    return new Target(this.pool, { ...this, path: [...this.path, name] })
+  }
+
+  handleFor(worker) {
+    if (this.handle === undefined || this.path.length) {
+      throw new TypeError('Only objects returned by a pool call can be passed back to it')
+    }
+    if (worker !== this.worker || this.generation !== worker.generation) {
+      throw new TypeError('Pool objects can only be passed back to the worker that created them')
+    }
+    return this.handle
+  }
+}
+
+export class PoolPythonObject {
+  constructor(target) {
+    this[HANDLE] = target
+  }
+
+  // Lazy, resolved in the worker as part of the next call
+  __getattr__(name) {
+    return new PoolPythonObject(this[HANDLE].child(name))
+  }
+
+  __callasync_promise__(...args) {
+    const target = this[HANDLE]
+    return target.pool.request(target, args, true)
+  }
+
+  __callasync__(...args) {
+    const callback = args.pop()
+    if (typeof callback !== 'function') {
+      throw new Error("Last argument to 'call' must be a function")
+    }
+    this.__callasync_promise__(...args).then((result) => callback(null, result), (error) => callback(error))
+  }
+
+  // The converted value at this attribute path, without calling it
+  __resolve__() {
+    const target = this[HANDLE]
+    return target.pool.request(target, [], false)
+  }
+
+  get __worker__() {
+    return this[HANDLE].worker?.index
+  }
+}
+
+class PoolWorker {
+  constructor(pool, index) {
+    this.pool = pool
+    this.index = index
+    this.generation = 0
+    this.queue = []
+    this.inflight = null
+    this.nextId = 1
+    this.pendingRelease = []
+    // Set once the worker won't be restarted, calls routed here fail with it
+    this.deadError = null
+    this.segmentName = `pyn_${process.pid.toString(36)}_${pool.id}_${index}`
+    this.start()
+  }
+
+  // A fresh segment per worker process, unlinked once it has attached so a
+  // crash of either side can't leave it behind in /dev/shm
+  openSegment() {
+    this.segment = new Uint8Array(native.openSharedMemory(this.segmentName, this.pool.options.segmentSize, true))
+    linkedSegments.add(this.segmentName)
+  }
+
+  unlinkSegment() {
+    if (linkedSegments.delete(this.segmentName)) {
+      native.unlinkSharedMemory(this.segmentName)
+    }
+  }
+
+  get load() {
+    return this.queue.length + (this.inflight ? 1 : 0)
+  }
+
+  start() {
+    const { options } = this.pool
+    if (!linkedSegments.has(this.segmentName)) {
+      this.openSegment()
+    }
+    this.generation++
+    this.ready = false
+    this.readyOnce = false
+    this.input = new Uint8Array(0)
+    this.child = spawn(options.python, [WORKER_SCRIPT, this.segmentName, ...options.sysPath], {
+      stdio: ['pipe', 'pipe', 'inherit'],
+      env: { ...process.env, ...options.env }
+    })
+    const child = this.child
+    // Writes racing a crash fail with EPIPE, the exit handler deals with it
+    child.stdin.on('error', () => {})
+    child.stdout.on('data', (chunk) => this.onData(chunk))
+    child.on('error', (error) => this.onExit(child, error))
+    child.on('exit', (code, signal) => this.onExit(child, new Error(`Python pool worker ${this.index} exited (${signal ?? code})`)))
+  }
+
+  // Handles from a restarted worker are gone, so they are tagged with the generation
+  adopt(handle) {
+    const obj = new PoolPythonObject(new Target(this.pool, { handle, worker: this, generation: this.generation }))
+    obj[HANDLE].owner = obj
+    this.pool.registry.register(obj, { worker: this, handle, generation: this.generation })
+    return obj
+  }
+
+  release(handle, generation) {
+    if (generation !== this.generation) {
+      return
+    }
+    this.pendingRelease.push(handle)
+    if (this.pendingRelease.length === 1) {
+      queueMicrotask(() => this.flushReleases())
+    }
+  }
+
+  flushReleases() {
+    if (!this.ready || !this.pendingRelease.length) {
+      return
+    }
+    const payload = new Uint8Array(this.pendingRelease.length * 4)
+    const view = new DataView(payload.buffer)
+    this.pendingRelease.forEach((handle, i) => view.setUint32(i * 4, handle, true))
+    this.pendingRelease = []
+    this.write(OP_RELEASE, 0, payload, false)
+  }
+
+  enqueue(request) {
+    if (this.deadError) {
+      request.reject(this.deadError)
+      return
+    }
+    this.queue.push(request)
+    this.pump()
+  }
+
+  pump() {
+    if (!this.ready || this.inflight || !this.queue.length) {
+      return
+    }
+    const request = this.queue.shift()
+    if (request.generation !== undefined && request.generation !== this.generation) {
+      request.reject(new Error('The pool worker holding this object was restarted'))
+      this.pump()
+      return
+    }
+    try {
+      // Straight into the segment when it fits, over the pipe otherwise
+      let w = new Writer(this.segment, false)
+      let shared = true
+      try {
+        encode(request.message, w, this)
+      } catch (e) {
+        if (!(e instanceof Overflow)) {
+          throw e
+        }
+        w = new Writer(new Uint8Array(1024), true)
+        encode(request.message, w, this)
+        shared = false
+      }
+      request.id = this.nextId++
+      this.inflight = request
+      this.write(OP_CALL, request.id, shared ? w.pos : w.bytes.subarray(0, w.pos), shared)
+      if (this.pool.options.callTimeoutMs) {
+        request.timer = setTimeout(() => this.kill(new Error('Python pool call timed out')), this.pool.options.callTimeoutMs)
+      }
+    } catch (e) {
+      this.inflight = null
+      request.reject(e)
+      this.pump()
+    }
+  }
+
+  write(op, id, payload, shared) {
+    const length = shared ? payload : payload.length
+    const header = new DataView(new ArrayBuffer(HEADER_SIZE))
+    header.setUint32(0, op, true)
+    header.setUint32(4, id, true)
+    header.setUint32(8, length, true)
+    header.setUint32(12, shared ? FLAG_SHM : 0, true)
+    this.child.stdin.write(new Uint8Array(header.buffer))
+    if (!shared && length) {
+      this.child.stdin.write(payload)
+    }
+  }
+
+  // Also while a call is in flight, the worker answers from its reader thread
+  // unless the call is stuck holding the GIL
+  ping() {
+    if (!this.ready || this.pingTimer) {
+      return
+    }
+    this.pingTimer = setTimeout(() => this.kill(new Error(`Python pool worker ${this.index} failed its health check`)), this.pool.options.healthCheckTimeoutMs)
+    this.write(OP_PING, 0, new Uint8Array(0), false)
+  }
+
+  onData(chunk) {
+    this.input = this.input.length ? Buffer.concat([this.input, chunk]) : chunk
+    while (this.input.length >= HEADER_SIZE) {
+      const header = new DataView(this.input.buffer, this.input.byteOffset, HEADER_SIZE)
+      const op = header.getUint32(0, true)
+      const id = header.getUint32(4, true)
+      const length = header.getUint32(8, true)
+      const shared = header.getUint32(12, true) & FLAG_SHM
+      const frameLength = HEADER_SIZE + (shared ? 0 : length)
+      if (this.input.length < frameLength) {
+        return
+      }
+      const payload = shared ? this.segment.subarray(0, length) : this.input.subarray(HEADER_SIZE, frameLength)
+      this.input = this.input.subarray(frameLength)
+      this.onMessage(op, id, payload)
+    }
+  }
+
+  onMessage(op, id, payload) {
+    if (op === OP_READY) {
+      // Windows segments already go away with their last handle
+      if (process.platform !== 'win32') {
+        this.unlinkSegment()
+      }
+      this.ready = true
+      this.readyOnce = true
+      this.flushReleases()
+      this.pump()
+    } else if (op === OP_PONG) {
+      clearTimeout(this.pingTimer)
+      this.pingTimer = null
+    } else if ((op === OP_RESULT || op === OP_ERROR) && this.inflight?.id === id) {
+      const request = this.inflight
+      this.inflight = null
+      clearTimeout(request.timer)
+      try {
+        // Decoded right away, the next request reuses the segment
+        const value = decode(reader(payload), this)
+        if (op === OP_RESULT) {
+          request.resolve(value)
+        } else {
+          request.reject(new PoolPythonError(...value))
+        }
+      } catch (e) {
+        request.reject(e)
+      }
+      this.pump()
+    }
+  }
+
+  kill(error) {
+    this.killError = error
+    this.child.kill('SIGKILL')
+  }
+
+  onExit(child, error) {
+    if (child !== this.child || this.exited === child) {
+      return
+    }
+    this.exited = child
+    this.ready = false
+    clearTimeout(this.pingTimer)
+    this.pingTimer = null
+    this.pendingRelease = []
+
+    const reason = this.killError ?? error
+    this.killError = null
+    if (this.inflight) {
+      clearTimeout(this.inflight.timer)
+      this.inflight.reject(reason)
+      this.inflight = null
+    }
+
+    // Give up on a worker that keeps dying before it is even ready (eg no python)
+    this.failures = this.readyOnce ? 0 : (this.failures ?? 0) + 1
+    if (this.pool.closed || !this.pool.options.restart || this.failures >= 3) {
+      this.deadError = new Error(`Python pool worker ${this.index} has stopped: ${reason.message}`, { cause: reason })
+      this.unlinkSegment()
+      for (const request of this.queue.splice(0)) {
+        request.reject(reason)
+      }
+      return
+    }
+    // Queued calls on modules survive the restart, handles don't
+    this.restartTimer = setTimeout(() => this.start(), this.pool.options.restartDelayMs)
+  }
+
+  close() {
+    clearTimeout(this.restartTimer)
+    clearTimeout(this.pingTimer)
+    for (const request of this.queue.splice(0)) {
+      request.reject(new Error('The pool is closed'))
+    }
+    const running = this.exited !== this.child && this.child.exitCode === null && this.child.signalCode === null
+    const closed = running ? new Promise((resolve) => this.child.once('exit', resolve)) : Promise.resolve()
+    this.child.stdin.end()
+    this.child.kill()
+    this.unlinkSegment()
+    return closed
+  }
+}
+
+export class PyNodePool {
+  constructor(options = {}) {
+    this.options = {
+      size: cpus().length,
+      python: process.env.PYTHON || (process.platform === 'win32' ? 'python' : 'python3'),
+      sysPath: [],
+      preload: [],
+      env: {},
+      segmentSize: 8 << 20,
+      healthCheckIntervalMs: 5000,
+      healthCheckTimeoutMs: 2000,
+      callTimeoutMs: 0,
+      restart: true,
+      restartDelayMs: 250,
+      ...options
+    }
+    this.options.sysPath = this.options.sysPath.map((p) => resolve(p))
+    this.id = randomBytes(3).toString('hex')
+    this.closed = false
+    this.registry = new FinalizationRegistry(({ worker, handle, generation }) => worker.release(handle, generation))
+    this.workers = Array.from({ length: Math.max(1, this.options.size) }, (_, i) => new PoolWorker(this, i))
+    for (const module of this.options.preload) {
+      for (const worker of this.workers) {
+        worker.enqueue({ message: [module, ['__name__'], [], false], resolve: () => {}, reject: () => {} })
+      }
+    }
+    this.healthTimer = setInterval(() => this.workers.forEach((w) => w.ping()), this.options.healthCheckIntervalMs)
+    this.healthTimer.unref()
+  }
+
+  // Module state is per worker. Pass { worker: i } to keep using one of them.
+  import(name, { worker } = {}) {
+    return new PoolPythonObject(new Target(this, { module: name, worker: worker === undefined ? undefined : this.workers[worker] }))
+  }
+
+  request(target, args, call) {
+    if (this.closed) {
+      return Promise.reject(new Error('The pool is closed'))
+    }
+    // Pinned targets stay on their worker and fail in enqueue() if it is gone
+    const live = target.worker ? [target.worker] : this.workers.filter((w) => !w.deadError)
+    if (!live.length) {
+      return Promise.reject(new Error('No Python pool workers are left running'))
+    }
+    const worker = live.reduce((best, w) => (w.load < best.load ? w : best))
+    return new Promise((resolve, reject) => {
+      const message = [target.module ?? null, target.path, args, call]
+      if (target.handle !== undefined) {
+        message[0] = new PoolPythonObject(new Target(this, { handle: target.handle, worker, generation: target.generation }))
+      }
+      worker.enqueue({ message, generation: target.generation, owner: target.owner, resolve, reject })
+    })
+  }
+
+  async close() {
+    if (this.closed) {
+      return
+    }
+    this.closed = true
+    clearInterval(this.healthTimer)
+    await Promise.all(this.workers.map((w) => w.close()))
+  }
+}
+
+export const createPool = (options) => new PyNodePool(options)
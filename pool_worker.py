@@ -0,0 +1,260 @@
+"""Child process side of pool.js.
+
+Requests arrive on stdin as 16 byte frames (op, id, length, flags), with the
+payload either inline after the header or at the start of the shared memory
+segment named on the command line. Replies go back the same way on the
+original stdout; print() ends up on stderr. Values use the same conversion
+rules as the embedded interpreter, objects that can't be converted stay here
+and travel as handles. Pings are answered by the thread reading stdin, so a
+call that holds on to the GIL makes the worker miss its health check.
+"""
+import importlib
+import os
+import queue
+import struct
+import sys
+import threading
+import traceback
+from multiprocessing import shared_memory
+
+OP_CALL = 1
+OP_PING = 2
+OP_RESULT = 3
+OP_ERROR = 4
+OP_PONG = 5
+OP_RELEASE = 6
+OP_READY = 7
+
+FLAG_SHM = 1
+
+T_NONE = 0
+T_FALSE = 1
+T_TRUE = 2
+T_INT = 3
+T_FLOAT = 4
+T_STR = 5
+T_LIST = 6
+T_DICT = 7
+T_BIGINT = 8
+T_HANDLE = 9
+T_BYTES = 10
+
+HEADER = struct.Struct('<IIII')
+U32 = struct.Struct('<I')
+F64 = struct.Struct('<d')
+
+
+class Handles:
+  def __init__(self):
+    self.objects = {}
+    self.next_id = 1
+
+  def add(self, obj):
+    handle = self.next_id
+    self.next_id += 1
+    self.objects[handle] = obj
+    return handle
+
+  def get(self, handle):
+    try:
+      return self.objects[handle]
+    except KeyError:
+      raise ReferenceError('Unknown pool handle %d' % handle) from None
+
+  def release(self, handle):
+    self.objects.pop(handle, None)
+
+
+def encode(value, out, handles):
+  if value is None:
+    out.append(T_NONE)
+  elif isinstance(value, bool):
+    out.append(T_TRUE if value else T_FALSE)
+  elif isinstance(value, (int, float)):
+    # Every int goes back as a double, like PyLong_AsDouble in the embedded
+    # path. Only JS BigInts arrive as T_BIGINT.
+    out.append(T_INT if isinstance(value, int) else T_FLOAT)
+    out += F64.pack(float(value))
+  elif isinstance(value, (str, bytes)):
+    data = value.encode('utf-8') if isinstance(value, str) else value.split(b'\0', 1)[0]
+    out.append(T_STR)
+    out += U32.pack(len(data))
+    out += data
+  elif isinstance(value, (list, tuple)):
+    out.append(T_LIST)
+    out += U32.pack(len(value))
+    for item in value:
+      encode(item, out, handles)
+  elif isinstance(value, dict):
+    out.append(T_DICT)
+    out += U32.pack(len(value))
+    for key, item in value.items():
+      data = str(key).encode('utf-8')
+      out += U32.pack(len(data))
+      out += data
+      encode(item, out, handles)
+  else:
+    out.append(T_HANDLE)
+    out += U32.pack(handles.add(value))
+
+
+def decode(view, pos, handles):
+  tag = view[pos]
+  pos += 1
+  if tag == T_NONE:
+    return None, pos
+  if tag == T_FALSE:
+    return False, pos
+  if tag == T_TRUE:
+    return True, pos
+  if tag == T_INT or tag == T_FLOAT:
+    number = F64.unpack_from(view, pos)[0]
+    return (int(number) if tag == T_INT else number), pos + 8
+  if tag in (T_STR, T_BIGINT, T_BYTES):
+    length = U32.unpack_from(view, pos)[0]
+    pos += 4
+    data = bytes(view[pos:pos + length])
+    pos += length
+    if tag == T_BYTES:
+      return data, pos
+    text = data.decode('utf-8')
+    return (int(text) if tag == T_BIGINT else text), pos
+  if tag == T_LIST:
+    count = U32.unpack_from(view, pos)[0]
+    pos += 4
+    items = []
+    for _ in range(count):
+      item, pos = decode(view, pos, handles)
+      items.append(item)
+    return items, pos
+  if tag == T_DICT:
+    count = U32.unpack_from(view, pos)[0]
+    pos += 4
+    items = {}
+    for _ in range(count):
+      length = U32.unpack_from(view, pos)[0]
+      pos += 4
+      key = bytes(view[pos:pos + length]).decode('utf-8')
+      pos += length
+      items[key], pos = decode(view, pos, handles)
+    return items, pos
+  if tag == T_HANDLE:
+    return handles.get(U32.unpack_from(view, pos)[0]), pos + 4
+  raise ValueError('Unknown value tag %d' % tag)
+
+
+def attach(name):
+  try:
+    return shared_memory.SharedMemory(name=name, track=False)
+  except TypeError:
+    # Before 3.13 attaching also registers with the resource tracker, which
+    # would unlink the segment when this process exits. pool.js owns it.
+    shm = shared_memory.SharedMemory(name=name)
+    try:
+      from multiprocessing import resource_tracker
+      resource_tracker.unregister(shm._name, 'shared_memory')
+    except Exception:
+      pass
+    return shm
+
+
+def read_exact(stream, length):
+  data = bytearray()
+  while len(data) < length:
+    chunk = stream.read(length - len(data))
+    if not chunk:
+      return None
+    data += chunk
+  return data
+
+
+class Worker:
+  def __init__(self, shm, out):
+    self.shm = shm
+    self.out = out
+    self.out_lock = threading.Lock()
+    self.handles = Handles()
+    self.requests = queue.SimpleQueue()
+
+  def send(self, op, request_id, payload=b''):
+    with self.out_lock:
+      if payload and len(payload) <= self.shm.size:
+        self.shm.buf[:len(payload)] = payload
+        self.out.write(HEADER.pack(op, request_id, len(payload), FLAG_SHM))
+      else:
+        self.out.write(HEADER.pack(op, request_id, len(payload), 0))
+        self.out.write(payload)
+      self.out.flush()
+
+  def call(self, request_id, view):
+    try:
+      try:
+        (target, path, args, call), _ = decode(view, 0, self.handles)
+      finally:
+        view.release()
+      obj = importlib.import_module(target) if isinstance(target, str) else target
+      for name in path:
+        obj = getattr(obj, name)
+      if call:
+        obj = obj(*args)
+      out = bytearray()
+      encode(obj, out, self.handles)
+      self.send(OP_RESULT, request_id, out)
+    except BaseException as e:
+      if isinstance(e, (KeyboardInterrupt, SystemExit)):
+        raise
+      out = bytearray()
+      encode([type(e).__qualname__, str(e), ''.join(traceback.format_tb(e.__traceback__))], out, self.handles)
+      self.send(OP_ERROR, request_id, out)
+
+  def read(self, stream):
+    """Reader thread: answers pings, hands everything else to run()"""
+    try:
+      while True:
+        header = read_exact(stream, HEADER.size)
+        if header is None:
+          return
+        op, request_id, length, flags = HEADER.unpack(header)
+        data = None if flags & FLAG_SHM else read_exact(stream, length) or b''
+        if op == OP_PING:
+          self.send(OP_PONG, request_id)
+        else:
+          self.requests.put((op, request_id, length, data))
+    finally:
+      self.requests.put(None)
+
+  def run(self, stream):
+    threading.Thread(target=self.read, args=(stream,), daemon=True).start()
+    self.send(OP_READY, 0)
+    while True:
+      request = self.requests.get()
+      if request is None:
+        return
+      op, request_id, length, data = request
+      # The segment is only written by pool.js while no call is in flight
+      view = self.shm.buf[:length] if data is None else memoryview(data)
+
+      if op == OP_CALL:
+        self.call(request_id, view)
+      elif op == OP_RELEASE:
+        for pos in range(0, length, 4):
+          self.handles.release(U32.unpack_from(view, pos)[0])
+        view.release()
+
+
+def main():
+  shm = attach(sys.argv[1])
+  sys.path[0:0] = sys.argv[2:]
+
+  # Keep the protocol on the real stdout, everything printed goes to stderr
+  out = os.fdopen(os.dup(sys.stdout.fileno()), 'wb')
+  os.dup2(sys.stderr.fileno(), sys.stdout.fileno())
+
+  try:
+    Worker(shm, out).run(sys.stdin.buffer)
+  finally:
+    shm.close()
+
+
+if __name__ == '__main__':
+  main()
@@ -0,0 +1,176 @@
+// Concurrency scaling and leak soak harness.
+// `node --expose-gc soak.js [--threads 4] [--inflight 1,8,64,256] [--duration 5]
+//   [--soak 600] [--sample 10] [--out results.json]`
+// Ramps the number of in-flight __callasync_promise__ calls on each of N
+// worker threads (every thread its own env), reporting throughput and latency
+// percentiles per level. With --soak it then keeps the heaviest level running
+// and samples RSS, wrapper mappings and Python allocations, reporting the
+// growth between the first and last sample.
+import { Worker, isMainThread, parentPort, workerData } from "node:worker_threads"
+import { fileURLToPath } from "node:url"
+import { writeFileSync } from "node:fs"
+import { performance } from "node:perf_hooks"
+import { pynode } from "./index.js"
+
+const gc = typeof global.gc === 'function' ? global.gc : () => {}
+
+const runWorker = async ({ index, inflight, durationMs, sampleMs, recordLatencies }) => {
+  pynode.startInterpreter()
+  pynode.appendSysPath('./test_files')
+  const soak = pynode.openFile('soak')
+  const payload = { id: 1, name: 'soak', tags: ['a', 'b'], nested: { x: 1.5 } }
+  const fn = name => soak.__getattr__(name)
+  const echo = fn('echo')
+  const makeObject = fn('make_object')
+  const echoShared = fn('echo_shared')
+  const work = fn('work')
+  const callBack = fn('call_back')
+  const sharedRefcount = fn('shared_refcount')
+
+  // A mix of conversion, wrapper identity churn, GIL bound work and JS callbacks
+  const ops = [
+    () => echo.__callasync_promise__(payload),
+    () => makeObject.__callasync_promise__(1),
+    () => echoShared.__callasync_promise__(),
+    () => work.__callasync_promise__(1000),
+    () => callBack.__callasync_promise__(() => {}, 2)
+  ]
+
+  const sample = () => {
+    gc()
+    return {
+      at: Date.now(),
+      rss: process.memoryUsage().rss,
+      sharedRefcount: sharedRefcount.__call__(),
+      ...pynode.getStats()
+    }
+  }
+
+  const latencies = []
+  let completed = 0
+  let errors = 0
+  const end = performance.now() + durationMs
+  const timer = sampleMs ? setInterval(() => parentPort.postMessage({ type: 'sample', worker: index, completed, ...sample() }), sampleMs) : null
+
+  const lane = async (next) => {
+    while (performance.now() < end) {
+      const op = ops[next++ % ops.length]
+      const start = performance.now()
+      try {
+        await op()
+      } catch (e) {
+        errors++
+      }
+      if (recordLatencies) {
+        latencies.push(performance.now() - start)
+      }
+      completed++
+    }
+  }
+  await Promise.all(Array.from({ length: inflight }, (_, i) => lane(i)))
+  clearInterval(timer)
+
+  const times = Float64Array.from(latencies)
+  parentPort.postMessage({ type: 'done', completed, errors, latencies: times, final: sample() }, [times.buffer])
+}
+
+const percentile = (sorted, p) => sorted.length ? sorted[Math.min(sorted.length - 1, Math.floor(p * sorted.length))] : 0
+
+const runPhase = ({ threads, inflight, durationMs, sampleMs = 0, recordLatencies = true, onSample }) => {
+  const started = performance.now()
+  const workers = Array.from({ length: threads }, (_, index) => new Promise((resolve, reject) => {
+    const worker = new Worker(fileURLToPath(import.meta.url), { workerData: { index, inflight, durationMs, sampleMs, recordLatencies } })
+    worker.on('message', msg => msg.type === 'sample' ? onSample?.(msg) : resolve(msg))
+    worker.on('error', reject)
+    worker.on('exit', code => code && reject(new Error(`soak worker exited with ${code}`)))
+  }))
+  return Promise.all(workers).then(results => {
+    const elapsed = (performance.now() - started) / 1000
+    const latencies = new Float64Array(results.reduce((n, r) => n + r.latencies.length, 0))
+    results.reduce((offset, r) => (latencies.set(r.latencies, offset), offset + r.latencies.length), 0)
+    latencies.sort()
+    const calls = results.reduce((n, r) => n + r.completed, 0)
+    return {
+      threads,
+      inflight,
+      calls,
+      errors: results.reduce((n, r) => n + r.errors, 0),
+      callsPerSecond: calls / elapsed,
+      latencyMs: {
+        p50: percentile(latencies, 0.5),
+        p90: percentile(latencies, 0.9),
+        p99: percentile(latencies, 0.99),
+        max: latencies.length ? latencies[latencies.length - 1] : 0
+      },
+      final: results.map(r => r.final)
+    }
+  })
+}
+
+if (!isMainThread) {
+  await runWorker(workerData)
+} else {
+  const args = process.argv.slice(2)
+  const option = (name, def) => {
+    const i = args.indexOf(name)
+    return i >= 0 ? args[i + 1] : def
+  }
+  const threads = Number(option('--threads', 4))
+  const levels = option('--inflight', '1,8,64,256').split(',').map(Number)
+  const durationMs = Number(option('--duration', 5)) * 1000
+  const soakMs = Number(option('--soak', 0)) * 1000
+  const sampleMs = Number(option('--sample', 10)) * 1000
+  const outFile = option('--out')
+
+  const scaling = []
+  for (const inflight of levels) {
+    const result = await runPhase({ threads, inflight, durationMs })
+    console.error(`threads=${threads} inflight=${inflight} ${Math.round(result.callsPerSecond)} calls/s p99=${result.latencyMs.p99.toFixed(2)}ms`)
+    scaling.push(result)
+  }
+
+  let soak = null
+  if (soakMs > 0) {
+    const samples = []
+    const phase = await runPhase({
+      threads,
+      inflight: Math.max(...levels),
+      durationMs: soakMs,
+      sampleMs,
+      recordLatencies: false,
+      onSample: s => {
+        samples.push(s)
+        console.error(`worker=${s.worker} rss=${(s.rss / 1048576).toFixed(1)}MiB mappings=${s.objectMappings} blocks=${s.pyAllocatedBlocks} shared=${s.sharedRefcount}`)
+      }
+    })
+    // Steady state is whatever a worker's first sample saw, leaks show up as
+    // growth after it. rss and the Python counters are process wide.
+    const keys = ['rss', 'objectMappings', 'weakRefs', 'pyAllocatedBlocks', 'pyTotalRefcount', 'sharedRefcount']
+    const growth = Array.from({ length: threads }, (_, worker) => {
+      const own = samples.filter(s => s.worker === worker)
+      const result = { worker }
+      if (own.length > 1) {
+        for (const key of keys) {
+          if (typeof own[0][key] === 'number') {
+            result[key] = own[own.length - 1][key] - own[0][key]
+          }
+        }
+      }
+      return result
+    })
+    soak = { durationMs: soakMs, calls: phase.calls, errors: phase.errors, samples, growth }
+  }
+
+  const report = JSON.stringify({
+    timestamp: new Date().toISOString(),
+    node: process.version,
+    platform: `${process.platform}-${process.arch}`,
+    scaling,
+    soak
+  }, null, 2)
+
+  if (outFile) {
+    writeFileSync(outFile, report)
+  }
+  console.log(report)
+}
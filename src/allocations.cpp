@@ -0,0 +1,227 @@
+#include "allocations.hpp"
+#include "helpers.hpp"
+#include "pynode.hpp"
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+
+std::atomic<bool> PyNodeAllocations::s_enabled{ false };
+
+namespace {
+  struct CallStats {
+    int64_t calls = 0;
+    int64_t allocated = 0;
+    int64_t peak = 0;
+    int64_t retained = 0;
+  };
+
+  /* Domains we wrap, RAW is left alone since it is used without the GIL */
+  const PyMemAllocatorDomain s_domains[] = { PYMEM_DOMAIN_MEM, PYMEM_DOMAIN_OBJ };
+  PyMemAllocatorEx s_original[2];
+
+  /* Size of every block handed out while hooked, guarded by the GIL. Blocks
+     from before tracking was enabled aren't in here and are not counted. */
+  std::unordered_map<void*, size_t> s_blocks;
+  std::atomic<int64_t> s_liveBytes{ 0 };
+
+  thread_local alloc_scope* t_scope = nullptr;
+
+  std::mutex s_statsMutex;
+  std::map<std::string, CallStats> s_byCallable;
+  CallStats s_totals;
+  std::string s_lastName;
+  CallStats s_last;
+
+  void Track(void* ptr, size_t size) {
+    s_blocks[ptr] = size;
+    s_liveBytes.fetch_add(size, std::memory_order_relaxed);
+    if (t_scope)
+      t_scope->Allocated(size);
+  }
+
+  /* Returns the tracked size of ptr (0 if unknown) and stops tracking it */
+  size_t Untrack(void* ptr) {
+    if (!ptr)
+      return 0;
+    auto it = s_blocks.find(ptr);
+    if (it == s_blocks.end())
+      return 0;
+    size_t size = it->second;
+    s_blocks.erase(it);
+    s_liveBytes.fetch_sub(size, std::memory_order_relaxed);
+    if (t_scope)
+      t_scope->Freed(size);
+    return size;
+  }
+
+  void* HookMalloc(void* ctx, size_t size) {
+    auto original = static_cast<PyMemAllocatorEx*>(ctx);
+    void* ptr = original->malloc(original->ctx, size);
+    if (ptr)
+      Track(ptr, size);
+    return ptr;
+  }
+
+  void* HookCalloc(void* ctx, size_t nelem, size_t elsize) {
+    auto original = static_cast<PyMemAllocatorEx*>(ctx);
+    void* ptr = original->calloc(original->ctx, nelem, elsize);
+    if (ptr)
+      Track(ptr, nelem * elsize);
+    return ptr;
+  }
+
+  void* HookRealloc(void* ctx, void* ptr, size_t size) {
+    auto original = static_cast<PyMemAllocatorEx*>(ctx);
+    void* result = original->realloc(original->ctx, ptr, size);
+    if (result) {
+      Untrack(ptr);
+      Track(result, size);
+    }
+    return result;
+  }
+
+  void HookFree(void* ctx, void* ptr) {
+    auto original = static_cast<PyMemAllocatorEx*>(ctx);
+    Untrack(ptr);
+    original->free(original->ctx, ptr);
+  }
+
+  /* Both need the GIL */
+  void InstallHooks() {
+    for (size_t i = 0; i < 2; i++) {
+      PyMem_GetAllocator(s_domains[i], &s_original[i]);
+      PyMemAllocatorEx hook = { &s_original[i], HookMalloc, HookCalloc, HookRealloc, HookFree };
+      PyMem_SetAllocator(s_domains[i], &hook);
+    }
+  }
+
+  /* Allocator hooks only unwind in LIFO order, restoring ours while another
+     hook sits on top would hand back an allocator that is no longer current */
+  bool HooksOnTop() {
+    for (size_t i = 0; i < 2; i++) {
+      PyMemAllocatorEx current;
+      PyMem_GetAllocator(s_domains[i], &current);
+      if (current.ctx != &s_original[i] || current.malloc != HookMalloc)
+        return false;
+    }
+    return true;
+  }
+
+  void RemoveHooks() {
+    for (size_t i = 0; i < 2; i++)
+      PyMem_SetAllocator(s_domains[i], &s_original[i]);
+    /* Whatever is still tracked is freed by the original allocator directly */
+    s_blocks.clear();
+    s_liveBytes = 0;
+  }
+
+  std::string CallableName(PyObject* callable) {
+    if (!callable)
+      return "<unknown>";
+    py_object_owned qualname(PyObject_GetAttrString(callable, "__qualname__"));
+    if (qualname && PyUnicode_Check(qualname.get())) {
+      const char* utf8 = PyUnicode_AsUTF8(qualname.get());
+      if (utf8)
+        return utf8;
+    }
+    PyErr_Clear();
+    return Py_TYPE(callable)->tp_name;
+  }
+
+  Napi::Object ToJS(Napi::Env env, const CallStats& stats) {
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("calls", Napi::Number::New(env, static_cast<double>(stats.calls)));
+    result.Set("allocated", Napi::Number::New(env, static_cast<double>(stats.allocated)));
+    result.Set("peak", Napi::Number::New(env, static_cast<double>(stats.peak)));
+    result.Set("retained", Napi::Number::New(env, static_cast<double>(stats.retained)));
+    return result;
+  }
+}
+
+void PyNodeAllocations::BeginCall(alloc_scope* scope, PyObject* callable) {
+  scope->name = CallableName(callable);
+  scope->parent = t_scope;
+  scope->active = true;
+  t_scope = scope;
+}
+
+void PyNodeAllocations::EndCall(alloc_scope* scope) {
+  t_scope = scope->parent;
+  if (t_scope) {
+    int64_t peak = t_scope->current + scope->peak;
+    t_scope->allocated += scope->allocated;
+    t_scope->freed += scope->freed;
+    t_scope->current += scope->current;
+    if (peak > t_scope->peak)
+      t_scope->peak = peak;
+  }
+
+  std::unique_lock lock{ s_statsMutex };
+  for (CallStats* stats : { &s_byCallable[scope->name], &s_totals }) {
+    stats->calls++;
+    stats->allocated += scope->allocated;
+    stats->peak = std::max(stats->peak, scope->peak);
+    stats->retained += scope->current;
+  }
+  s_lastName = scope->name;
+  s_last = { 1, scope->allocated, scope->peak, scope->current };
+}
+
+Napi::Value PyNodeAllocations::Enable(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  bool enable = info.Length() == 0 || info[0].ToBoolean();
+
+  if (!PyNodeInterpreterReady()) {
+    Napi::Error::New(env, "The Python interpreter must be started before tracking allocations")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  py_ensure_gil ctx;
+  if (enable && !IsEnabled()) {
+    {
+      std::unique_lock lock{ s_statsMutex };
+      s_byCallable.clear();
+      s_totals = CallStats();
+      s_lastName.clear();
+      s_last = CallStats();
+    }
+    InstallHooks();
+    s_enabled = true;
+  } else if (!enable && IsEnabled()) {
+    if (!HooksOnTop()) {
+      Napi::Error::New(env, "Another Python allocator hook was installed after allocation tracking, remove it first")
+          .ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+    s_enabled = false;
+    RemoveHooks();
+  }
+  return env.Undefined();
+}
+
+Napi::Value PyNodeAllocations::GetStats(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  Napi::Object result = Napi::Object::New(env);
+  result.Set("enabled", Napi::Boolean::New(env, IsEnabled()));
+  result.Set("liveBytes", Napi::Number::New(env, static_cast<double>(s_liveBytes.load(std::memory_order_relaxed))));
+
+  std::unique_lock lock{ s_statsMutex };
+  result.Set("totals", ToJS(env, s_totals));
+  if (!s_lastName.empty()) {
+    Napi::Object last = ToJS(env, s_last);
+    last.Set("name", Napi::String::New(env, s_lastName));
+    result.Set("last", last);
+  }
+  Napi::Object byCallable = Napi::Object::New(env);
+  for (auto& entry : s_byCallable)
+    byCallable.Set(entry.first, ToJS(env, entry.second));
+  result.Set("byCallable", byCallable);
+  return result;
+}
+
+void PyNodeAllocations::Init(Napi::Env env, Napi::Object exports) {
+  exports.Set("enableAllocationTracking", Napi::Function::New(env, Enable));
+  exports.Set("getAllocationStats", Napi::Function::New(env, GetStats));
+}
@@ -0,0 +1,70 @@
+#ifndef PYNODE_ALLOCATIONS_HPP
+#define PYNODE_ALLOCATIONS_HPP
+
+#include "napi.h"
+#include <Python.h>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+class alloc_scope;
+
+/* Opt-in accounting of Python heap usage per call. Wraps the PyMem and
+   PyObject allocators (both only used with the GIL held) and charges every
+   block to the call running on the allocating thread. */
+class PyNodeAllocations {
+public:
+  static void Init(Napi::Env env, Napi::Object exports);
+
+  static bool IsEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+  /* Called by alloc_scope, BeginCall needs the GIL */
+  static void BeginCall(alloc_scope* scope, PyObject* callable);
+  static void EndCall(alloc_scope* scope);
+
+private:
+  static Napi::Value Enable(const Napi::CallbackInfo& info);
+  static Napi::Value GetStats(const Napi::CallbackInfo& info);
+
+  static std::atomic<bool> s_enabled;
+};
+
+/* Charges the Python allocations made on this thread during its lifetime to
+   callable. Nested scopes also count towards their parent. */
+class alloc_scope {
+public:
+  explicit alloc_scope(PyObject* callable) {
+    if (PyNodeAllocations::IsEnabled())
+      PyNodeAllocations::BeginCall(this, callable);
+  }
+
+  ~alloc_scope() {
+    if (active)
+      PyNodeAllocations::EndCall(this);
+  }
+
+  alloc_scope(const alloc_scope&) = delete;
+  alloc_scope& operator=(const alloc_scope&) = delete;
+
+  void Allocated(size_t size) {
+    allocated += size;
+    current += size;
+    if (current > peak)
+      peak = current;
+  }
+
+  void Freed(size_t size) {
+    freed += size;
+    current -= size;
+  }
+
+  std::string name;
+  alloc_scope* parent = nullptr;
+  bool active = false;
+  int64_t allocated = 0;
+  int64_t freed = 0;
+  int64_t current = 0;
+  int64_t peak = 0;
+};
+
+#endif
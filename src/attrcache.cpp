@@ -0,0 +1,124 @@
+#include "attrcache.hpp"
+#include <unordered_map>
+
+namespace {
+    struct TypeAttr
+    {
+        PyTypeObject *type;
+        PyObject *name;
+        bool operator==(const TypeAttr &other) const { return type == other.type && name == other.name; }
+    };
+
+    struct TypeAttrHash
+    {
+        size_t operator()(const TypeAttr &key) const
+        {
+            return std::hash<void *>()(key.type) * 31 + std::hash<void *>()(key.name);
+        }
+    };
+
+    struct Resolved
+    {
+        unsigned int version = 0;
+        py_object_owned name;  // keeps the key's pointer from being reused
+        py_object_owned descr; // NULL when the MRO doesn't have the name
+    };
+
+    const size_t s_maxNames = 16384;
+    const size_t s_maxResolved = 4096;
+
+    /* Leaked, these hold Python objects and must not be torn down after the interpreter */
+    std::unordered_map<std::string, py_object_owned> &s_names = *new std::unordered_map<std::string, py_object_owned>();
+    std::unordered_map<TypeAttr, Resolved, TypeAttrHash> &s_resolved = *new std::unordered_map<TypeAttr, Resolved, TypeAttrHash>();
+
+    bool HasInstanceDict(PyTypeObject *type)
+    {
+#ifdef Py_TPFLAGS_MANAGED_DICT
+        if (PyType_HasFeature(type, Py_TPFLAGS_MANAGED_DICT))
+            return true;
+#endif
+        return type->tp_dictoffset != 0;
+    }
+
+    /* What the MRO of type resolves name to, or nullptr if the type has no
+       valid version tag to validate a cached answer against */
+    Resolved *Resolve(PyTypeObject *type, PyObject *name)
+    {
+        auto it = s_resolved.find({ type, name });
+        if (it != s_resolved.end() && PyType_HasFeature(type, Py_TPFLAGS_VALID_VERSION_TAG) && it->second.version == type->tp_version_tag)
+            return &it->second;
+
+        /* Assigns a version tag if the type can have one */
+        PyObject *descr = _PyType_Lookup(type, name);
+        if (!PyType_HasFeature(type, Py_TPFLAGS_VALID_VERSION_TAG))
+            return nullptr;
+
+        if (it == s_resolved.end()) {
+            if (s_resolved.size() >= s_maxResolved)
+                s_resolved.clear();
+            it = s_resolved.emplace(TypeAttr{ type, name }, Resolved()).first;
+        }
+        Resolved &resolved = it->second;
+        resolved.version = type->tp_version_tag;
+        resolved.name = ConvertBorrowedObjectToOwned(name);
+        resolved.descr = descr ? ConvertBorrowedObjectToOwned(descr) : nullptr;
+        return &resolved;
+    }
+}
+
+py_object_owned PyNodeAttributeCache::Intern(const std::string &name)
+{
+    auto it = s_names.find(name);
+    if (it != s_names.end())
+        return ConvertBorrowedObjectToOwned(it->second.get());
+
+    py_object_owned str(PyUnicode_FromStringAndSize(name.data(), name.size()));
+    if (!str)
+        return nullptr;
+    PyObject *interned = str.release();
+    PyUnicode_InternInPlace(&interned);
+    str.reset(interned);
+    if (s_names.size() < s_maxNames)
+        s_names.emplace(name, ConvertBorrowedObjectToOwned(interned));
+    return str;
+}
+
+py_object_owned PyNodeAttributeCache::GetAttr(PyObject *obj, PyObject *name)
+{
+    if (!name)
+        return nullptr;
+
+    PyTypeObject *type = Py_TYPE(obj);
+    /* Modules, __getattr__ hooks and the like do their own thing */
+    if (type->tp_getattro != PyObject_GenericGetAttr)
+        return py_object_owned(PyObject_GetAttr(obj, name));
+
+    Resolved *resolved = Resolve(type, name);
+    if (!resolved)
+        return py_object_owned(PyObject_GetAttr(obj, name));
+
+    /* The lookups below can run arbitrary code, keep the descriptor alive through them */
+    py_object_owned descr = resolved->descr ? ConvertBorrowedObjectToOwned(resolved->descr.get()) : nullptr;
+    descrgetfunc get = descr ? Py_TYPE(descr.get())->tp_descr_get : nullptr;
+
+    /* Same precedence as PyObject_GenericGetAttr: data descriptors, then
+       the instance dict, then whatever else the MRO has */
+    if (get && Py_TYPE(descr.get())->tp_descr_set)
+        return py_object_owned(get(descr.get(), obj, (PyObject *)type));
+    if (HasInstanceDict(type)) {
+        py_object_owned dict(PyObject_GenericGetDict(obj, NULL));
+        if (!dict)
+            return nullptr;
+        PyObject *value = PyDict_GetItemWithError(dict.get(), name);
+        if (value)
+            return ConvertBorrowedObjectToOwned(value);
+        if (PyErr_Occurred())
+            return nullptr;
+    }
+    /* Raises the AttributeError */
+    if (!descr)
+        return py_object_owned(PyObject_GetAttr(obj, name));
+    if (get)
+        return py_object_owned(get(descr.get(), obj, (PyObject *)type));
+    return descr;
+}
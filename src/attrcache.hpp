@@ -0,0 +1,22 @@
+#ifndef PYNODE_ATTRCACHE_HPP
+#define PYNODE_ATTRCACHE_HPP
+
+#include <Python.h>
+#include "helpers.hpp"
+#include <string>
+
+/* Attribute lookups from JS. Names are interned once, and what the MRO
+   resolves a (type, name) pair to is cached until the type's version tag
+   changes, so a hit is a lookup in the instance dict or a call through
+   tp_descr_get. Everything here needs the GIL. */
+class PyNodeAttributeCache
+{
+public:
+    /* New reference to the interned str for name */
+    static py_object_owned Intern(const std::string &name);
+    /* Same result as PyObject_GetAttr, NULL with a Python error set on failure */
+    static py_object_owned GetAttr(PyObject *obj, PyObject *name);
+    static py_object_owned GetAttr(PyObject *obj, const std::string &name) { return GetAttr(obj, Intern(name).get()); }
+};
+
+#endif
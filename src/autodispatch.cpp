@@ -0,0 +1,208 @@
+#include "autodispatch.hpp"
+#include "pynode.hpp"
+#include "worker.hpp"
+#include "pyerror.hpp"
+#include "allocations.hpp"
+#include "tracing.hpp"
+#include <algorithm>
+#include <chrono>
+
+std::mutex PyNodeAutoDispatch::s_optionsMutex;
+PyNodeAutoDispatch::Options PyNodeAutoDispatch::s_options;
+std::atomic<int64_t> PyNodeAutoDispatch::s_inlineCalls{ 0 };
+std::atomic<int64_t> PyNodeAutoDispatch::s_offloadedCalls{ 0 };
+std::atomic<int64_t> PyNodeAutoDispatch::s_batches{ 0 };
+std::atomic<int64_t> PyNodeAutoDispatch::s_overBudget{ 0 };
+
+namespace {
+    double ElapsedUs(std::chrono::steady_clock::time_point since)
+    {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - since).count();
+    }
+
+    bool WeakRefAlive(PyObject *ref)
+    {
+#if PY_VERSION_HEX >= 0x030D0000
+        PyObject *target = nullptr;
+        PyWeakref_GetRef(ref, &target);
+        Py_XDECREF(target);
+        return target != nullptr;
+#else
+        return PyWeakref_GetObject(ref) != Py_None;
+#endif
+    }
+
+    /* What a profile is keyed on: the function behind a bound method, the
+       code behind a Python function (shared by its closures) */
+    PyObject *ProfileKey(PyObject *func)
+    {
+        if (PyMethod_Check(func))
+            func = PyMethod_GET_FUNCTION(func);
+        if (PyFunction_Check(func))
+            func = PyFunction_GET_CODE(func);
+        return func;
+    }
+}
+
+void PyNodeCallProfile::Record(double elapsedUs) {
+    PyNodeAutoDispatch::Options options = PyNodeAutoDispatch::GetOptions();
+    averageUs = averageUs < 0 ? elapsedUs : averageUs + options.smoothing * (elapsedUs - averageUs);
+    /* Two thresholds, so a callable near the edge doesn't flip on every call */
+    if (inlined && averageUs > options.offloadThresholdUs)
+        inlined = false;
+    else if (!inlined && averageUs < options.inlineThresholdUs)
+        inlined = true;
+}
+
+PyNodeAutoDispatch::Options PyNodeAutoDispatch::GetOptions() {
+    std::unique_lock lock{ s_optionsMutex };
+    return s_options;
+}
+
+std::shared_ptr<PyNodeCallProfile> PyNodeAutoDispatch::ProfileFor(Napi::Env env, PyObject *func) {
+    auto &state = env.GetInstanceData<PyNodeEnvData>()->autoDispatch;
+    PyObject *key = ProfileKey(func);
+    auto it = state.profiles.find(key);
+    if (it != state.profiles.end() && WeakRefAlive(it->second.ref.get()))
+        return it->second.profile;
+
+    py_object_owned ref(PyWeakref_NewRef(key, NULL));
+    if (!ref) {
+        PyErr_Clear();
+        return nullptr;
+    }
+    if (state.profiles.size() >= state.pruneProfilesAt) {
+        for (auto slot = state.profiles.begin(); slot != state.profiles.end();) {
+            if (WeakRefAlive(slot->second.ref.get()))
+                ++slot;
+            else
+                slot = state.profiles.erase(slot);
+        }
+        state.pruneProfilesAt = std::max<size_t>(64, state.profiles.size() * 2);
+    }
+    auto &slot = state.profiles[key];
+    slot.ref = std::move(ref);
+    slot.profile = std::make_shared<PyNodeCallProfile>();
+    return slot.profile;
+}
+
+Napi::Value PyNodeAutoDispatch::Call(Napi::Env env, PyObject *func, py_object_owned &&args, const std::shared_ptr<PyNodeCallProfile> &profile) {
+    Napi::Promise::Deferred deferred(env);
+    EnvState::Pending call(deferred);
+    call.func = ConvertBorrowedObjectToOwned(func);
+    call.args = std::move(args);
+    call.profile = profile;
+
+    if (!profile->inlined) {
+        Offload(std::move(call));
+        return deferred.Promise();
+    }
+
+    auto &state = env.GetInstanceData<PyNodeEnvData>()->autoDispatch;
+    state.pending.push_back(std::move(call));
+    if (!state.scheduled) {
+        state.scheduled = true;
+        state.queueMicrotask.Call({ state.flush.Value() });
+    }
+    return deferred.Promise();
+}
+
+void PyNodeAutoDispatch::Offload(EnvState::Pending &&call) {
+    s_offloadedCalls++;
+    PyNodeWorker* pnw = new PyNodeWorker(call.deferred, std::move(call.args), std::move(call.func));
+    pnw->SetProfile(std::move(call.profile));
+    pnw->Queue();
+}
+
+Napi::Value PyNodeAutoDispatch::Flush(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    auto &state = env.GetInstanceData<PyNodeEnvData>()->autoDispatch;
+    std::vector<EnvState::Pending> batch;
+    batch.swap(state.pending);
+    state.scheduled = false;
+    if (batch.empty())
+        return env.Undefined();
+
+    trace_span span("PyNodeAutoDispatch::Flush", "pynode");
+    Options options = GetOptions();
+    s_batches++;
+
+    py_ensure_gil ctx;
+    auto start = std::chrono::steady_clock::now();
+    for (auto &call : batch) {
+        /* The rest of a long burst goes to the pool instead of stalling the loop */
+        if (ElapsedUs(start) > options.batchBudgetUs) {
+            s_overBudget++;
+            Offload(std::move(call));
+            continue;
+        }
+
+        s_inlineCalls++;
+        py_object_owned result;
+        auto callStart = std::chrono::steady_clock::now();
+        {
+            alloc_scope allocations(call.func.get());
+            result.reset(PyObject_CallObject(call.func.get(), call.args.get()));
+        }
+        call.profile->Record(ElapsedUs(callStart));
+        call.func = nullptr;
+        call.args = nullptr;
+
+        if (!result) {
+            call.deferred.Reject(PyNodePythonError::New(env, py_exception::Fetch()).Value());
+            continue;
+        }
+        try {
+            call.deferred.Resolve(ConvertFromPython(env, result.get()));
+        }
+        catch (const Napi::Error &e) {
+            call.deferred.Reject(e.Value());
+        }
+    }
+    return env.Undefined();
+}
+
+Napi::Value PyNodeAutoDispatch::Configure(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    Options options = GetOptions();
+    if (info.Length() > 0 && info[0].IsObject()) {
+        auto obj = info[0].As<Napi::Object>();
+        if (obj.Has("inlineThresholdUs"))
+            options.inlineThresholdUs = obj.Get("inlineThresholdUs").ToNumber().DoubleValue();
+        if (obj.Has("offloadThresholdUs"))
+            options.offloadThresholdUs = obj.Get("offloadThresholdUs").ToNumber().DoubleValue();
+        if (obj.Has("smoothing"))
+            options.smoothing = obj.Get("smoothing").ToNumber().DoubleValue();
+        if (obj.Has("batchBudgetUs"))
+            options.batchBudgetUs = obj.Get("batchBudgetUs").ToNumber().DoubleValue();
+        if (!(options.smoothing > 0 && options.smoothing <= 1)) {
+            Napi::RangeError::New(env, "smoothing must be in (0, 1]").ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+        if (!(options.offloadThresholdUs >= options.inlineThresholdUs)) {
+            Napi::RangeError::New(env, "offloadThresholdUs must not be below inlineThresholdUs").ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+        std::unique_lock lock{ s_optionsMutex };
+        s_options = options;
+    }
+
+    auto result = Napi::Object::New(env);
+    result.Set("inlineThresholdUs", Napi::Number::New(env, options.inlineThresholdUs));
+    result.Set("offloadThresholdUs", Napi::Number::New(env, options.offloadThresholdUs));
+    result.Set("smoothing", Napi::Number::New(env, options.smoothing));
+    result.Set("batchBudgetUs", Napi::Number::New(env, options.batchBudgetUs));
+    result.Set("inlineCalls", Napi::Number::New(env, static_cast<double>(s_inlineCalls.load())));
+    result.Set("offloadedCalls", Napi::Number::New(env, static_cast<double>(s_offloadedCalls.load())));
+    result.Set("batches", Napi::Number::New(env, static_cast<double>(s_batches.load())));
+    result.Set("overBudget", Napi::Number::New(env, static_cast<double>(s_overBudget.load())));
+    return result;
+}
+
+void PyNodeAutoDispatch::Init(Napi::Env env, Napi::Object exports) {
+    auto &state = env.GetInstanceData<PyNodeEnvData>()->autoDispatch;
+    state.flush = Napi::Persistent(Napi::Function::New(env, Flush, "PyNodeAutoDispatch"));
+    state.queueMicrotask = Napi::Persistent(env.Global().Get("queueMicrotask").As<Napi::Function>());
+
+    exports.Set("configureAutoDispatch", Napi::Function::New(env, Configure));
+}
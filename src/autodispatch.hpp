@@ -0,0 +1,91 @@
+#ifndef PYNODE_AUTODISPATCH_HPP
+#define PYNODE_AUTODISPATCH_HPP
+
+#include <Python.h>
+#include "napi.h"
+#include "helpers.hpp"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/* Moving average of how long a callable spends in Python, and whether
+   __callauto__ currently runs it inline. Only touched on the JS thread. */
+struct PyNodeCallProfile
+{
+    double averageUs = -1;
+    bool inlined = false;
+
+    void Record(double elapsedUs);
+};
+
+/* __callauto__: calls whose average stays under inlineThresholdUs run on the
+   JS thread, batched per microtask checkpoint under one GIL acquisition.
+   Everything else, and the part of a batch past batchBudgetUs, goes to a
+   PyNodeWorker like __callasync_promise__. Unprofiled callables start out
+   offloaded, so a slow first call never blocks the event loop. */
+class PyNodeAutoDispatch
+{
+public:
+    struct Options
+    {
+        double inlineThresholdUs = 50;
+        /* Inlined callables go back to the pool once they average above this */
+        double offloadThresholdUs = 200;
+        double smoothing = 0.2;
+        double batchBudgetUs = 2000;
+    };
+
+    /* Per env, lives in PyNodeEnvData */
+    struct EnvState
+    {
+        struct Pending
+        {
+            Pending(Napi::Promise::Deferred deferred) : deferred(deferred) {}
+            Napi::Promise::Deferred deferred;
+            py_object_owned func;
+            py_object_owned args;
+            std::shared_ptr<PyNodeCallProfile> profile;
+        };
+
+        /* Profiles by the code object of the callable, held through a weakref
+           so a freed key's address can't pick up its profile */
+        struct ProfileSlot
+        {
+            py_object_owned ref;
+            std::shared_ptr<PyNodeCallProfile> profile;
+        };
+
+        std::vector<Pending> pending;
+        std::unordered_map<PyObject*, ProfileSlot> profiles;
+        size_t pruneProfilesAt = 64;
+        bool scheduled = false;
+        Napi::FunctionReference flush;
+        Napi::FunctionReference queueMicrotask;
+    };
+
+    static void Init(Napi::Env env, Napi::Object exports);
+    static Options GetOptions();
+    /* Profile shared by every wrapper of the same function, so bound methods
+       fetched anew for each call still get inlined. nullptr for callables that
+       can't be weakly referenced. Needs the GIL. */
+    static std::shared_ptr<PyNodeCallProfile> ProfileFor(Napi::Env env, PyObject *func);
+    /* Needs the GIL, takes the converted arguments */
+    static Napi::Value Call(Napi::Env env, PyObject *func, py_object_owned &&args, const std::shared_ptr<PyNodeCallProfile> &profile);
+
+private:
+    static Napi::Value Configure(const Napi::CallbackInfo &info);
+    static Napi::Value Flush(const Napi::CallbackInfo &info);
+    static void Offload(EnvState::Pending &&call);
+
+    static std::mutex s_optionsMutex;
+    static Options s_options;
+    static std::atomic<int64_t> s_inlineCalls;
+    static std::atomic<int64_t> s_offloadedCalls;
+    static std::atomic<int64_t> s_batches;
+    static std::atomic<int64_t> s_overBudget;
+};
+
+#endif
@@ -0,0 +1,121 @@
+#include "bench.hpp"
+#include "helpers.hpp"
+#include <atomic>
+#include <chrono>
+
+/* Counts every allocation made through the PyMem/PyObject allocators while
+   installed. Both domains require the GIL, but async workers allocate on
+   other threads so the counter is still atomic. */
+static std::atomic<uint64_t> s_allocCount{ 0 };
+static bool s_allocHookInstalled = false;
+static PyMemAllocatorEx s_origMem;
+static PyMemAllocatorEx s_origObj;
+
+static void* CountingMalloc(void* ctx, size_t size) {
+	s_allocCount.fetch_add(1, std::memory_order_relaxed);
+	auto orig = static_cast<PyMemAllocatorEx*>(ctx);
+	return orig->malloc(orig->ctx, size);
+}
+
+static void* CountingCalloc(void* ctx, size_t nelem, size_t elsize) {
+	s_allocCount.fetch_add(1, std::memory_order_relaxed);
+	auto orig = static_cast<PyMemAllocatorEx*>(ctx);
+	return orig->calloc(orig->ctx, nelem, elsize);
+}
+
+static void* CountingRealloc(void* ctx, void* ptr, size_t new_size) {
+	s_allocCount.fetch_add(1, std::memory_order_relaxed);
+	auto orig = static_cast<PyMemAllocatorEx*>(ctx);
+	return orig->realloc(orig->ctx, ptr, new_size);
+}
+
+static void CountingFree(void* ctx, void* ptr) {
+	auto orig = static_cast<PyMemAllocatorEx*>(ctx);
+	orig->free(orig->ctx, ptr);
+}
+
+Napi::Value BeginAllocations(const Napi::CallbackInfo& info) {
+	py_ensure_gil ctx;
+	if (!s_allocHookInstalled) {
+		PyMem_GetAllocator(PYMEM_DOMAIN_MEM, &s_origMem);
+		PyMem_GetAllocator(PYMEM_DOMAIN_OBJ, &s_origObj);
+		PyMemAllocatorEx mem = { &s_origMem, CountingMalloc, CountingCalloc, CountingRealloc, CountingFree };
+		PyMemAllocatorEx obj = { &s_origObj, CountingMalloc, CountingCalloc, CountingRealloc, CountingFree };
+		PyMem_SetAllocator(PYMEM_DOMAIN_MEM, &mem);
+		PyMem_SetAllocator(PYMEM_DOMAIN_OBJ, &obj);
+		s_allocHookInstalled = true;
+	}
+	s_allocCount = 0;
+	return info.Env().Undefined();
+}
+
+/* Like the allocation tracker, only unwinds when nothing was installed on top */
+static bool CountingHookOnTop() {
+	PyMemAllocatorEx mem, obj;
+	PyMem_GetAllocator(PYMEM_DOMAIN_MEM, &mem);
+	PyMem_GetAllocator(PYMEM_DOMAIN_OBJ, &obj);
+	return mem.ctx == &s_origMem && mem.malloc == CountingMalloc && obj.ctx == &s_origObj && obj.malloc == CountingMalloc;
+}
+
+Napi::Value EndAllocations(const Napi::CallbackInfo& info) {
+	py_ensure_gil ctx;
+	if (s_allocHookInstalled) {
+		if (!CountingHookOnTop()) {
+			throw Napi::Error::New(info.Env(), "Another Python allocator hook was installed after the benchmark counter, remove it first");
+		}
+		PyMem_SetAllocator(PYMEM_DOMAIN_MEM, &s_origMem);
+		PyMem_SetAllocator(PYMEM_DOMAIN_OBJ, &s_origObj);
+		s_allocHookInstalled = false;
+	}
+	return Napi::Number::New(info.Env(), static_cast<double>(s_allocCount.load()));
+}
+
+static uint32_t GetIterations(const Napi::CallbackInfo& info) {
+	if (info.Length() < 2 || !info[1].IsNumber()) {
+		throw Napi::TypeError::New(info.Env(), "Expected (value, iterations)");
+	}
+	return info[1].As<Napi::Number>().Uint32Value();
+}
+
+/* Times ConvertToPython(value) in a tight native loop, returns elapsed ns */
+Napi::Value BenchConvertToPython(const Napi::CallbackInfo& info) {
+	Napi::Env env = info.Env();
+	uint32_t iterations = GetIterations(info);
+	Napi::Value value = info[0];
+
+	py_ensure_gil ctx;
+	auto start = std::chrono::steady_clock::now();
+	for (uint32_t i = 0; i < iterations; i++) {
+		Napi::HandleScope scope(env);
+		py_object_owned pyval = ConvertToPython(value);
+	}
+	auto elapsed = std::chrono::steady_clock::now() - start;
+	return Napi::Number::New(env, static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+}
+
+/* Converts value to Python once, then times ConvertFromPython on the result.
+   Passing a PyNodeWrappedPythonObject measures the identity-map lookup. */
+Napi::Value BenchConvertFromPython(const Napi::CallbackInfo& info) {
+	Napi::Env env = info.Env();
+	uint32_t iterations = GetIterations(info);
+
+	py_ensure_gil ctx;
+	py_object_owned pyval = ConvertToPython(info[0]);
+	auto start = std::chrono::steady_clock::now();
+	for (uint32_t i = 0; i < iterations; i++) {
+		Napi::HandleScope scope(env);
+		ConvertFromPython(env, pyval.get());
+	}
+	auto elapsed = std::chrono::steady_clock::now() - start;
+	return Napi::Number::New(env, static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+}
+
+Napi::Object BenchInit(Napi::Env env, Napi::Object exports) {
+	auto bench = Napi::Object::New(env);
+	bench.Set("beginAllocations", Napi::Function::New(env, BeginAllocations));
+	bench.Set("endAllocations", Napi::Function::New(env, EndAllocations));
+	bench.Set("convertToPython", Napi::Function::New(env, BenchConvertToPython));
+	bench.Set("convertFromPython", Napi::Function::New(env, BenchConvertFromPython));
+	exports.Set("bench", bench);
+	return exports;
+}
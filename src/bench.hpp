@@ -0,0 +1,9 @@
+#ifndef PYNODE_BENCH_HPP
+#define PYNODE_BENCH_HPP
+
+#include "napi.h"
+
+/* Native microbenchmarks, only built into the PyNodeBench target (see bench.js) */
+Napi::Object BenchInit(Napi::Env env, Napi::Object exports);
+
+#endif
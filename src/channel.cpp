@@ -0,0 +1,345 @@
+#define PY_SSIZE_T_CLEAN
+#include "channel.hpp"
+#include "pynode.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <string>
+
+PyNodeChannelState::PyNodeChannelState(uint32_t capacity) : capacity(capacity) {
+  memorySize = HEADER_SLOTS * sizeof(int32_t) + capacity;
+  memory = ::operator new(memorySize, std::align_val_t(64));
+  header = reinterpret_cast<std::atomic<int32_t>*>(memory);
+  for (int i = 0; i < HEADER_SLOTS; i++) {
+    new (&header[i]) std::atomic<int32_t>(0);
+  }
+  header[CAPACITY].store(static_cast<int32_t>(capacity));
+  data = static_cast<uint8_t*>(memory) + HEADER_SLOTS * sizeof(int32_t);
+}
+
+PyNodeChannelState::~PyNodeChannelState() {
+  ::operator delete(memory, std::align_val_t(64));
+}
+
+void PyNodeChannelState::CopyIn(uint32_t position, const uint8_t* src, uint32_t length) {
+  uint32_t offset = position & (capacity - 1);
+  uint32_t first = std::min(length, capacity - offset);
+  memcpy(data + offset, src, first);
+  memcpy(data, src + first, length - first);
+}
+
+void PyNodeChannelState::CopyOut(uint32_t position, uint8_t* dst, uint32_t length) const {
+  uint32_t offset = position & (capacity - 1);
+  uint32_t first = std::min(length, capacity - offset);
+  memcpy(dst, data + offset, first);
+  memcpy(dst + first, data, length - first);
+}
+
+void PyNodeChannelState::Notify() {
+  {
+    std::unique_lock lock(mutex);
+  }
+  condition.notify_all();
+}
+
+bool PyNodeChannelState::Wait(double timeoutSeconds) {
+  auto ready = [&]() { return Used() > 0 || IsClosed(); };
+  std::unique_lock lock(mutex);
+  if (timeoutSeconds < 0) {
+    condition.wait(lock, ready);
+  }
+  else if (!condition.wait_for(lock, std::chrono::duration<double>(timeoutSeconds), ready)) {
+    return false;
+  }
+  return Used() > 0;
+}
+
+/* JS side */
+
+Napi::Object PyNodeChannel::Init(Napi::Env env, Napi::Object exports) {
+    Napi::Function func = DefineClass(env, "PyNodeChannel", {
+        InstanceMethod("write", &PyNodeChannel::Write),
+        InstanceMethod("notify", &PyNodeChannel::Notify),
+        InstanceMethod("close", &PyNodeChannel::Close),
+    });
+
+    auto instData = env.GetInstanceData<PyNodeEnvData>();
+    instData->PyNodeChannelConstructor = Napi::Persistent(func);
+    exports.Set("PyNodeChannel", func);
+    exports.Set("createChannel", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto instData = info.Env().GetInstanceData<PyNodeEnvData>();
+        return instData->PyNodeChannelConstructor.New({ info[0] });
+    }));
+    return exports;
+}
+
+PyNodeChannel::PyNodeChannel(const Napi::CallbackInfo &info) : Napi::ObjectWrap<PyNodeChannel>(info) {
+    Napi::Env env = info.Env();
+    if (info.Length() < 1 || !info[0].IsNumber()) {
+        throw Napi::TypeError::New(env, "Must pass a size to 'createChannel'");
+    }
+
+    /* Round up to a power of two so positions can be masked */
+    uint32_t requested = std::max<uint32_t>(info[0].As<Napi::Number>().Uint32Value(), 64);
+    uint32_t capacity = 64;
+    while (capacity < requested && capacity < (1u << 30))
+        capacity <<= 1;
+    _state = std::make_shared<PyNodeChannelState>(capacity);
+
+    /* The ArrayBuffer keeps the ring memory alive for as long as JS can see it */
+    auto keepAlive = new std::shared_ptr<PyNodeChannelState>(_state);
+    auto buffer = Napi::ArrayBuffer::New(env, _state->memory, _state->memorySize,
+        [](Napi::Env, void*, std::shared_ptr<PyNodeChannelState>* hint) { delete hint; }, keepAlive);
+
+    auto self = info.This().As<Napi::Object>();
+    self.Set("buffer", buffer);
+    self.Set("header", Napi::Int32Array::New(env, PyNodeChannelState::HEADER_SLOTS, buffer, 0, napi_int32_array));
+    self.Set("data", Napi::Uint8Array::New(env, capacity, buffer, PyNodeChannelState::HEADER_SLOTS * sizeof(int32_t), napi_uint8_array));
+    self.Set("capacity", Napi::Number::New(env, capacity));
+}
+
+Napi::Value PyNodeChannel::Write(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    const uint8_t* bytes = nullptr;
+    size_t length = 0;
+    std::string str;
+    if (info.Length() > 0 && info[0].IsTypedArray()) {
+        auto array = info[0].As<Napi::TypedArray>();
+        bytes = static_cast<const uint8_t*>(array.ArrayBuffer().Data()) + array.ByteOffset();
+        length = array.ByteLength();
+    }
+    else if (info.Length() > 0 && info[0].IsString()) {
+        str = info[0].As<Napi::String>().Utf8Value();
+        bytes = reinterpret_cast<const uint8_t*>(str.data());
+        length = str.size();
+    }
+    else {
+        Napi::TypeError::New(env, "Must pass a string or typed array to 'write'")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    if (_state->IsClosed()) {
+        Napi::Error::New(env, "Channel is closed").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    /* Only this thread moves HEAD, so the free space can only grow while we write */
+    uint32_t head = _state->header[PyNodeChannelState::HEAD].load(std::memory_order_relaxed);
+    uint32_t used = _state->Used();
+    if (length + sizeof(uint32_t) > _state->capacity - used) {
+        return Napi::Boolean::New(env, false);
+    }
+
+    uint8_t prefix[4] = {
+        static_cast<uint8_t>(length), static_cast<uint8_t>(length >> 8),
+        static_cast<uint8_t>(length >> 16), static_cast<uint8_t>(length >> 24)
+    };
+    _state->CopyIn(head, prefix, sizeof(prefix));
+    _state->CopyIn(head + sizeof(prefix), bytes, static_cast<uint32_t>(length));
+    _state->header[PyNodeChannelState::HEAD].store(static_cast<int32_t>(head + sizeof(prefix) + length), std::memory_order_release);
+    _state->Notify();
+    return Napi::Boolean::New(env, true);
+}
+
+Napi::Value PyNodeChannel::Notify(const Napi::CallbackInfo &info) {
+    _state->Notify();
+    return info.Env().Undefined();
+}
+
+Napi::Value PyNodeChannel::Close(const Napi::CallbackInfo &info) {
+    _state->header[PyNodeChannelState::CLOSED].store(1, std::memory_order_release);
+    _state->Notify();
+    return info.Env().Undefined();
+}
+
+/* Python side */
+
+struct PyNodeChannelObject {
+    PyObject_HEAD
+    std::shared_ptr<PyNodeChannelState> state;
+};
+
+PyTypeObject PyNodeChannelType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+};
+
+PyObject* PyNodeChannel_New(std::shared_ptr<PyNodeChannelState> state) {
+    auto self = (PyNodeChannelObject*)PyNodeChannelType.tp_alloc(&PyNodeChannelType, 0);
+    if (self != NULL) {
+        new (&self->state) std::shared_ptr<PyNodeChannelState>(std::move(state));
+    }
+    return (PyObject*)self;
+}
+
+static void
+PyNodeChannel_dealloc(PyObject* obj)
+{
+    auto self = (PyNodeChannelObject*)obj;
+    self->state.~shared_ptr();
+    Py_TYPE(self)->tp_free(obj);
+}
+
+static int
+PyNodeChannel_getbuffer(PyObject* obj, Py_buffer* view, int flags)
+{
+    auto self = (PyNodeChannelObject*)obj;
+    return PyBuffer_FillInfo(view, obj, self->state->data, self->state->capacity, 0, flags);
+}
+
+static PyObject *
+PyNodeChannel_read(PyObject* obj, PyObject*)
+{
+    auto& state = ((PyNodeChannelObject*)obj)->state;
+    uint32_t tail = state->header[PyNodeChannelState::TAIL].load(std::memory_order_relaxed);
+    uint32_t used = state->Used();
+    if (used < sizeof(uint32_t))
+        Py_RETURN_NONE;
+
+    uint8_t prefix[4];
+    state->CopyOut(tail, prefix, sizeof(prefix));
+    uint32_t length = prefix[0] | (prefix[1] << 8) | (prefix[2] << 16) | ((uint32_t)prefix[3] << 24);
+    if (length > used - sizeof(uint32_t)) {
+        PyErr_SetString(PyExc_RuntimeError, "Corrupt record in channel");
+        return NULL;
+    }
+
+    py_object_owned bytes(PyBytes_FromStringAndSize(NULL, length));
+    if (!bytes)
+        return NULL;
+    state->CopyOut(tail + sizeof(prefix), (uint8_t*)PyBytes_AS_STRING(bytes.get()), length);
+    state->header[PyNodeChannelState::TAIL].store(static_cast<int32_t>(tail + sizeof(prefix) + length), std::memory_order_release);
+    return bytes.release();
+}
+
+static PyObject *
+PyNodeChannel_advance(PyObject* obj, PyObject* arg)
+{
+    auto& state = ((PyNodeChannelObject*)obj)->state;
+    unsigned long count = PyLong_AsUnsignedLong(arg);
+    if (PyErr_Occurred())
+        return NULL;
+    if (count > state->Used()) {
+        PyErr_SetString(PyExc_ValueError, "Cannot advance past the channel head");
+        return NULL;
+    }
+    uint32_t tail = state->header[PyNodeChannelState::TAIL].load(std::memory_order_relaxed);
+    state->header[PyNodeChannelState::TAIL].store(static_cast<int32_t>(tail + count), std::memory_order_release);
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+PyNodeChannel_wait(PyObject* obj, PyObject* args)
+{
+    auto state = ((PyNodeChannelObject*)obj)->state;
+    PyObject* timeoutObj = Py_None;
+    if (!PyArg_ParseTuple(args, "|O", &timeoutObj))
+        return NULL;
+    double timeout = -1;
+    if (timeoutObj != Py_None) {
+        timeout = PyFloat_AsDouble(timeoutObj);
+        if (PyErr_Occurred())
+            return NULL;
+    }
+
+    bool available;
+    Py_BEGIN_ALLOW_THREADS
+    available = state->Wait(timeout);
+    Py_END_ALLOW_THREADS
+    return PyBool_FromLong(available);
+}
+
+static PyObject *
+PyNodeChannel_wait_async(PyObject* obj, PyObject* args)
+{
+    /* Runs the blocking wait on the event loop's default executor */
+    py_object_owned asyncio(PyImport_ImportModule("asyncio"));
+    py_object_owned loop(asyncio ? PyObject_CallMethod(asyncio.get(), "get_running_loop", NULL) : NULL);
+    py_object_owned wait(loop ? PyObject_GetAttrString(obj, "wait") : NULL);
+    if (!wait)
+        return NULL;
+    PyObject* timeout = PyTuple_GET_SIZE(args) > 0 ? PyTuple_GET_ITEM(args, 0) : Py_None;
+    return PyObject_CallMethod(loop.get(), "run_in_executor", "OOO", Py_None, wait.get(), timeout);
+}
+
+static PyObject *
+PyNodeChannel_iternext(PyObject* obj)
+{
+    auto state = ((PyNodeChannelObject*)obj)->state;
+    while (true) {
+        if (state->Used() > 0)
+            return PyNodeChannel_read(obj, NULL);
+        bool available;
+        Py_BEGIN_ALLOW_THREADS
+        available = state->Wait(-1);
+        Py_END_ALLOW_THREADS
+        if (!available)
+            return NULL; /* closed and drained, StopIteration */
+    }
+}
+
+static PyObject *
+PyNodeChannel_get_header(PyObject* obj, void* closure)
+{
+    auto& state = ((PyNodeChannelObject*)obj)->state;
+    return PyLong_FromUnsignedLong((uint32_t)state->header[(intptr_t)closure].load(std::memory_order_acquire));
+}
+
+static PyObject *
+PyNodeChannel_get_capacity(PyObject* obj, void*)
+{
+    return PyLong_FromUnsignedLong(((PyNodeChannelObject*)obj)->state->capacity);
+}
+
+static PyObject *
+PyNodeChannel_get_closed(PyObject* obj, void*)
+{
+    return PyBool_FromLong(((PyNodeChannelObject*)obj)->state->IsClosed());
+}
+
+static PyObject *
+PyNodeChannel_get_buffer(PyObject* obj, void*)
+{
+    return PyMemoryView_FromObject(obj);
+}
+
+static PyMethodDef PyNodeChannel_methods[] = {
+    { "read", PyNodeChannel_read, METH_NOARGS, "Returns the next record as bytes, or None if the channel is empty" },
+    { "advance", PyNodeChannel_advance, METH_O, "Marks n raw bytes as consumed" },
+    { "wait", PyNodeChannel_wait, METH_VARARGS, "wait(timeout=None): blocks without the GIL until data is available, False on timeout or close" },
+    { "wait_async", PyNodeChannel_wait_async, METH_VARARGS, "Awaitable version of wait, runs in the event loop's executor" },
+    { NULL }
+};
+
+static PyGetSetDef PyNodeChannel_getset[] = {
+    { "head", PyNodeChannel_get_header, NULL, "Bytes written by the producer", (void*)PyNodeChannelState::HEAD },
+    { "tail", PyNodeChannel_get_header, NULL, "Bytes consumed", (void*)PyNodeChannelState::TAIL },
+    { "capacity", PyNodeChannel_get_capacity, NULL, "Size of the data region", NULL },
+    { "closed", PyNodeChannel_get_closed, NULL, "True once the producer closed the channel", NULL },
+    { "buffer", PyNodeChannel_get_buffer, NULL, "memoryview of the data region", NULL },
+    { NULL }
+};
+
+static PyBufferProcs PyNodeChannel_as_buffer = {
+    PyNodeChannel_getbuffer,
+    NULL,
+};
+
+int PyNodeChannel_AddToModule(PyObject* module) {
+    PyNodeChannelType.tp_name = "pynode.Channel";
+    PyNodeChannelType.tp_doc = "Ring buffer shared with JavaScript, created by pynode.createChannel()";
+    PyNodeChannelType.tp_basicsize = sizeof(PyNodeChannelObject);
+    PyNodeChannelType.tp_itemsize = 0;
+    PyNodeChannelType.tp_flags = Py_TPFLAGS_DEFAULT;
+    PyNodeChannelType.tp_dealloc = PyNodeChannel_dealloc;
+    PyNodeChannelType.tp_as_buffer = &PyNodeChannel_as_buffer;
+    PyNodeChannelType.tp_iter = PyObject_SelfIter;
+    PyNodeChannelType.tp_iternext = PyNodeChannel_iternext;
+    PyNodeChannelType.tp_methods = PyNodeChannel_methods;
+    PyNodeChannelType.tp_getset = PyNodeChannel_getset;
+
+    if (PyType_Ready(&PyNodeChannelType) < 0)
+        return -1;
+    return PyModule_AddObjectRef(module, "Channel", (PyObject*)&PyNodeChannelType);
+}
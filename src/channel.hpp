@@ -0,0 +1,64 @@
+#ifndef PYNODE_CHANNEL_HPP
+#define PYNODE_CHANNEL_HPP
+
+#include <Python.h>
+#include "napi.h"
+#include "helpers.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+/* Single producer (JS) / single consumer (Python) byte ring. The memory is
+   laid out as an Int32 header followed by the data region:
+     header[HEAD]   bytes written, free running uint32, stored by the producer
+     header[TAIL]   bytes consumed, free running uint32, stored by the consumer
+     header[CLOSED] non zero once the producer closed the channel
+   Records written with write()/read() are a little endian uint32 length
+   followed by the payload, both wrapping around the end of the data region. */
+struct PyNodeChannelState {
+  enum HeaderSlot { HEAD = 0, TAIL = 1, CLOSED = 2, CAPACITY = 3, HEADER_SLOTS = 16 };
+
+  explicit PyNodeChannelState(uint32_t capacity);
+  ~PyNodeChannelState();
+
+  uint32_t Used() const { return header[HEAD].load(std::memory_order_acquire) - header[TAIL].load(std::memory_order_acquire); }
+  bool IsClosed() const { return header[CLOSED].load(std::memory_order_acquire) != 0; }
+
+  void CopyIn(uint32_t position, const uint8_t* src, uint32_t length);
+  void CopyOut(uint32_t position, uint8_t* dst, uint32_t length) const;
+
+  /* Wakes a consumer blocked in Wait, call after publishing HEAD or CLOSED */
+  void Notify();
+  /* Blocks until data is available or the channel is closed, timeout < 0 waits forever */
+  bool Wait(double timeoutSeconds);
+
+  std::atomic<int32_t>* header;
+  uint8_t* data;
+  uint32_t capacity;
+  void* memory;
+  size_t memorySize;
+
+  std::mutex mutex;
+  std::condition_variable condition;
+};
+
+class PyNodeChannel : public Napi::ObjectWrap<PyNodeChannel> {
+  public:
+    static Napi::Object Init(Napi::Env env, Napi::Object exports);
+    PyNodeChannel(const Napi::CallbackInfo &info);
+    Napi::Value Write(const Napi::CallbackInfo &info);
+    Napi::Value Notify(const Napi::CallbackInfo &info);
+    Napi::Value Close(const Napi::CallbackInfo &info);
+    std::shared_ptr<PyNodeChannelState> getState() { return _state; }
+
+  private:
+    std::shared_ptr<PyNodeChannelState> _state;
+};
+
+/* Python side of a channel, pynode.Channel */
+extern PyTypeObject PyNodeChannelType;
+int PyNodeChannel_AddToModule(PyObject* module);
+PyObject* PyNodeChannel_New(std::shared_ptr<PyNodeChannelState> state);
+
+#endif
@@ -0,0 +1,527 @@
+#include "columnar.hpp"
+#include "helpers.hpp"
+#include "pyerror.hpp"
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/* Arrow C Data Interface, https://arrow.apache.org/docs/format/CDataInterface.html */
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+  const char* format;
+  const char* name;
+  const char* metadata;
+  int64_t flags;
+  int64_t n_children;
+  struct ArrowSchema** children;
+  struct ArrowSchema* dictionary;
+  void (*release)(struct ArrowSchema*);
+  void* private_data;
+};
+
+struct ArrowArray {
+  int64_t length;
+  int64_t null_count;
+  int64_t offset;
+  int64_t n_buffers;
+  int64_t n_children;
+  const void** buffers;
+  struct ArrowArray** children;
+  struct ArrowArray* dictionary;
+  void (*release)(struct ArrowArray*);
+  void* private_data;
+};
+
+#endif
+
+#ifndef ARROW_C_STREAM_INTERFACE
+#define ARROW_C_STREAM_INTERFACE
+
+struct ArrowArrayStream {
+  int (*get_schema)(struct ArrowArrayStream*, struct ArrowSchema* out);
+  int (*get_next)(struct ArrowArrayStream*, struct ArrowArray* out);
+  const char* (*get_last_error)(struct ArrowArrayStream*);
+  void (*release)(struct ArrowArrayStream*);
+  void* private_data;
+};
+
+#endif
+
+/* Owns an imported record batch. Shared by every ArrayBuffer that points
+   into it, released (with the GIL, the producer may be Python backed) once
+   the last one is collected. */
+struct ArrowBatch {
+  ArrowSchema schema = {};
+  ArrowArray array = {};
+
+  ~ArrowBatch() {
+    py_ensure_gil ctx;
+    if (array.release)
+      array.release(&array);
+    if (schema.release)
+      schema.release(&schema);
+  }
+};
+
+using ArrowBatchPtr = std::shared_ptr<ArrowBatch>;
+
+/* Moves a struct out of a PyCapsule, leaving the capsule with nothing to release */
+template <typename T>
+static bool TakeFromCapsule(PyObject* capsule, const char* name, T* out) {
+  T* source = static_cast<T*>(PyCapsule_GetPointer(capsule, name));
+  if (!source)
+    return false;
+  *out = *source;
+  source->release = nullptr;
+  return true;
+}
+
+static void ThrowPythonError(Napi::Env env) {
+  throw PyNodePythonError::New(env, py_exception::Fetch());
+}
+
+static Napi::Object NewResult(Napi::Env env, int64_t length, Napi::Object columns, Napi::Object validity) {
+  auto result = Napi::Object::New(env);
+  result.Set("length", Napi::Number::New(env, static_cast<double>(length)));
+  result.Set("columns", columns);
+  result.Set("validity", validity);
+  return result;
+}
+
+/* Arrow columns */
+
+struct ArrowPrimitive {
+  const char* format;
+  napi_typedarray_type type;
+  size_t size;
+};
+
+static const ArrowPrimitive* FindPrimitive(const char* format) {
+  static const ArrowPrimitive primitives[] = {
+    { "c", napi_int8_array, 1 }, { "C", napi_uint8_array, 1 },
+    { "s", napi_int16_array, 2 }, { "S", napi_uint16_array, 2 },
+    { "i", napi_int32_array, 4 }, { "I", napi_uint32_array, 4 },
+    { "l", napi_bigint64_array, 8 }, { "L", napi_biguint64_array, 8 },
+    { "f", napi_float32_array, 4 }, { "g", napi_float64_array, 8 },
+    /* dates, times, timestamps and durations are plain integers underneath */
+    { "tdD", napi_int32_array, 4 }, { "tdm", napi_bigint64_array, 8 },
+    { "tts", napi_int32_array, 4 }, { "ttm", napi_int32_array, 4 },
+    { "ttu", napi_bigint64_array, 8 }, { "ttn", napi_bigint64_array, 8 },
+    { "ts", napi_bigint64_array, 8 }, { "tD", napi_bigint64_array, 8 },
+  };
+  for (auto& primitive : primitives) {
+    size_t len = strlen(primitive.format);
+    if (strncmp(format, primitive.format, len) == 0 && (format[len] == '\0' || primitive.format[0] == 't'))
+      return &primitive;
+  }
+  return nullptr;
+}
+
+static bool IsValid(const ArrowArray* array, int64_t i) {
+  auto bitmap = static_cast<const uint8_t*>(array->buffers[0]);
+  if (array->null_count == 0 || !bitmap)
+    return true;
+  int64_t bit = array->offset + i;
+  return (bitmap[bit >> 3] >> (bit & 7)) & 1;
+}
+
+/* Wraps an Arrow buffer without copying, keeping the batch alive */
+static Napi::TypedArray WrapArrowBuffer(Napi::Env env, const ArrowBatchPtr& batch, const ArrowArray* array, const ArrowPrimitive& primitive) {
+  size_t byteLength = static_cast<size_t>(array->offset + array->length) * primitive.size;
+  void* data = const_cast<void*>(array->buffers[1]);
+  Napi::ArrayBuffer buffer;
+  if (data && byteLength > 0) {
+    buffer = Napi::ArrayBuffer::New(env, data, byteLength,
+      [](Napi::Env, void*, ArrowBatchPtr* hint) { delete hint; }, new ArrowBatchPtr(batch));
+  }
+  else {
+    buffer = Napi::ArrayBuffer::New(env, 0);
+  }
+  napi_value typedArray;
+  napi_status status = napi_create_typedarray(env, primitive.type, static_cast<size_t>(array->length), buffer,
+    data && byteLength > 0 ? static_cast<size_t>(array->offset) * primitive.size : 0, &typedArray);
+  if (status != napi_ok)
+    throw Napi::Error::New(env);
+  return Napi::TypedArray(env, typedArray);
+}
+
+template <typename Offset>
+static Napi::Value BuildArrowStrings(Napi::Env env, const ArrowArray* array) {
+  auto offsets = static_cast<const Offset*>(array->buffers[1]) + array->offset;
+  auto chars = static_cast<const char*>(array->buffers[2]);
+  auto strings = Napi::Array::New(env, static_cast<size_t>(array->length));
+  for (int64_t i = 0; i < array->length; i++) {
+    if (IsValid(array, i))
+      strings.Set(static_cast<uint32_t>(i), Napi::String::New(env, chars + offsets[i], static_cast<size_t>(offsets[i + 1] - offsets[i])));
+    else
+      strings.Set(static_cast<uint32_t>(i), env.Null());
+  }
+  return strings;
+}
+
+static Napi::Value BuildArrowColumn(Napi::Env env, const ArrowBatchPtr& batch, const ArrowSchema* schema, const ArrowArray* array) {
+  const char* format = schema->format;
+
+  if (schema->dictionary) {
+    /* Already dictionary encoded, hand over the indices as they are */
+    auto primitive = FindPrimitive(format);
+    if (!primitive || format[0] == 't' || format[0] == 'f' || format[0] == 'g')
+      throw Napi::TypeError::New(env, std::string("Unsupported Arrow dictionary index type ") + format);
+    auto column = Napi::Object::New(env);
+    column.Set("dictionary", BuildArrowColumn(env, batch, schema->dictionary, array->dictionary));
+    column.Set("indices", WrapArrowBuffer(env, batch, array, *primitive));
+    return column;
+  }
+
+  if (auto primitive = FindPrimitive(format)) {
+    return WrapArrowBuffer(env, batch, array, *primitive);
+  }
+  if (strcmp(format, "b") == 0) {
+    auto bools = Napi::Uint8Array::New(env, static_cast<size_t>(array->length));
+    auto bits = static_cast<const uint8_t*>(array->buffers[1]);
+    for (int64_t i = 0; i < array->length; i++) {
+      int64_t bit = array->offset + i;
+      bools[static_cast<size_t>(i)] = (bits[bit >> 3] >> (bit & 7)) & 1;
+    }
+    return bools;
+  }
+  if (strcmp(format, "u") == 0) {
+    return BuildArrowStrings<int32_t>(env, array);
+  }
+  if (strcmp(format, "U") == 0) {
+    return BuildArrowStrings<int64_t>(env, array);
+  }
+  throw Napi::TypeError::New(env, std::string("Unsupported Arrow column format ") + format);
+}
+
+/* Plain string columns are dictionary encoded on the way out */
+static Napi::Value DictionaryEncode(Napi::Env env, Napi::Array strings) {
+  uint32_t length = strings.Length();
+  auto indices = Napi::Int32Array::New(env, length);
+  auto dictionary = Napi::Array::New(env);
+  /* Not a JS object, values like "__proto__" or "toString" are ordinary keys here */
+  std::unordered_map<std::string, int32_t> seen;
+  for (uint32_t i = 0; i < length; i++) {
+    auto value = strings.Get(i);
+    if (!value.IsString()) {
+      indices[i] = -1;
+      continue;
+    }
+    auto inserted = seen.emplace(value.As<Napi::String>().Utf8Value(), static_cast<int32_t>(seen.size()));
+    if (inserted.second)
+      dictionary.Set(static_cast<uint32_t>(inserted.first->second), value);
+    indices[i] = inserted.first->second;
+  }
+  auto column = Napi::Object::New(env);
+  column.Set("dictionary", dictionary);
+  column.Set("indices", indices);
+  return column;
+}
+
+static Napi::Value BuildArrowResult(Napi::Env env, const ArrowBatchPtr& batch) {
+  const ArrowSchema& schema = batch->schema;
+  const ArrowArray& array = batch->array;
+  if (strcmp(schema.format, "+s") != 0 || schema.n_children != array.n_children)
+    throw Napi::TypeError::New(env, "Columnar conversion needs an Arrow struct array (a record batch)");
+  if (array.offset != 0 && array.n_children > 0)
+    throw Napi::TypeError::New(env, "Sliced Arrow record batches are not supported");
+
+  auto columns = Napi::Object::New(env);
+  auto validity = Napi::Object::New(env);
+  for (int64_t c = 0; c < schema.n_children; c++) {
+    const ArrowSchema* childSchema = schema.children[c];
+    const ArrowArray* childArray = array.children[c];
+    std::string name = childSchema->name ? childSchema->name : std::to_string(c);
+
+    auto column = BuildArrowColumn(env, batch, childSchema, childArray);
+    if (column.IsArray())
+      column = DictionaryEncode(env, column.As<Napi::Array>());
+    columns.Set(name, column);
+
+    if (childArray->null_count != 0 && childArray->buffers[0]) {
+      auto valid = Napi::Uint8Array::New(env, static_cast<size_t>(childArray->length));
+      for (int64_t i = 0; i < childArray->length; i++)
+        valid[static_cast<size_t>(i)] = IsValid(childArray, i);
+      validity.Set(name, valid);
+    }
+  }
+  return NewResult(env, array.length, columns, validity);
+}
+
+static Napi::Value ConvertArrowCArray(Napi::Env env, PyObject* obj) {
+  py_object_owned capsules(PyObject_CallMethod(obj, "__arrow_c_array__", NULL));
+  if (!capsules)
+    ThrowPythonError(env);
+  if (!PyTuple_Check(capsules.get()) || PyTuple_GET_SIZE(capsules.get()) != 2) {
+    PyErr_SetString(PyExc_TypeError, "__arrow_c_array__ must return a (schema, array) capsule pair");
+    ThrowPythonError(env);
+  }
+
+  auto batch = std::make_shared<ArrowBatch>();
+  if (!TakeFromCapsule(PyTuple_GET_ITEM(capsules.get(), 0), "arrow_schema", &batch->schema) ||
+      !TakeFromCapsule(PyTuple_GET_ITEM(capsules.get(), 1), "arrow_array", &batch->array))
+    ThrowPythonError(env);
+  return BuildArrowResult(env, batch);
+}
+
+static Napi::Value ConvertArrowCStream(Napi::Env env, PyObject* obj) {
+  py_object_owned capsule(PyObject_CallMethod(obj, "__arrow_c_stream__", NULL));
+  ArrowArrayStream stream = {};
+  if (!capsule || !TakeFromCapsule(capsule.get(), "arrow_array_stream", &stream))
+    ThrowPythonError(env);
+  std::unique_ptr<ArrowArrayStream, void (*)(ArrowArrayStream*)> streamGuard(&stream, [](ArrowArrayStream* s) {
+    if (s->release)
+      s->release(s);
+  });
+
+  std::vector<ArrowBatchPtr> batches;
+  while (true) {
+    auto batch = std::make_shared<ArrowBatch>();
+    if (stream.get_schema(&stream, &batch->schema) != 0 || stream.get_next(&stream, &batch->array) != 0) {
+      const char* error = stream.get_last_error(&stream);
+      throw Napi::Error::New(env, std::string("Failed to read Arrow stream: ") + (error ? error : "unknown error"));
+    }
+    if (!batch->array.release)
+      break; /* end of stream */
+    batches.push_back(std::move(batch));
+  }
+
+  if (batches.size() == 1)
+    return BuildArrowResult(env, batches[0]);
+
+  /* Several chunks, concatenate each column's values into plain JS arrays
+     and let the caller decide. Single batch streams above stay zero copy. */
+  auto columns = Napi::Object::New(env);
+  auto validity = Napi::Object::New(env);
+  /* Only for columns where some batch had nulls, backfilled once one does */
+  std::unordered_map<std::string, std::vector<uint8_t>> valid;
+  int64_t length = 0;
+  for (auto& batch : batches) {
+    auto part = BuildArrowResult(env, batch).As<Napi::Object>();
+    auto partColumns = part.Get("columns").As<Napi::Object>();
+    auto partValidity = part.Get("validity").As<Napi::Object>();
+    auto names = partColumns.GetPropertyNames();
+    int64_t partLength = part.Get("length").As<Napi::Number>().Int64Value();
+    for (uint32_t c = 0; c < names.Length(); c++) {
+      auto name = names.Get(c);
+      std::string key = name.ToString().Utf8Value();
+      if (!columns.Has(name))
+        columns.Set(name, Napi::Array::New(env));
+      auto target = columns.Get(name).As<Napi::Array>();
+      auto source = partColumns.Get(name).As<Napi::Object>();
+      bool dictionary = !source.IsTypedArray();
+      auto values = dictionary ? source.Get("indices").As<Napi::Object>() : source;
+      auto dictionaryValues = dictionary ? source.Get("dictionary").As<Napi::Array>() : Napi::Array();
+
+      auto partValid = partValidity.Get(name);
+      bool hasNulls = partValid.IsTypedArray();
+      auto validBytes = hasNulls ? partValid.As<Napi::Uint8Array>() : Napi::Uint8Array();
+      if (hasNulls && valid.find(key) == valid.end())
+        valid[key].assign(static_cast<size_t>(length), 1);
+      auto columnValid = valid.find(key);
+
+      for (int64_t i = 0; i < partLength; i++) {
+        bool isValid = !hasNulls || validBytes[static_cast<size_t>(i)];
+        auto value = isValid ? values.Get(static_cast<uint32_t>(i)) : env.Null();
+        if (isValid && dictionary) {
+          int32_t index = value.As<Napi::Number>().Int32Value();
+          value = index < 0 ? env.Null() : dictionaryValues.Get(static_cast<uint32_t>(index));
+        }
+        target.Set(static_cast<uint32_t>(length + i), value);
+        if (columnValid != valid.end())
+          columnValid->second.push_back(isValid);
+      }
+    }
+    length += partLength;
+  }
+  auto names = columns.GetPropertyNames();
+  for (uint32_t c = 0; c < names.Length(); c++) {
+    auto name = names.Get(c);
+    auto values = columns.Get(name).As<Napi::Array>();
+    Napi::Value first = env.Null();
+    for (uint32_t i = 0; i < values.Length() && first.IsNull(); i++)
+      first = values.Get(i);
+    if (first.IsString())
+      columns.Set(name, DictionaryEncode(env, values));
+
+    auto columnValid = valid.find(name.ToString().Utf8Value());
+    if (columnValid != valid.end()) {
+      auto bytes = Napi::Uint8Array::New(env, columnValid->second.size());
+      std::memcpy(bytes.Data(), columnValid->second.data(), columnValid->second.size());
+      validity.Set(name, bytes);
+    }
+  }
+  return NewResult(env, length, columns, validity);
+}
+
+/* Lists of dicts */
+
+enum class ColumnKind { Unknown, Bool, Number, String, Mixed };
+
+static Napi::Value ConvertRecordList(Napi::Env env, PyObject* list) {
+  Py_ssize_t length = PyList_GET_SIZE(list);
+
+  /* First pass, collect the keys in order of appearance and their kinds */
+  py_object_owned keyIndex(PyDict_New());
+  std::vector<PyObject*> keys;
+  std::vector<ColumnKind> kinds;
+  for (Py_ssize_t row = 0; row < length; row++) {
+    PyObject* record = PyList_GET_ITEM(list, row);
+    if (!PyDict_Check(record))
+      throw Napi::TypeError::New(env, "Columnar conversion needs a list of dicts");
+    PyObject *key, *value;
+    Py_ssize_t pos = 0;
+    while (PyDict_Next(record, &pos, &key, &value)) {
+      PyObject* index = PyDict_GetItemWithError(keyIndex.get(), key);
+      size_t column;
+      if (index) {
+        column = PyLong_AsSize_t(index);
+      }
+      else {
+        if (PyErr_Occurred())
+          ThrowPythonError(env);
+        column = keys.size();
+        py_object_owned columnIndex(PyLong_FromSize_t(column));
+        PyDict_SetItem(keyIndex.get(), key, columnIndex.get());
+        keys.push_back(key);
+        kinds.push_back(ColumnKind::Unknown);
+      }
+
+      ColumnKind kind;
+      if (value == Py_None)
+        continue;
+      else if (PyBool_Check(value))
+        kind = ColumnKind::Bool;
+      else if (PyLong_Check(value) || PyFloat_Check(value))
+        kind = ColumnKind::Number;
+      else if (PyUnicode_Check(value))
+        kind = ColumnKind::String;
+      else
+        kind = ColumnKind::Mixed;
+
+      if (kinds[column] == ColumnKind::Unknown)
+        kinds[column] = kind;
+      else if (kinds[column] != kind)
+        kinds[column] = ColumnKind::Mixed;
+    }
+  }
+
+  /* Second pass, fill one preallocated column at a time */
+  auto columns = Napi::Object::New(env);
+  auto validity = Napi::Object::New(env);
+  for (size_t c = 0; c < keys.size(); c++) {
+    Napi::HandleScope scope(env);
+    py_object_owned keyString(PyObject_Str(keys[c]));
+    const char* name = keyString ? PyUnicode_AsUTF8(keyString.get()) : nullptr;
+    if (!name)
+      ThrowPythonError(env);
+
+    Napi::Uint8Array valid = Napi::Uint8Array::New(env, static_cast<size_t>(length));
+    bool hasNulls = false;
+    Napi::Value column;
+    switch (kinds[c]) {
+    case ColumnKind::Bool:
+    case ColumnKind::Number: {
+      bool isBool = kinds[c] == ColumnKind::Bool;
+      auto bools = isBool ? Napi::Uint8Array::New(env, static_cast<size_t>(length)) : Napi::Uint8Array();
+      auto numbers = isBool ? Napi::Float64Array() : Napi::Float64Array::New(env, static_cast<size_t>(length));
+      for (Py_ssize_t row = 0; row < length; row++) {
+        PyObject* value = PyDict_GetItemWithError(PyList_GET_ITEM(list, row), keys[c]);
+        bool present = value && value != Py_None;
+        valid[static_cast<size_t>(row)] = present;
+        hasNulls |= !present;
+        if (isBool)
+          bools[static_cast<size_t>(row)] = present && value == Py_True;
+        else
+          numbers[static_cast<size_t>(row)] = present ? PyFloat_AsDouble(value) : NAN;
+      }
+      if (isBool)
+        column = bools;
+      else
+        column = numbers;
+      break;
+    }
+    case ColumnKind::String: {
+      auto indices = Napi::Int32Array::New(env, static_cast<size_t>(length));
+      auto dictionary = Napi::Array::New(env);
+      py_object_owned seen(PyDict_New());
+      for (Py_ssize_t row = 0; row < length; row++) {
+        PyObject* value = PyDict_GetItemWithError(PyList_GET_ITEM(list, row), keys[c]);
+        if (!value || value == Py_None) {
+          indices[static_cast<size_t>(row)] = -1;
+          valid[static_cast<size_t>(row)] = 0;
+          hasNulls = true;
+          continue;
+        }
+        valid[static_cast<size_t>(row)] = 1;
+        PyObject* index = PyDict_GetItemWithError(seen.get(), value);
+        if (index) {
+          indices[static_cast<size_t>(row)] = static_cast<int32_t>(PyLong_AsLong(index));
+        }
+        else {
+          uint32_t next = dictionary.Length();
+          py_object_owned nextIndex(PyLong_FromUnsignedLong(next));
+          PyDict_SetItem(seen.get(), value, nextIndex.get());
+          dictionary.Set(next, Napi::String::New(env, PyUnicode_AsUTF8(value)));
+          indices[static_cast<size_t>(row)] = static_cast<int32_t>(next);
+        }
+      }
+      auto encoded = Napi::Object::New(env);
+      encoded.Set("dictionary", dictionary);
+      encoded.Set("indices", indices);
+      column = encoded;
+      break;
+    }
+    default: {
+      auto values = Napi::Array::New(env, static_cast<size_t>(length));
+      for (Py_ssize_t row = 0; row < length; row++) {
+        PyObject* value = PyDict_GetItemWithError(PyList_GET_ITEM(list, row), keys[c]);
+        bool present = value && value != Py_None;
+        valid[static_cast<size_t>(row)] = present;
+        hasNulls |= !present;
+        values.Set(static_cast<uint32_t>(row), present ? ConvertFromPython(env, value) : env.Null());
+      }
+      column = values;
+    }
+    }
+    if (PyErr_Occurred())
+      ThrowPythonError(env);
+
+    columns.Set(name, column);
+    if (hasNulls)
+      validity.Set(name, valid);
+  }
+  return NewResult(env, length, columns, validity);
+}
+
+Napi::Value ConvertFromPythonColumnar(Napi::Env env, PyObject* obj) {
+  if (PyObject_HasAttrString(obj, "__arrow_c_array__"))
+    return ConvertArrowCArray(env, obj);
+  if (PyObject_HasAttrString(obj, "__arrow_c_stream__"))
+    return ConvertArrowCStream(env, obj);
+  if (PyList_Check(obj))
+    return ConvertRecordList(env, obj);
+
+  /* Older pandas has no Arrow export of its own, go through pyarrow */
+  py_object_owned module(PyObject_GetAttrString((PyObject*)Py_TYPE(obj), "__module__"));
+  const char* moduleName = module && PyUnicode_Check(module.get()) ? PyUnicode_AsUTF8(module.get()) : nullptr;
+  PyErr_Clear();
+  if (moduleName && strncmp(moduleName, "pandas", 6) == 0) {
+    py_object_owned pyarrow(PyImport_ImportModule("pyarrow"));
+    py_object_owned tableType(pyarrow ? PyObject_GetAttrString(pyarrow.get(), "Table") : nullptr);
+    py_object_owned table(tableType ? PyObject_CallMethod(tableType.get(), "from_pandas", "O", obj) : nullptr);
+    if (!table)
+      ThrowPythonError(env);
+    return ConvertFromPythonColumnar(env, table.get());
+  }
+
+  throw Napi::TypeError::New(env, "Columnar conversion needs an Arrow record batch/table, a DataFrame or a list of dicts");
+}
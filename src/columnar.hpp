@@ -0,0 +1,15 @@
+#ifndef PYNODE_COLUMNAR_HPP
+#define PYNODE_COLUMNAR_HPP
+
+#include <Python.h>
+#include "napi.h"
+
+/* Converts a record set to { length, columns, validity } with one typed array
+   per numeric column and { dictionary, indices } for string columns.
+   Accepts Arrow C Data Interface producers (__arrow_c_array__ /
+   __arrow_c_stream__, eg pyarrow tables and record batches, pandas
+   DataFrames via pyarrow) and lists of dicts. Needs the GIL, throws
+   Napi::Error for unsupported input. */
+Napi::Value ConvertFromPythonColumnar(Napi::Env env, PyObject *obj);
+
+#endif
@@ -0,0 +1,137 @@
+#include "conversion.hpp"
+#include "pynode.hpp"
+#include "tracing.hpp"
+#include <algorithm>
+#include <chrono>
+
+std::mutex PyNodeConversion::s_optionsMutex;
+PyNodeConversion::Options PyNodeConversion::s_options;
+std::atomic<uint32_t> PyNodeConversion::s_chunkSize{ PyNodeConversion::Options().chunkSize };
+std::atomic<int64_t> PyNodeConversion::s_incrementalConversions{ 0 };
+std::atomic<int64_t> PyNodeConversion::s_slices{ 0 };
+
+/* A list being converted across event loop turns. Only touched on the JS thread. */
+struct PyNodeConversion::Job
+{
+    Job(Napi::Promise::Deferred deferred) : deferred(deferred) {}
+    ~Job() {
+        py_ensure_gil ctx;
+        sequence.reset();
+    }
+
+    py_object_owned sequence;
+    Napi::Reference<Napi::Array> array;
+    Napi::Promise::Deferred deferred;
+    Py_ssize_t next = 0;
+    double timeBudgetMs = 0;
+};
+
+PyNodeConversion::Options PyNodeConversion::GetOptions() {
+    std::unique_lock lock{ s_optionsMutex };
+    return s_options;
+}
+
+bool PyNodeConversion::ConvertIncrementally(Napi::Env env, py_object_owned &result, Napi::Promise::Deferred deferred) {
+    Options options = GetOptions();
+    PyObject *obj = result.get();
+    if (!options.incrementalThreshold || !obj || (!PyList_CheckExact(obj) && !PyTuple_CheckExact(obj)))
+        return false;
+    Py_ssize_t length = PySequence_Fast_GET_SIZE(obj);
+    if (length < static_cast<Py_ssize_t>(options.incrementalThreshold))
+        return false;
+
+    s_incrementalConversions++;
+    Job *job = new Job(deferred);
+    job->sequence = std::move(result);
+    job->array = Napi::Persistent(Napi::Array::New(env, length));
+    job->timeBudgetMs = options.timeBudgetMs;
+    Schedule(env, job);
+    return true;
+}
+
+void PyNodeConversion::Schedule(Napi::Env env, Job *job) {
+    auto &state = env.GetInstanceData<PyNodeEnvData>()->conversion;
+    state.setImmediate.Call({ state.resume.Value(), Napi::External<Job>::New(env, job) });
+}
+
+/* Converts until the list is done (true) or the time budget is used up */
+bool PyNodeConversion::RunSlice(Napi::Env env, Job *job) {
+    trace_span span("ConvertFromPython.slice", "conversion");
+    s_slices++;
+    py_ensure_gil ctx;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double, std::milli>(job->timeBudgetMs);
+    Napi::Array array = job->array.Value();
+    PyObject *sequence = job->sequence.get();
+    uint32_t chunkSize = ChunkSize();
+
+    while (job->next < PySequence_Fast_GET_SIZE(sequence)) {
+        Napi::HandleScope scope(env);
+        Py_ssize_t stop = std::min(PySequence_Fast_GET_SIZE(sequence), job->next + static_cast<Py_ssize_t>(chunkSize));
+        /* Converting an item can run Python that shrinks the list */
+        for (; job->next < stop && job->next < PySequence_Fast_GET_SIZE(sequence); job->next++) {
+            py_object_owned item = ConvertBorrowedObjectToOwned(PySequence_Fast_GET_ITEM(sequence, job->next));
+            array.Set(static_cast<uint32_t>(job->next), ConvertFromPython(env, item.get()));
+        }
+        if (std::chrono::steady_clock::now() >= deadline)
+            return job->next >= PySequence_Fast_GET_SIZE(sequence);
+    }
+    return true;
+}
+
+Napi::Value PyNodeConversion::Resume(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    Job *job = info[0].As<Napi::External<Job>>().Data();
+    try {
+        if (!RunSlice(env, job)) {
+            Schedule(env, job);
+            return env.Undefined();
+        }
+        job->deferred.Resolve(job->array.Value());
+    }
+    catch (const Napi::Error &e) {
+        job->deferred.Reject(e.Value());
+    }
+    delete job;
+    return env.Undefined();
+}
+
+Napi::Value PyNodeConversion::Configure(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    Options options = GetOptions();
+    if (info.Length() > 0 && info[0].IsObject()) {
+        auto obj = info[0].As<Napi::Object>();
+        if (obj.Has("chunkSize"))
+            options.chunkSize = obj.Get("chunkSize").ToNumber().Uint32Value();
+        if (obj.Has("incrementalThreshold"))
+            options.incrementalThreshold = obj.Get("incrementalThreshold").ToNumber().Uint32Value();
+        if (obj.Has("timeBudgetMs"))
+            options.timeBudgetMs = obj.Get("timeBudgetMs").ToNumber().DoubleValue();
+        if (options.chunkSize == 0) {
+            Napi::RangeError::New(env, "chunkSize must be at least 1").ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+        if (!(options.timeBudgetMs >= 0)) {
+            Napi::RangeError::New(env, "timeBudgetMs must not be negative").ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+        std::unique_lock lock{ s_optionsMutex };
+        s_options = options;
+        s_chunkSize = options.chunkSize;
+    }
+
+    auto result = Napi::Object::New(env);
+    result.Set("chunkSize", Napi::Number::New(env, options.chunkSize));
+    result.Set("incrementalThreshold", Napi::Number::New(env, options.incrementalThreshold));
+    result.Set("timeBudgetMs", Napi::Number::New(env, options.timeBudgetMs));
+    result.Set("incrementalConversions", Napi::Number::New(env, static_cast<double>(s_incrementalConversions.load())));
+    result.Set("slices", Napi::Number::New(env, static_cast<double>(s_slices.load())));
+    return result;
+}
+
+void PyNodeConversion::Init(Napi::Env env, Napi::Object exports) {
+    auto &state = env.GetInstanceData<PyNodeEnvData>()->conversion;
+    state.setImmediate = Napi::Persistent(env.Global().Get("setImmediate").As<Napi::Function>());
+    state.resume = Napi::Persistent(Napi::Function::New(env, Resume, "PyNodeConversion"));
+
+    exports.Set("configureConversion", Napi::Function::New(env, Configure));
+}
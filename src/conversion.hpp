@@ -0,0 +1,56 @@
+#ifndef PYNODE_CONVERSION_HPP
+#define PYNODE_CONVERSION_HPP
+
+#include <Python.h>
+#include "napi.h"
+#include "helpers.hpp"
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+/* Bounds the cost of converting very large results. Lists and dicts are
+   converted in chunks, each under its own HandleScope, so the handles of
+   converted elements don't pile up until the callback returns. Async
+   results that are lists past incrementalThreshold are converted across
+   event loop turns, timeBudgetMs at a time. */
+class PyNodeConversion
+{
+public:
+    struct Options
+    {
+        uint32_t chunkSize = 1024;
+        /* 0 converts every result in one go */
+        uint32_t incrementalThreshold = 0;
+        double timeBudgetMs = 4;
+    };
+
+    /* Per env, lives in PyNodeEnvData */
+    struct EnvState
+    {
+        Napi::FunctionReference setImmediate;
+        Napi::FunctionReference resume;
+    };
+
+    static void Init(Napi::Env env, Napi::Object exports);
+    static uint32_t ChunkSize() { return s_chunkSize.load(std::memory_order_relaxed); }
+    /* Takes result over and settles deferred once it is converted, if it is
+       big enough to be worth spreading out. Needs the GIL. */
+    static bool ConvertIncrementally(Napi::Env env, py_object_owned &result, Napi::Promise::Deferred deferred);
+
+private:
+    struct Job;
+
+    static Napi::Value Configure(const Napi::CallbackInfo &info);
+    static Napi::Value Resume(const Napi::CallbackInfo &info);
+    static void Schedule(Napi::Env env, Job *job);
+    static bool RunSlice(Napi::Env env, Job *job);
+    static Options GetOptions();
+
+    static std::mutex s_optionsMutex;
+    static Options s_options;
+    static std::atomic<uint32_t> s_chunkSize;
+    static std::atomic<int64_t> s_incrementalConversions;
+    static std::atomic<int64_t> s_slices;
+};
+
+#endif
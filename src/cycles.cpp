@@ -0,0 +1,179 @@
+#include "cycles.hpp"
+#include "helpers.hpp"
+#include "jswrapper.hpp"
+#include "pyerror.hpp"
+#include "pynode.hpp"
+#include "pywrapper.hpp"
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+static const char* const CYCLE_REFS_PROPERTY = "__pynode_cycle_refs__";
+
+using RefCounts = std::unordered_map<PyObject*, Py_ssize_t>;
+using ObjectSet = std::unordered_set<PyObject*>;
+
+static int VisitDecref(PyObject* child, void* arg) {
+    auto& refs = *static_cast<RefCounts*>(arg);
+    auto it = refs.find(child);
+    if (it != refs.end())
+        it->second--;
+    return 0;
+}
+
+struct ReachVisit
+{
+    const RefCounts& refs;
+    ObjectSet& reached;
+    std::vector<PyObject*>& pending;
+};
+
+static int VisitReach(PyObject* child, void* arg) {
+    auto& visit = *static_cast<ReachVisit*>(arg);
+    if (visit.refs.count(child) && visit.reached.insert(child).second)
+        visit.pending.push_back(child);
+    return 0;
+}
+
+/* Everything tracked reachable from the given objects, stopping at excluded ones */
+static void Reach(const RefCounts& refs, std::vector<PyObject*> pending, ObjectSet& reached, const ObjectSet* excluded) {
+    ReachVisit visit{ refs, reached, pending };
+    for (auto obj : pending)
+        reached.insert(obj);
+    while (!pending.empty()) {
+        PyObject* obj = pending.back();
+        pending.pop_back();
+        if (excluded && excluded->count(obj))
+            continue;
+        traverseproc traverse = Py_TYPE(obj)->tp_traverse;
+        if (traverse)
+            traverse(obj, VisitReach, &visit);
+    }
+}
+
+Napi::Value PyNodeCycleCollector::Collect(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    trace_span span("PyNodeCycleCollector::Collect", "gc");
+    if (!PyNodeRequireInterpreter(env))
+        return env.Undefined();
+    py_ensure_gil ctx;
+    auto instData = env.GetInstanceData<PyNodeEnvData>();
+
+    py_object_owned gc(PyImport_ImportModule("gc"));
+    py_object_owned objects(gc ? PyObject_CallMethod(gc.get(), "get_objects", NULL) : nullptr);
+    if (!objects || !PyList_Check(objects.get())) {
+        PyNodePythonError::New(env, py_exception::Fetch()).ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    /* Same idea as CPython's own collector: start from the reference counts,
+       take away every reference held by another tracked object and whatever
+       is left comes from outside the Python heap. The list holds one more. */
+    RefCounts refs;
+    Py_ssize_t count = PyList_GET_SIZE(objects.get());
+    refs.reserve(count);
+    for (Py_ssize_t i = 0; i < count; i++) {
+        PyObject* obj = PyList_GET_ITEM(objects.get(), i);
+        refs[obj] = Py_REFCNT(obj) - 1;
+    }
+    for (Py_ssize_t i = 0; i < count; i++) {
+        PyObject* obj = PyList_GET_ITEM(objects.get(), i);
+        traverseproc traverse = Py_TYPE(obj)->tp_traverse;
+        if (traverse)
+            traverse(obj, VisitDecref, &refs);
+    }
+
+    /* The list of what the last pass made weak isn't a root either */
+    for (auto& obj : instData->weakJSObjects) {
+        auto it = refs.find(obj.get());
+        if (it != refs.end())
+            it->second--;
+    }
+
+    /* Then the references held by this env's JS wrappers. Other envs can't be
+       touched from this thread, their references stay roots. */
+    std::vector<std::pair<PyObject*, Napi::Object>> jsRoots;
+    {
+        std::unique_lock lock{ PyNodeEnvData::s_envDataMutex };
+        for (auto& [pyObj, mapping] : instData->objectMappings) {
+            auto it = refs.find(pyObj);
+            Napi::Object wrapper = mapping.existingJSObject.Value();
+            if (it == refs.end() || wrapper.IsEmpty())
+                continue;
+            it->second--;
+            jsRoots.emplace_back(pyObj, wrapper);
+        }
+    }
+
+    std::vector<PyObject*> pythonRoots;
+    for (auto& [obj, remaining] : refs) {
+        if (remaining > 0)
+            pythonRoots.push_back(obj);
+    }
+    ObjectSet pythonReachable;
+    Reach(refs, std::move(pythonRoots), pythonReachable, nullptr);
+
+    ObjectSet weak;
+    for (auto& [pyObj, wrapper] : jsRoots) {
+        Napi::Array cycleRefs = Napi::Array::New(env);
+        if (!pythonReachable.count(pyObj)) {
+            /* Only alive because JS holds the wrapper, let V8 see what it leads to */
+            ObjectSet reached;
+            Reach(refs, { pyObj }, reached, &pythonReachable);
+            for (auto obj : reached) {
+                if (pythonReachable.count(obj) || WrappedJSObject_get_env(obj) != (napi_env)env)
+                    continue;
+                Napi::Object jsObj = WrappedJSObject_get_napi_value(obj);
+                if (!jsObj.IsEmpty())
+                    cycleRefs.Set(cycleRefs.Length(), jsObj);
+                weak.insert(obj);
+            }
+        }
+
+        Napi::ObjectWrap<PyNodeWrappedPythonObject>::Unwrap(wrapper)->MarkCycleRoot(cycleRefs.Length() > 0);
+        if (cycleRefs.Length() > 0) {
+            wrapper.DefineProperty(Napi::PropertyDescriptor::Value(CYCLE_REFS_PROPERTY, cycleRefs, napi_configurable));
+        }
+        else if (wrapper.HasOwnProperty(CYCLE_REFS_PROPERTY)) {
+            wrapper.Delete(CYCLE_REFS_PROPERTY);
+        }
+    }
+
+    /* Strong again when Python can reach them by itself, weak otherwise */
+    uint32_t restored = 0, released = 0;
+    std::vector<py_object_owned> weakened;
+    for (auto& [obj, remaining] : refs) {
+        if (WrappedJSObject_get_env(obj) != (napi_env)env)
+            continue;
+        bool makeWeak = weak.count(obj) > 0;
+        if (!makeWeak && !pythonReachable.count(obj))
+            continue; /* Python garbage, its own collector will get to it */
+        bool wasWeak = WrappedJSObject_IsWeak(obj);
+        if (!WrappedJSObject_SetWeak(obj, makeWeak))
+            released++;
+        else if (wasWeak && !makeWeak)
+            restored++;
+        else if (makeWeak)
+            weakened.push_back(ConvertBorrowedObjectToOwned(obj));
+    }
+    instData->weakJSObjects.swap(weakened);
+
+    auto result = Napi::Object::New(env);
+    result.Set("objects", Napi::Number::New(env, static_cast<double>(count)));
+    result.Set("weak", Napi::Number::New(env, static_cast<double>(weak.size())));
+    result.Set("restored", Napi::Number::New(env, restored));
+    result.Set("released", Napi::Number::New(env, released));
+    return result;
+}
+
+void PyNodeCycleCollector::Restore(Napi::Env env) {
+    py_ensure_gil ctx;
+    auto instData = env.GetInstanceData<PyNodeEnvData>();
+    for (auto& obj : instData->weakJSObjects)
+        WrappedJSObject_SetWeak(obj.get(), false);
+    instData->weakJSObjects.clear();
+}
+
+void PyNodeCycleCollector::Init(Napi::Env env, Napi::Object exports) {
+    exports.Set("collectCycles", Napi::Function::New(env, Collect));
+}
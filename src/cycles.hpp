@@ -0,0 +1,28 @@
+#ifndef PYNODE_CYCLES_HPP
+#define PYNODE_CYCLES_HPP
+
+#include "napi.h"
+
+/* Finds Python objects that are only kept alive by JS wrappers and hands the
+   JS objects they reference over to V8's own tracing. For each such wrapper
+   the JS objects reachable through its Python object are stored on the
+   wrapper itself and the WrappedJSObject references are made weak, so a
+   cycle running through both heaps becomes a plain JS cycle V8 can free.
+   Each pass makes references strong again once Python reaches them on its
+   own. Using any wrapper that led to weak references from JS (calling it,
+   reading attributes, passing it to Python) makes them all strong again
+   first, so Python code can't pick up a weak one and outlive its JS object.
+   Touching a WrappedJSObject whose JS object went away raises
+   ReferenceError. */
+class PyNodeCycleCollector
+{
+public:
+    static void Init(Napi::Env env, Napi::Object exports);
+    /* Undoes what the last pass made weak, needs the GIL */
+    static void Restore(Napi::Env env);
+
+private:
+    static Napi::Value Collect(const Napi::CallbackInfo &info);
+};
+
+#endif
@@ -0,0 +1,141 @@
+#include "dispatch.hpp"
+#include "helpers.hpp"
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+/* A thread waiting in RunBlocking */
+struct PyNodeBlockingCall
+{
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool done = false;
+    bool ran = false;
+
+    void Finish(bool didRun) {
+        std::unique_lock lock(mutex);
+        if (done)
+            return;
+        done = true;
+        ran = didRun;
+        condition.notify_all();
+    }
+};
+
+struct PyNodeDispatchState
+{
+    Napi::ThreadSafeFunction tsfn;
+    std::thread::id jsThread;
+    /* Work queued at teardown is dropped without running, so the cleanup
+       hook releases these itself */
+    std::unordered_set<std::shared_ptr<PyNodeBlockingCall>> waiting;
+};
+
+/* Never destroyed, Python threads can still look here during shutdown */
+static std::mutex& s_dispatchMutex = *new std::mutex();
+static std::unordered_map<napi_env, PyNodeDispatchState>& s_dispatchStates = *new std::unordered_map<napi_env, PyNodeDispatchState>();
+
+void PyNodeJSDispatcher::Init(Napi::Env env) {
+    auto tsfn = Napi::ThreadSafeFunction::New(env, Napi::Function::New(env, [](const Napi::CallbackInfo&) {}),
+        "PyNodeJSDispatch", 0, 1);
+    /* Python threads calling into JS shouldn't keep the process alive */
+    tsfn.Unref(env);
+    {
+        std::unique_lock lock{ s_dispatchMutex };
+        s_dispatchStates[env] = { tsfn, std::this_thread::get_id() };
+    }
+
+    napi_env rawEnv = env;
+    env.AddCleanupHook([rawEnv]() {
+        std::unordered_set<std::shared_ptr<PyNodeBlockingCall>> waiting;
+        {
+            std::unique_lock lock{ s_dispatchMutex };
+            auto it = s_dispatchStates.find(rawEnv);
+            if (it == s_dispatchStates.end())
+                return;
+            waiting.swap(it->second.waiting);
+            s_dispatchStates.erase(it);
+        }
+        for (auto &call : waiting)
+            call->Finish(false);
+    });
+}
+
+bool PyNodeJSDispatcher::IsJSThread(napi_env env) {
+    std::unique_lock lock{ s_dispatchMutex };
+    auto it = s_dispatchStates.find(env);
+    return it != s_dispatchStates.end() && it->second.jsThread == std::this_thread::get_id();
+}
+
+bool PyNodeJSDispatcher::Post(napi_env env, std::function<void(Napi::Env)> work) {
+    std::unique_lock lock{ s_dispatchMutex };
+    auto it = s_dispatchStates.find(env);
+    if (it == s_dispatchStates.end())
+        return false;
+    auto status = it->second.tsfn.NonBlockingCall([work = std::move(work)](Napi::Env env, Napi::Function) {
+        trace_span span("js.dispatch", "js");
+        work(env);
+    });
+    return status == napi_ok;
+}
+
+bool PyNodeJSDispatcher::RunBlocking(napi_env env, std::function<void()> work) {
+    auto call = std::make_shared<PyNodeBlockingCall>();
+    auto forget = [env, call]() {
+        std::unique_lock lock{ s_dispatchMutex };
+        auto it = s_dispatchStates.find(env);
+        if (it != s_dispatchStates.end())
+            it->second.waiting.erase(call);
+    };
+    {
+        std::unique_lock lock{ s_dispatchMutex };
+        auto it = s_dispatchStates.find(env);
+        if (it == s_dispatchStates.end())
+            return false;
+        it->second.waiting.insert(call);
+    }
+
+    bool queued = Post(env, [call, work = std::move(work)](Napi::Env) {
+        /* Releases the caller however work ends */
+        struct Finisher {
+            PyNodeBlockingCall &call;
+            ~Finisher() { call.Finish(true); }
+        } finisher{ *call };
+        py_ensure_gil ctx;
+        try {
+            work();
+        }
+        catch (const Napi::Error&) {
+            /* work reports JS errors itself, one that gets here must not unwind into node */
+        }
+    });
+    if (!queued) {
+        forget();
+        return false;
+    }
+
+    bool ran;
+    {
+        std::unique_lock lock(call->mutex);
+        call->condition.wait(lock, [&]() { return call->done; });
+        ran = call->ran;
+    }
+    forget();
+    return ran;
+}
+
+void PyNodeJSDispatcher::Release(Napi::ObjectReference&& reference) {
+    if (reference.IsEmpty())
+        return;
+    napi_env env = reference.Env();
+    if (IsJSThread(env)) {
+        reference.Reset();
+        return;
+    }
+    /* Leaked if the env is already gone, there is nothing left to release it in */
+    auto moved = new Napi::ObjectReference(std::move(reference));
+    Post(env, [moved](Napi::Env) { delete moved; });
+}
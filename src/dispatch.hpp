@@ -0,0 +1,23 @@
+#ifndef PYNODE_DISPATCH_HPP
+#define PYNODE_DISPATCH_HPP
+
+#include "napi.h"
+#include <functional>
+
+/* Gets work onto an env's JS thread from any thread, through a threadsafe
+   function created with the env. Nothing here touches the GIL. */
+class PyNodeJSDispatcher
+{
+public:
+    static void Init(Napi::Env env);
+    static bool IsJSThread(napi_env env);
+    /* Queues work without waiting, returns false (and drops work) if the env is gone */
+    static bool Post(napi_env env, std::function<void(Napi::Env)> work);
+    /* Runs work on the JS thread and waits for it. Release the GIL first.
+       False if the env went away before work ran, work catches its own JS errors. */
+    static bool RunBlocking(napi_env env, std::function<void()> work);
+    /* Drops a reference on its JS thread, leaking it if the env is gone */
+    static void Release(Napi::ObjectReference &&reference);
+};
+
+#endif
@@ -2,17 +2,19 @@
 #include "jswrapper.hpp"
 #include "pywrapper.hpp"
 #include "pynode.hpp"
+#include "channel.hpp"
+#include "stream.hpp"
+#include "pyerror.hpp"
+#include "proxy.hpp"
+#include "conversion.hpp"
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <unordered_map>
 
-bool isNapiValueInt(Napi::Env& env, Napi::Value& num) {
-	return env.Global()
-		.Get("Number")
-		.ToObject()
-		.Get("isInteger")
-		.As<Napi::Function>()
-		.Call({ num })
-		.ToBoolean()
-		.Value();
+/* Same answer as Number.isInteger without the round trip into JS */
+bool isNapiValueInt(double num) {
+	return std::isfinite(num) && std::trunc(num) == num;
 }
 
 /* Returns true if the value given is (roughly) an object literal,
@@ -29,15 +31,30 @@ bool isNapiValuePlainObject(Napi::Object obj) {
 		return false;
 	}
 
-	auto plainobj_result = obj.Env().Global().Get("Object").As<Napi::Object>().Get("prototype");
-	return plainobj_result.StrictEquals(Napi::Value(obj.Env(), result));
+	return GetObjectPrototype(obj.Env()).StrictEquals(Napi::Value(obj.Env(), result));
 
 }
 
+Napi::Object GetObjectPrototype(Napi::Env env) {
+	auto instData = env.GetInstanceData<PyNodeEnvData>();
+	if (instData->ObjectPrototype.IsEmpty()) {
+		instData->ObjectPrototype = Napi::Persistent(env.Global().Get("Object").As<Napi::Object>().Get("prototype").As<Napi::Object>());
+	}
+	return instData->ObjectPrototype.Value();
+}
+
 bool isNapiValueWrappedPython(Napi::Env& env, Napi::Object obj) {
 	return obj.InstanceOf(env.GetInstanceData<PyNodeEnvData>()->PyNodeWrappedPythonObjectConstructor.Value());
 }
 
+bool isNapiValueChannel(Napi::Env& env, Napi::Object obj) {
+	return obj.InstanceOf(env.GetInstanceData<PyNodeEnvData>()->PyNodeChannelConstructor.Value());
+}
+
+bool isNapiValueStream(Napi::Env& env, Napi::Object obj) {
+	return obj.InstanceOf(env.GetInstanceData<PyNodeEnvData>()->PyNodeStreamConstructor.Value());
+}
+
 py_object_owned BuildPyArray(Napi::Env env, Napi::Value arg) {
 	auto arr = arg.As<Napi::Array>();
 	py_object_owned list(PyList_New(arr.Length()));
@@ -77,6 +94,7 @@ py_object_owned BuildWrappedJSObject(Napi::Object arg) {
 }
 
 py_object_owned BuildPyArgs(const Napi::CallbackInfo& args, size_t start_index, size_t count) {
+	trace_span span("BuildPyArgs", "conversion");
 	py_object_owned pArgs(PyTuple_New(count));
 	for (size_t i = start_index; i < start_index + count; i++) {
 		auto arg = args[i];
@@ -90,106 +108,284 @@ py_object_owned BuildPyArgs(const Napi::CallbackInfo& args, size_t start_index,
 	return pArgs;
 }
 
+static py_object_owned ConvertObjectToPython(Napi::Env env, Napi::Object obj) {
+	if (obj.IsArray()) {
+		return BuildPyArray(env, obj);
+	}
+
+	napi_value proto;
+	if (napi_get_prototype(env, obj, &proto) != napi_ok) {
+		throw Napi::Error::New(env);
+	}
+	Napi::Value prototype(env, proto);
+	if (prototype.StrictEquals(GetObjectPrototype(env))) {
+		return BuildPyDict(env, obj);
+	}
+
+	auto instData = env.GetInstanceData<PyNodeEnvData>();
+	for (auto& converter : instData->toPythonConverters) {
+		if (prototype.StrictEquals(converter.prototype.Value())) {
+			Napi::Value replacement = converter.converter.Call({ obj });
+			if (replacement.StrictEquals(obj)) {
+				break;
+			}
+			return ConvertToPython(replacement);
+		}
+	}
+
+	if (isNapiValueWrappedPython(env, obj)) {
+		PyNodeWrappedPythonObject* wrapper = Napi::ObjectWrap<PyNodeWrappedPythonObject>::Unwrap(obj);
+		return ConvertBorrowedObjectToOwned(wrapper->getValue());
+	}
+	else if (isNapiValueChannel(env, obj)) {
+		PyNodeChannel* channel = Napi::ObjectWrap<PyNodeChannel>::Unwrap(obj);
+		return py_object_owned(PyNodeChannel_New(channel->getState()));
+	}
+	else if (isNapiValueStream(env, obj)) {
+		PyNodeStream* stream = Napi::ObjectWrap<PyNodeStream>::Unwrap(obj);
+		return py_object_owned(PyNodeStream_New(stream->getState()));
+	}
+	else {
+		return BuildWrappedJSObject(obj);
+	}
+}
+
 py_object_owned ConvertToPython(Napi::Value arg) {
 	Napi::Env env = arg.Env();
-	if (arg.IsNumber()) {
-		double num = arg.As<Napi::Number>().ToNumber();
-		if (isNapiValueInt(env, arg)) {
-			return py_object_owned(PyLong_FromLong(num));
-		}
-		else {
-			return py_object_owned(PyFloat_FromDouble(num));
+	switch (arg.Type()) {
+	case napi_number: {
+		double num = arg.As<Napi::Number>().DoubleValue();
+		if (isNapiValueInt(num)) {
+			if (std::fabs(num) < 9.2e18) {
+				return py_object_owned(PyLong_FromLongLong(static_cast<long long>(num)));
+			}
+			return py_object_owned(PyLong_FromDouble(num));
 		}
+		return py_object_owned(PyFloat_FromDouble(num));
 	}
-	else if (arg.IsString()) {
+	case napi_string: {
 		std::string str = arg.As<Napi::String>();
-		return py_object_owned(PyUnicode_FromString(str.c_str()));
-	}
-	else if (arg.IsBoolean()) {
-		long b = arg.As<Napi::Boolean>().ToBoolean();
-		return py_object_owned(PyBool_FromLong(b));
-		// } else if (arg.IsDate()) {
-		//   printf("Dates dont work yet");
-		//   // Nan::ThrowError("Dates dont work yet");
-		//   throw Napi::Error::New(args.Env(), "Dates dont work  yet");
-	}
-	else if (arg.IsArray()) {
-		return BuildPyArray(env, arg);
-	}
-	else if (arg.IsObject()) {
-		auto obj = arg.As<Napi::Object>();
-		if (isNapiValueWrappedPython(env, obj)) {
-			PyNodeWrappedPythonObject* wrapper = Napi::ObjectWrap<PyNodeWrappedPythonObject>::Unwrap(obj);
-			return ConvertBorrowedObjectToOwned(wrapper->getValue());
-		}
-		else if (isNapiValuePlainObject(obj)) {
-			return BuildPyDict(env, obj);
-		}
-		else {
-			return BuildWrappedJSObject(obj);
-		}
+		return py_object_owned(PyUnicode_FromStringAndSize(str.data(), str.size()));
 	}
-	else if (arg.IsNull() || arg.IsUndefined()) {
+	case napi_boolean:
+		return py_object_owned(PyBool_FromLong(arg.As<Napi::Boolean>().Value()));
+	case napi_null:
+	case napi_undefined:
 		return ConvertBorrowedObjectToOwned(Py_None);
+	case napi_bigint: {
+		bool lossless;
+		int64_t value = arg.As<Napi::BigInt>().Int64Value(&lossless);
+		if (lossless) {
+			return py_object_owned(PyLong_FromLongLong(value));
+		}
+		std::string digits = arg.ToString();
+		return py_object_owned(PyLong_FromString(digits.c_str(), nullptr, 10));
 	}
-	else {
+	case napi_object:
+		return ConvertObjectToPython(env, arg.As<Napi::Object>());
+	case napi_function: {
+		Napi::Object wrapper = PyNodeProxy::Unwrap(env, arg.As<Napi::Object>());
+		return ConvertObjectToPython(env, wrapper.IsEmpty() ? arg.As<Napi::Object>() : wrapper);
+	}
+	default: {
 		Napi::String string = arg.ToString();
 		std::cout << "Unknown arg type" << string.Utf8Value() << std::endl;
 		throw Napi::Error::New(arg.Env(), "Unknown arg type");
 	}
+	}
 }
 
+/* Sized up front, and every chunk of elements converts under its own
+   HandleScope so a huge list doesn't hold a handle per element until the
+   callback returns. Items are re-read (and held) each time since a
+   converter may run Python code that changes the list. */
 Napi::Array BuildV8Array(Napi::Env env, PyObject* obj) {
-	const bool isList = PyList_Check(obj);
-	Py_ssize_t len = isList ? PyList_Size(obj) : PyTuple_Size(obj);
-
-	auto arr = Napi::Array::New(env);
+	Py_ssize_t len = PySequence_Fast_GET_SIZE(obj);
+	auto arr = Napi::Array::New(env, len);
+	Py_ssize_t chunkSize = PyNodeConversion::ChunkSize();
 
-	for (Py_ssize_t i = 0; i < len; i++) {
-		PyObject* localObj;
-		if (isList) {
-			localObj = PyList_GetItem(obj, i);
+	for (Py_ssize_t start = 0; start < len; start += chunkSize) {
+		Napi::HandleScope scope(env);
+		Py_ssize_t stop = std::min(len, start + chunkSize);
+		for (Py_ssize_t i = start; i < stop; i++) {
+			Napi::Value result = env.Null();
+			if (i < PySequence_Fast_GET_SIZE(obj)) {
+				py_object_owned item = ConvertBorrowedObjectToOwned(PySequence_Fast_GET_ITEM(obj, i));
+				result = ConvertFromPython(env, item.get());
+			}
+			arr.Set(static_cast<uint32_t>(i), result);
 		}
-		else {
-			localObj = PyTuple_GetItem(obj, i);
+	}
+	return arr;
+}
+
+
+Napi::Object BuildV8Dict(Napi::Env env, PyObject* obj) {
+	py_object_owned keys(PyDict_Keys(obj));
+	Py_ssize_t size = PyList_GET_SIZE(keys.get());
+	auto jsObj = Napi::Object::New(env);
+	Py_ssize_t chunkSize = PyNodeConversion::ChunkSize();
+
+	for (Py_ssize_t start = 0; start < size; start += chunkSize) {
+		Napi::HandleScope scope(env);
+		Py_ssize_t stop = std::min(size, start + chunkSize);
+		for (Py_ssize_t i = start; i < stop; i++) {
+			PyObject* key = PyList_GET_ITEM(keys.get(), i);
+			py_object_owned val = ConvertBorrowedObjectToOwned(PyDict_GetItem(obj, key));
+			if (!val)
+				continue;
+			py_object_owned keyString(PyObject_Str(key));
+			auto jsKey = Napi::String::New(env, PyUnicode_AsUTF8(keyString.get()));
+			jsObj.Set(jsKey, ConvertFromPython(env, val.get()));
 		}
+	}
 
-		Napi::Value result = env.Null();
-		if (localObj)
-			result = ConvertFromPython(env, localObj);
+	return jsObj;
+}
 
-		arr.Set(i, result);
+/* Registered from-Python converters, keyed on the exact type. Only touched
+   with the GIL held, so no lock of its own. Never destroyed, the references
+   must not be dropped after the interpreter is gone. */
+struct PyConverter
+{
+	py_object_owned type;
+	PyToJSConverter native = nullptr;
+	py_object_owned callable;
+};
 
+static std::unordered_map<PyTypeObject*, PyConverter>& s_pyConverters = *new std::unordered_map<PyTypeObject*, PyConverter>();
+
+void RegisterFromPythonConverter(PyTypeObject* type, PyToJSConverter converter) {
+	auto& entry = s_pyConverters[type];
+	entry.type = ConvertBorrowedObjectToOwned((PyObject*)type);
+	entry.native = converter;
+	entry.callable.reset();
+}
+
+int RegisterPythonConverter(PyObject* type, PyObject* converter) {
+	if (!PyType_Check(type)) {
+		PyErr_SetString(PyExc_TypeError, "register_converter needs a type");
+		return -1;
 	}
-	return arr;
+	if (converter == Py_None) {
+		s_pyConverters.erase((PyTypeObject*)type);
+		return 0;
+	}
+	if (!PyCallable_Check(converter)) {
+		PyErr_SetString(PyExc_TypeError, "register_converter needs a callable or None");
+		return -1;
+	}
+	auto& entry = s_pyConverters[(PyTypeObject*)type];
+	entry.type = ConvertBorrowedObjectToOwned(type);
+	entry.native = nullptr;
+	entry.callable = ConvertBorrowedObjectToOwned(converter);
+	return 0;
 }
 
+/* Exact type first, then the MRO so converters also cover subclasses */
+static const PyConverter* FindPyConverter(PyTypeObject* type) {
+	auto it = s_pyConverters.find(type);
+	if (it != s_pyConverters.end()) {
+		return &it->second;
+	}
+	PyObject* mro = type->tp_mro;
+	if (mro && PyTuple_Check(mro)) {
+		for (Py_ssize_t i = 1; i < PyTuple_GET_SIZE(mro); i++) {
+			it = s_pyConverters.find((PyTypeObject*)PyTuple_GET_ITEM(mro, i));
+			if (it != s_pyConverters.end()) {
+				return &it->second;
+			}
+		}
+	}
+	return nullptr;
+}
 
-Napi::Object BuildV8Dict(Napi::Env env, PyObject* obj) {
-	auto keys = PyDict_Keys(obj);
-	auto size = PyList_GET_SIZE(keys);
-	auto jsObj = Napi::Object::New(env);
+static Napi::Value ConvertWithPyConverter(Napi::Env env, const PyConverter& converter, PyObject* pValue) {
+	if (converter.native) {
+		return converter.native(env, pValue);
+	}
+	py_object_owned replacement(PyObject_CallOneArg(converter.callable.get(), pValue));
+	if (!replacement) {
+		throw PyNodePythonError::New(env, py_exception::Fetch());
+	}
+	if (Py_TYPE(replacement.get()) == Py_TYPE(pValue)) {
+		throw Napi::TypeError::New(env, "Converter for " + GetPyTypeName(Py_TYPE(pValue)) + " returned the same type");
+	}
+	return ConvertFromPython(env, replacement.get());
+}
 
-	for (Py_ssize_t i = 0; i < size; i++) {
-		auto key = PyList_GetItem(keys, i);
-		auto keyString = PyObject_Str(key);
-		auto val = PyDict_GetItem(obj, key);
-		auto jsKey = Napi::String::New(env, PyUnicode_AsUTF8(keyString));
-		jsObj.Set(jsKey, ConvertFromPython(env, val));
-		Py_DECREF(keyString);
+static Napi::Object FindWrapper(PyNodeEnvData* instData, PyObject* pValue) {
+	auto findIt = instData->objectMappings.find(pValue);
+	return findIt == instData->objectMappings.end() ? Napi::Object() : findIt->second.existingJSObject.Value();
+}
+
+static Napi::Value WrapPythonObject(Napi::Env env, PyObject* pValue) {
+	auto instData = env.GetInstanceData<PyNodeEnvData>();
+	{
+		std::unique_lock lock{ PyNodeEnvData::s_envDataMutex };
+		if (Napi::Object obj = FindWrapper(instData, pValue))
+			return obj;
 	}
 
-	Py_DECREF(keys);
+	/* Can run Python (an nbytes property), which must not happen under the mutex */
+	int64_t externalMemory = PyNodeMemoryPressure::EstimateExternalSize(pValue);
 
-	return jsObj;
+	std::unique_lock lock{ PyNodeEnvData::s_envDataMutex };
+	Napi::Object obj = FindWrapper(instData, pValue);
+	if (!obj)
+	{
+		auto exp = Napi::External<PyObject>::New(env, pValue);
+		obj = instData->PyNodeWrappedPythonObjectConstructor.New({ exp, Napi::Number::New(env, static_cast<double>(externalMemory)) });
+		auto mappingIt = instData->objectMappings.insert_or_assign(pValue, PyNodeEnvData::WeakRef()).first;
+		auto& mapping = mappingIt->second;
+		mapping.existingJSObject = Napi::Weak(obj);
+		mapping.pyWeakRef.reset(PyWeakref_NewRef(pValue, WeakRefCleanupFunc));
+		instData->weakRefToSlot[mapping.pyWeakRef.get()] = mappingIt;
+	}
+	return obj;
 }
 
 Napi::Value ConvertFromPython(Napi::Env env, PyObject* pValue) {
-	Napi::Value result = env.Undefined();
+	PyTypeObject* type = Py_TYPE(pValue);
+
+	/* Exact builtin types, by far the most common, skip every subtype check */
 	if (pValue == Py_None) {
-		result = env.Null();
+		return env.Null();
+	}
+	else if (type == &PyBool_Type) {
+		return Napi::Boolean::New(env, pValue == Py_True);
 	}
-	else if (PyBool_Check(pValue)) {
+	else if (type == &PyFloat_Type) {
+		return Napi::Number::New(env, PyFloat_AS_DOUBLE(pValue));
+	}
+	else if (type == &PyLong_Type) {
+		return Napi::Number::New(env, PyLong_AsDouble(pValue));
+	}
+	else if (type == &PyUnicode_Type) {
+		Py_ssize_t size;
+		const char* str = PyUnicode_AsUTF8AndSize(pValue, &size);
+		return Napi::String::New(env, str, static_cast<size_t>(size));
+	}
+	else if (type == &PyList_Type || type == &PyTuple_Type) {
+		return BuildV8Array(env, pValue);
+	}
+	else if (type == &PyDict_Type) {
+		return BuildV8Dict(env, pValue);
+	}
+	else if (type == &WrappedJSType) {
+		/* Empty once collectCycles let V8 collect it */
+		Napi::Object obj = WrappedJSObject_get_napi_value(pValue);
+		return obj.IsEmpty() ? env.Undefined() : obj;
+	}
+
+	if (!s_pyConverters.empty()) {
+		if (auto converter = FindPyConverter(type)) {
+			return ConvertWithPyConverter(env, *converter, pValue);
+		}
+	}
+
+	Napi::Value result = env.Undefined();
+	if (PyBool_Check(pValue)) {
 		bool b = PyObject_IsTrue(pValue);
 		result = Napi::Boolean::New(env, b);
 	}
@@ -217,27 +413,24 @@ Napi::Value ConvertFromPython(Napi::Env env, PyObject* pValue) {
 		auto obj = BuildV8Dict(env, pValue);
 		result = obj;
 	}
-	else if (Py_IS_TYPE(pValue, &WrappedJSType)) {
-		auto obj = Napi::Value(env, WrappedJSObject_get_napi_value(pValue));
-		result = obj;
-	}
 	else {
-		std::unique_lock lock{ PyNodeEnvData::s_envDataMutex };
-		auto instData = env.GetInstanceData<PyNodeEnvData>();
-		auto findIt = instData->objectMappings.find(pValue);
-		Napi::Object obj = findIt == instData->objectMappings.end() ? Napi::Object() : findIt->second.existingJSObject.Value();
-		if (!obj)
-		{
-			auto exp = Napi::External<PyObject>::New(env, pValue);
-			obj = instData->PyNodeWrappedPythonObjectConstructor.New({ exp });
-			auto mappingIt = instData->objectMappings.insert_or_assign(pValue, PyNodeEnvData::WeakRef()).first;
-			auto& mapping = mappingIt->second;
-			mapping.existingJSObject = Napi::Weak(obj);
-			mapping.pyWeakRef.reset(PyWeakref_NewRef(pValue, WeakRefCleanupFunc));
-			instData->weakRefToSlot[mapping.pyWeakRef.get()] = mappingIt;
-		}
-		result = obj;
+		result = WrapPythonObject(env, pValue);
 	}
 	return result;
 }
 
+
+std::string GetPyTypeName(PyTypeObject* type) {
+#if PY_VERSION_HEX >= 0x030B0000
+	py_object_owned nameStr(PyType_GetQualName(type));
+	return PyUnicode_AsUTF8(nameStr.get());
+#else
+	if (type->tp_flags & Py_TPFLAGS_HEAPTYPE) {
+		PyHeapTypeObject* et = (PyHeapTypeObject*)type;
+		return PyUnicode_AsUTF8(et->ht_qualname);
+	}
+	else {
+		return type->tp_name;
+	}
+#endif
+}
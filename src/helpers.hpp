@@ -2,8 +2,15 @@
 #define PYNODE_HELPERS_HPP
 
 #include <memory>
+#include <string>
 #include "napi.h"
 #include <Python.h>
+#include "tracing.hpp"
+
+/* PyModule_AddObjectRef and friends */
+#if PY_VERSION_HEX < 0x030A0000
+#error "PyNode needs Python 3.10 or newer"
+#endif
 
 struct PyObjectDeleter {
   void operator()(PyObject* b) { Py_XDECREF(b); }
@@ -20,7 +27,10 @@ inline py_object_owned ConvertBorrowedObjectToOwned(PyObject* o)
 /* entry points to threads should grab a py_thread_context for the duration of the thread */
 class py_thread_context {
 public:
-  py_thread_context() { gstate = PyGILState_Ensure(); }
+  py_thread_context() {
+    trace_span span("gil.acquire", "gil");
+    gstate = PyGILState_Ensure();
+  }
 
   ~py_thread_context() {
     PyGILState_Release(gstate);
@@ -37,6 +47,7 @@ protected:
 class py_ensure_gil {
 public:
   py_ensure_gil() {
+    trace_span span("gil.acquire", "gil");
     gstate = PyGILState_Ensure();
   }
 
@@ -49,6 +60,7 @@ private:
 };
 
 // v8 to Python
+bool isNapiValueWrappedPython(Napi::Env& env, Napi::Object obj);
 py_object_owned BuildPyArray(Napi::Env env, Napi::Value arg);
 py_object_owned BuildPyDict(Napi::Env env, Napi::Value arg);
 py_object_owned BuildWrappedJSObject(Napi::Object arg);
@@ -60,6 +72,15 @@ Napi::Array BuildV8Array(Napi::Env env, PyObject *obj);
 Napi::Object BuildV8Dict(Napi::Env env, PyObject *obj);
 Napi::Value ConvertFromPython(Napi::Env env, PyObject *obj);
 
+// Converters for types that should not end up as a wrapped object. Looked up on
+// the exact type, then its MRO, before the generic subtype checks.
+typedef Napi::Value (*PyToJSConverter)(Napi::Env env, PyObject *obj);
+void RegisterFromPythonConverter(PyTypeObject *type, PyToJSConverter converter);
+// pynode.register_converter, the callable returns a replacement to convert. None unregisters.
+int RegisterPythonConverter(PyObject *type, PyObject *converter);
+Napi::Object GetObjectPrototype(Napi::Env env);
+
 int Py_GetNumArguments(PyObject *pFunc);
+std::string GetPyTypeName(PyTypeObject *type);
 
 #endif
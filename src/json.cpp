@@ -0,0 +1,486 @@
+#include "json.hpp"
+#include <cmath>
+#include <cstring>
+#include <string_view>
+#include <unordered_map>
+
+namespace {
+    const int s_maxDepth = 1000;
+
+    class JsonParser
+    {
+    public:
+        JsonParser(const char *data, size_t length) : begin(data), p(data), end(data + length) {}
+
+        py_object_owned ParseDocument()
+        {
+            SkipWhitespace();
+            py_object_owned value = ParseValue();
+            if (!value)
+                return nullptr;
+            SkipWhitespace();
+            if (p != end)
+                return Fail("extra data after the value");
+            return value;
+        }
+
+    private:
+        py_object_owned Fail(const char *what)
+        {
+            if (!PyErr_Occurred())
+                PyErr_Format(PyExc_ValueError, "Invalid JSON at offset %zd: %s", static_cast<Py_ssize_t>(p - begin), what);
+            return nullptr;
+        }
+
+        void SkipWhitespace()
+        {
+            while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t'))
+                p++;
+        }
+
+        bool Literal(const char *text, size_t length)
+        {
+            if (static_cast<size_t>(end - p) < length || std::memcmp(p, text, length) != 0)
+                return false;
+            p += length;
+            return true;
+        }
+
+        py_object_owned ParseValue()
+        {
+            if (p == end)
+                return Fail("unexpected end of input");
+            switch (*p) {
+            case '{': return ParseObject();
+            case '[': return ParseArray();
+            case '"': return ParseString(false);
+            case 't':
+                if (Literal("true", 4))
+                    return ConvertBorrowedObjectToOwned(Py_True);
+                break;
+            case 'f':
+                if (Literal("false", 5))
+                    return ConvertBorrowedObjectToOwned(Py_False);
+                break;
+            case 'n':
+                if (Literal("null", 4))
+                    return ConvertBorrowedObjectToOwned(Py_None);
+                break;
+            default:
+                if (*p == '-' || (*p >= '0' && *p <= '9'))
+                    return ParseNumber();
+                break;
+            }
+            return Fail("unexpected character");
+        }
+
+        py_object_owned ParseObject()
+        {
+            if (++depth > s_maxDepth)
+                return Fail("nesting too deep");
+            p++;
+            py_object_owned dict(PyDict_New());
+            if (!dict)
+                return nullptr;
+            SkipWhitespace();
+            if (p < end && *p == '}') {
+                p++;
+                depth--;
+                return dict;
+            }
+            while (true) {
+                if (p == end || *p != '"')
+                    return Fail("expected a property name");
+                py_object_owned key = ParseString(true);
+                if (!key)
+                    return nullptr;
+                SkipWhitespace();
+                if (p == end || *p != ':')
+                    return Fail("expected ':'");
+                p++;
+                SkipWhitespace();
+                py_object_owned value = ParseValue();
+                if (!value || PyDict_SetItem(dict.get(), key.get(), value.get()) < 0)
+                    return nullptr;
+                SkipWhitespace();
+                if (p < end && *p == ',') {
+                    p++;
+                    SkipWhitespace();
+                    continue;
+                }
+                if (p < end && *p == '}') {
+                    p++;
+                    depth--;
+                    return dict;
+                }
+                return Fail("expected ',' or '}'");
+            }
+        }
+
+        py_object_owned ParseArray()
+        {
+            if (++depth > s_maxDepth)
+                return Fail("nesting too deep");
+            p++;
+            py_object_owned list(PyList_New(0));
+            if (!list)
+                return nullptr;
+            SkipWhitespace();
+            if (p < end && *p == ']') {
+                p++;
+                depth--;
+                return list;
+            }
+            while (true) {
+                py_object_owned value = ParseValue();
+                if (!value || PyList_Append(list.get(), value.get()) < 0)
+                    return nullptr;
+                SkipWhitespace();
+                if (p < end && *p == ',') {
+                    p++;
+                    SkipWhitespace();
+                    continue;
+                }
+                if (p < end && *p == ']') {
+                    p++;
+                    depth--;
+                    return list;
+                }
+                return Fail("expected ',' or ']'");
+            }
+        }
+
+        static int HexDigit(char c)
+        {
+            if (c >= '0' && c <= '9')
+                return c - '0';
+            if (c >= 'a' && c <= 'f')
+                return c - 'a' + 10;
+            if (c >= 'A' && c <= 'F')
+                return c - 'A' + 10;
+            return -1;
+        }
+
+        bool ReadHex4(uint32_t &code)
+        {
+            if (end - p < 4)
+                return false;
+            code = 0;
+            for (int i = 0; i < 4; i++) {
+                int digit = HexDigit(p[i]);
+                if (digit < 0)
+                    return false;
+                code = (code << 4) | static_cast<uint32_t>(digit);
+            }
+            p += 4;
+            return true;
+        }
+
+        static void AppendUtf8(std::string &out, uint32_t code)
+        {
+            if (code < 0x80) {
+                out.push_back(static_cast<char>(code));
+            }
+            else if (code < 0x800) {
+                out.push_back(static_cast<char>(0xC0 | (code >> 6)));
+                out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+            }
+            else if (code < 0x10000) {
+                out.push_back(static_cast<char>(0xE0 | (code >> 12)));
+                out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+                out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+            }
+            else {
+                out.push_back(static_cast<char>(0xF0 | (code >> 18)));
+                out.push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3F)));
+                out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+                out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+            }
+        }
+
+        /* Strings without escapes decode straight from the input. Property
+           names repeat a lot in arrays of records, so those are shared. */
+        py_object_owned ParseString(bool key)
+        {
+            const char *start = ++p;
+            while (p < end && *p != '"' && *p != '\\' && static_cast<unsigned char>(*p) >= 0x20)
+                p++;
+            if (p == end)
+                return Fail("unterminated string");
+            if (*p == '"') {
+                std::string_view text(start, p - start);
+                p++;
+                if (!key)
+                    return py_object_owned(PyUnicode_DecodeUTF8(text.data(), text.size(), "strict"));
+                auto found = keys.find(text);
+                if (found != keys.end())
+                    return ConvertBorrowedObjectToOwned(found->second.get());
+                py_object_owned name(PyUnicode_DecodeUTF8(text.data(), text.size(), "strict"));
+                if (name)
+                    keys.emplace(text, ConvertBorrowedObjectToOwned(name.get()));
+                return name;
+            }
+            if (*p != '\\')
+                return Fail("control character in string");
+
+            std::string buffer(start, p - start);
+            while (p < end && *p != '"') {
+                unsigned char c = static_cast<unsigned char>(*p);
+                if (c < 0x20)
+                    return Fail("control character in string");
+                if (c != '\\') {
+                    buffer.push_back(*p++);
+                    continue;
+                }
+                if (++p == end)
+                    break;
+                char escape = *p++;
+                switch (escape) {
+                case '"': buffer.push_back('"'); break;
+                case '\\': buffer.push_back('\\'); break;
+                case '/': buffer.push_back('/'); break;
+                case 'b': buffer.push_back('\b'); break;
+                case 'f': buffer.push_back('\f'); break;
+                case 'n': buffer.push_back('\n'); break;
+                case 'r': buffer.push_back('\r'); break;
+                case 't': buffer.push_back('\t'); break;
+                case 'u': {
+                    uint32_t code;
+                    if (!ReadHex4(code))
+                        return Fail("invalid \\u escape");
+                    uint32_t low;
+                    if (code >= 0xD800 && code < 0xDC00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+                        const char *mark = p;
+                        p += 2;
+                        if (ReadHex4(low) && low >= 0xDC00 && low < 0xE000)
+                            code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                        else
+                            p = mark;
+                    }
+                    AppendUtf8(buffer, code);
+                    break;
+                }
+                default:
+                    return Fail("invalid escape");
+                }
+            }
+            if (p == end)
+                return Fail("unterminated string");
+            p++;
+            /* Lone surrogates are allowed by JSON (and json.loads) */
+            return py_object_owned(PyUnicode_DecodeUTF8(buffer.data(), buffer.size(), "surrogatepass"));
+        }
+
+        py_object_owned ParseNumber()
+        {
+            const char *start = p;
+            bool integral = true;
+            if (*p == '-')
+                p++;
+            if (p < end && *p == '0') {
+                p++;
+            }
+            else if (p < end && *p >= '1' && *p <= '9') {
+                while (p < end && *p >= '0' && *p <= '9')
+                    p++;
+            }
+            else {
+                return Fail("invalid number");
+            }
+            if (p < end && *p == '.') {
+                integral = false;
+                p++;
+                if (p == end || *p < '0' || *p > '9')
+                    return Fail("invalid number");
+                while (p < end && *p >= '0' && *p <= '9')
+                    p++;
+            }
+            if (p < end && (*p == 'e' || *p == 'E')) {
+                integral = false;
+                p++;
+                if (p < end && (*p == '+' || *p == '-'))
+                    p++;
+                if (p == end || *p < '0' || *p > '9')
+                    return Fail("invalid number");
+                while (p < end && *p >= '0' && *p <= '9')
+                    p++;
+            }
+
+            size_t length = p - start;
+            if (integral && length <= 18) {
+                long long value = 0;
+                for (const char *digit = start + (*start == '-'); digit < p; digit++)
+                    value = value * 10 + (*digit - '0');
+                return py_object_owned(PyLong_FromLongLong(*start == '-' ? -value : value));
+            }
+            std::string text(start, length);
+            if (integral)
+                return py_object_owned(PyLong_FromString(text.c_str(), nullptr, 10));
+            double value = PyOS_string_to_double(text.c_str(), nullptr, PyExc_ValueError);
+            if (value == -1.0 && PyErr_Occurred())
+                return nullptr;
+            return py_object_owned(PyFloat_FromDouble(value));
+        }
+
+        const char *begin;
+        const char *p;
+        const char *end;
+        int depth = 0;
+        std::unordered_map<std::string_view, py_object_owned> keys;
+    };
+
+    void AppendString(std::string &out, const char *data, Py_ssize_t length)
+    {
+        static const char hex[] = "0123456789abcdef";
+        out.push_back('"');
+        for (Py_ssize_t i = 0; i < length; i++) {
+            unsigned char c = static_cast<unsigned char>(data[i]);
+            switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            default:
+                if (c < 0x20) {
+                    out += "\\u00";
+                    out.push_back(hex[c >> 4]);
+                    out.push_back(hex[c & 0xF]);
+                }
+                else {
+                    out.push_back(static_cast<char>(c));
+                }
+            }
+        }
+        out.push_back('"');
+    }
+
+    bool AppendUnicode(std::string &out, PyObject *str)
+    {
+        Py_ssize_t length;
+        const char *data = PyUnicode_AsUTF8AndSize(str, &length);
+        if (!data)
+            return false;
+        AppendString(out, data, length);
+        return true;
+    }
+
+    bool AppendFloat(std::string &out, double value)
+    {
+        if (!std::isfinite(value)) {
+            PyErr_SetString(PyExc_ValueError, "Out of range float values are not JSON compliant");
+            return false;
+        }
+        char *text = PyOS_double_to_string(value, 'r', 0, 0, nullptr);
+        if (!text)
+            return false;
+        out += text;
+        PyMem_Free(text);
+        return true;
+    }
+
+    bool AppendLong(std::string &out, PyObject *obj)
+    {
+        int overflow;
+        long long value = PyLong_AsLongLongAndOverflow(obj, &overflow);
+        if (!overflow) {
+            if (value == -1 && PyErr_Occurred())
+                return false;
+            out += std::to_string(value);
+            return true;
+        }
+        py_object_owned text(PyObject_Str(obj));
+        Py_ssize_t length;
+        const char *data = text ? PyUnicode_AsUTF8AndSize(text.get(), &length) : nullptr;
+        if (!data)
+            return false;
+        out.append(data, length);
+        return true;
+    }
+
+    /* json.dumps turns these keys into strings, anything else is a TypeError */
+    bool AppendKey(std::string &out, PyObject *key)
+    {
+        if (PyUnicode_Check(key))
+            return AppendUnicode(out, key);
+        std::string text;
+        if (key == Py_True || key == Py_False || key == Py_None)
+            text = key == Py_None ? "null" : key == Py_True ? "true" : "false";
+        else if (PyLong_Check(key) && !AppendLong(text, key))
+            return false;
+        else if (PyFloat_Check(key) && !AppendFloat(text, PyFloat_AS_DOUBLE(key)))
+            return false;
+        else if (!PyLong_Check(key) && !PyFloat_Check(key)) {
+            PyErr_Format(PyExc_TypeError, "keys must be str, int, float, bool or None, not %s", Py_TYPE(key)->tp_name);
+            return false;
+        }
+        AppendString(out, text.data(), text.size());
+        return true;
+    }
+
+    bool AppendValue(std::string &out, PyObject *obj, int depth)
+    {
+        if (depth > s_maxDepth) {
+            PyErr_SetString(PyExc_RecursionError, "maximum recursion depth exceeded while encoding JSON");
+            return false;
+        }
+        if (obj == Py_None) {
+            out += "null";
+            return true;
+        }
+        if (obj == Py_True || obj == Py_False) {
+            out += obj == Py_True ? "true" : "false";
+            return true;
+        }
+        if (PyUnicode_Check(obj))
+            return AppendUnicode(out, obj);
+        if (PyLong_Check(obj))
+            return AppendLong(out, obj);
+        if (PyFloat_Check(obj))
+            return AppendFloat(out, PyFloat_AS_DOUBLE(obj));
+        if (PyList_Check(obj) || PyTuple_Check(obj)) {
+            out.push_back('[');
+            for (Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(obj); i++) {
+                if (i)
+                    out.push_back(',');
+                if (!AppendValue(out, PySequence_Fast_GET_ITEM(obj, i), depth + 1))
+                    return false;
+            }
+            out.push_back(']');
+            return true;
+        }
+        if (PyDict_Check(obj)) {
+            out.push_back('{');
+            Py_ssize_t pos = 0;
+            PyObject *key;
+            PyObject *value;
+            bool first = true;
+            while (PyDict_Next(obj, &pos, &key, &value)) {
+                if (!first)
+                    out.push_back(',');
+                first = false;
+                if (!AppendKey(out, key))
+                    return false;
+                out.push_back(':');
+                if (!AppendValue(out, value, depth + 1))
+                    return false;
+            }
+            out.push_back('}');
+            return true;
+        }
+        PyErr_Format(PyExc_TypeError, "Object of type %s is not JSON serializable", Py_TYPE(obj)->tp_name);
+        return false;
+    }
+}
+
+py_object_owned PyNodeJson::Parse(const char *data, size_t length) {
+    trace_span span("PyNodeJson::Parse", "conversion");
+    return JsonParser(data, length).ParseDocument();
+}
+
+bool PyNodeJson::Serialize(PyObject *obj, std::string &out) {
+    trace_span span("PyNodeJson::Serialize", "conversion");
+    return AppendValue(out, obj, 0);
+}
@@ -0,0 +1,21 @@
+#ifndef PYNODE_JSON_HPP
+#define PYNODE_JSON_HPP
+
+#include <Python.h>
+#include "helpers.hpp"
+#include <string>
+
+/* JSON text straight to Python objects and back, without going through JS
+   values, so __calljson__ can do both on the worker thread. Everything here
+   needs the GIL. */
+class PyNodeJson
+{
+public:
+    /* Strict RFC 8259. NULL with a ValueError naming the offset on bad input. */
+    static py_object_owned Parse(const char *data, size_t length);
+    /* Appends obj as compact JSON, with the same types json.dumps accepts by
+       default. False with a TypeError/ValueError set otherwise. */
+    static bool Serialize(PyObject *obj, std::string &out);
+};
+
+#endif
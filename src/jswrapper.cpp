@@ -3,8 +3,12 @@
 #include "helpers.hpp"
 #include "pynode.hpp"
 #include "worker.hpp"
+#include "channel.hpp"
+#include "stream.hpp"
+#include "dispatch.hpp"
 #include <structmember.h>
 #include <optional>
+#include <vector>
 #include "napi.h"
 
 struct WrappedJSObject {
@@ -13,6 +17,7 @@ struct WrappedJSObject {
     struct CPPData
     {
         Napi::ObjectReference object_reference;
+        bool weak = false; // collectCycles found it only reachable from JS
     };
     CPPData cpp;
 };
@@ -21,13 +26,34 @@ static void
 WrappedJSObject_dealloc(PyObject* obj)
 {
     WrappedJSObject *self = (WrappedJSObject *)obj;
-    PyNodeWorker::WrapJSInteractionFromAsyncThread([&]()
-    {
-        self->cpp.~CPPData();
-    });
+    PyObject_GC_UnTrack(obj);
+    /* Never wait on the JS thread just to drop a reference */
+    PyNodeJSDispatcher::Release(std::move(self->cpp.object_reference));
+    self->cpp.~CPPData();
     Py_TYPE(self)->tp_free((PyObject *) self);
 }
 
+/* No Python references inside, but being tracked puts instances in
+   gc.get_objects() where collectCycles can find them */
+static int
+WrappedJSObject_traverse(PyObject* self, visitproc visit, void* arg)
+{
+    return 0;
+}
+
+static void
+SetCollectedJSObjectError()
+{
+    PyErr_SetString(PyExc_ReferenceError, "The JavaScript object was garbage collected");
+}
+
+static PyObject *
+SetJSUnavailableError()
+{
+    PyErr_SetString(PyExc_RuntimeError, "The JavaScript environment is shutting down");
+    return NULL;
+}
+
 
 
 static PyObject *
@@ -53,18 +79,39 @@ WrappedJSObject_getattro(PyObject *_self, PyObject *attr)
 {
     WrappedJSObject *self = (WrappedJSObject*)_self;
     py_object_owned pyval;
-    PyNodeWorker::WrapJSInteractionFromAsyncThread([&]() {
+    std::string error;
+    bool collected = false;
+    bool ran = PyNodeWorker::WrapJSInteractionFromAsyncThread(self->cpp.object_reference.Env(), [&]() {
         auto wrapped = self->cpp.object_reference.Value();
+        if (wrapped.IsEmpty()) {
+            collected = true;
+            return;
+        }
         const char* utf8name = PyUnicode_AsUTF8(attr);
-        if (wrapped.Has(utf8name)) {
+        try {
+            /* One Get, Has only settles whether an undefined is a missing property */
             auto result = wrapped.Get(utf8name);
-            pyval = ConvertToPython(result);
-
+            if (!result.IsUndefined() || wrapped.Has(utf8name)) {
+                pyval = ConvertToPython(result);
+            }
+        }
+        catch (const Napi::Error& e) {
+            error = e.Message();
         }
     });
+    if (!ran)
+        return SetJSUnavailableError();
     if (pyval) {
         return pyval.release();
     }
+    if (collected) {
+        SetCollectedJSObjectError();
+        return NULL;
+    }
+    if (!error.empty()) {
+        PyErr_SetString(PyExc_RuntimeError, error.c_str());
+        return NULL;
+    }
     PyErr_SetObject(PyExc_AttributeError, attr);
     Py_RETURN_NONE;
 }
@@ -74,12 +121,18 @@ WrappedJSObject_call(PyObject *_self, PyObject *args, PyObject *kwargs)
 {
     WrappedJSObject *self = (WrappedJSObject*)_self;
     py_object_owned pyval;
-    const char* error = nullptr;
+    std::string error;
+    bool collected = false;
 
-    PyNodeWorker::WrapJSInteractionFromAsyncThread([&]() {
+    trace_span span("WrappedJSObject_call", "js");
+    bool ran = PyNodeWorker::WrapJSInteractionFromAsyncThread(self->cpp.object_reference.Env(), [&]() {
         auto env = self->cpp.object_reference.Env();
         auto wrapped = self->cpp.object_reference.Value();
 
+        if (wrapped.IsEmpty()) {
+            collected = true;
+            return;
+        }
         if (!wrapped.IsFunction()) {
             error = "Error calling javascript function";
             return;
@@ -87,26 +140,38 @@ WrappedJSObject_call(PyObject *_self, PyObject *args, PyObject *kwargs)
 
         auto wrappedFunc = wrapped.As<Napi::Function>();
 
-        py_object_owned seq(PySequence_Fast(args, "*args must be a sequence"));
-        Py_ssize_t len = PySequence_Size(args);
-        auto jsargs = std::vector<Napi::Value>(len);
-        for (Py_ssize_t i = 0; i < len; i++) {
-            PyObject* arg = PySequence_Fast_GET_ITEM(seq.get(), i);
-            jsargs[i] = ConvertFromPython(env, arg);
-        }
-
-        Napi::Object thisPtr = self->cpp.object_reference.Value();
+        /* A throwing callback (or argument conversion) comes back as a RuntimeError */
+        try {
+            py_object_owned seq(PySequence_Fast(args, "*args must be a sequence"));
+            Py_ssize_t len = PySequence_Size(args);
+            auto jsargs = std::vector<Napi::Value>(len);
+            for (Py_ssize_t i = 0; i < len; i++) {
+                PyObject* arg = PySequence_Fast_GET_ITEM(seq.get(), i);
+                jsargs[i] = ConvertFromPython(env, arg);
+            }
 
-        auto result = wrappedFunc.Call(thisPtr, jsargs);
-        if (!result) {
-            error = "Error calling javascript function";
-            return;
+            Napi::Object thisPtr = self->cpp.object_reference.Value();
+            auto result = wrappedFunc.Call(thisPtr, jsargs);
+            if (!result) {
+                error = "Error calling javascript function";
+                return;
+            }
+            pyval = ConvertToPython(result);
+        }
+        catch (const Napi::Error& e) {
+            error = e.Message();
         }
-
-        pyval = ConvertToPython(result);
      });
-    if (error)
-        PyErr_SetString(PyExc_RuntimeError, error);
+    if (!ran)
+        return SetJSUnavailableError();
+    if (collected) {
+        SetCollectedJSObjectError();
+        return NULL;
+    }
+    if (!error.empty()) {
+        PyErr_SetString(PyExc_RuntimeError, error.c_str());
+        return NULL;
+    }
 
     return pyval ? pyval.release() : Py_NewRef(Py_None);
 }
@@ -114,11 +179,23 @@ WrappedJSObject_call(PyObject *_self, PyObject *args, PyObject *kwargs)
 PyObject * WrappedJSObject_str(PyObject *_self) {
     WrappedJSObject *self = (WrappedJSObject *)_self;
     py_object_owned pyval;
-    const char* error = nullptr;
+    std::string error;
+    bool collected = false;
 
-    PyNodeWorker::WrapJSInteractionFromAsyncThread([&]() {
+    bool ran = PyNodeWorker::WrapJSInteractionFromAsyncThread(self->cpp.object_reference.Env(), [&]() {
         auto wrapped = self->cpp.object_reference.Value();
-        auto result = wrapped.ToString();
+        if (wrapped.IsEmpty()) {
+            collected = true;
+            return;
+        }
+        Napi::String result;
+        try {
+            result = wrapped.ToString();
+        }
+        catch (const Napi::Error& e) {
+            error = e.Message();
+            return;
+        }
         if (result.IsEmpty()) {
             error = "Error coercing javascript value to string";
             return;
@@ -131,9 +208,17 @@ PyObject * WrappedJSObject_str(PyObject *_self) {
             return;
         }
      });
+    if (!ran)
+        return SetJSUnavailableError();
 
-    if (error)
-        PyErr_SetString(PyExc_RuntimeError, error);
+    if (collected) {
+        SetCollectedJSObjectError();
+        return NULL;
+    }
+    if (!error.empty()) {
+        PyErr_SetString(PyExc_RuntimeError, error.c_str());
+        return NULL;
+    }
 
     return pyval ? pyval.release() : Py_NewRef(Py_None);
 }
@@ -158,7 +243,7 @@ PyObject *WrappedJSObject_New(Napi::Object value) {
 
 
 Napi::Object WrappedJSObject_get_napi_value(PyObject* s) {
-    if (s && Py_IS_TYPE(s, &WrappedJSType))
+    if (s && PyObject_TypeCheck(s, &WrappedJSType))
     {
         WrappedJSObject* self = (WrappedJSObject*)s;
         return self->cpp.object_reference.Value();
@@ -166,6 +251,284 @@ Napi::Object WrappedJSObject_get_napi_value(PyObject* s) {
     return {};
 }
 
+napi_env WrappedJSObject_get_env(PyObject* s) {
+    if (s && PyObject_TypeCheck(s, &WrappedJSType))
+    {
+        WrappedJSObject* self = (WrappedJSObject*)s;
+        return self->cpp.object_reference.IsEmpty() ? nullptr : (napi_env)self->cpp.object_reference.Env();
+    }
+    return nullptr;
+}
+
+bool WrappedJSObject_SetWeak(PyObject* s, bool weak) {
+    WrappedJSObject* self = (WrappedJSObject*)s;
+    if (self->cpp.weak != weak) {
+        if (weak)
+            self->cpp.object_reference.Unref();
+        else
+            self->cpp.object_reference.Ref();
+        self->cpp.weak = weak;
+    }
+    return !self->cpp.object_reference.Value().IsEmpty();
+}
+
+bool WrappedJSObject_IsWeak(PyObject* s) {
+    return ((WrappedJSObject*)s)->cpp.weak;
+}
+
+static PyObject* pynode_register_converter(PyObject* self, PyObject* args) {
+    PyObject* type;
+    PyObject* converter;
+    if (!PyArg_ParseTuple(args, "OO:register_converter", &type, &converter))
+        return NULL;
+    if (RegisterPythonConverter(type, converter) < 0)
+        return NULL;
+    Py_RETURN_NONE;
+}
+
+/* A call_js_async in flight. Only touched on the JS thread once posted, the
+   references are dropped with the GIL as soon as the future is settled. */
+struct PendingJSCall
+{
+    py_object_owned fn;
+    py_object_owned args;
+    py_object_owned future;
+
+    ~PendingJSCall() {
+        if (fn || args || future) {
+            py_ensure_gil ctx;
+            Reset();
+        }
+    }
+
+    void Reset() {
+        fn.reset();
+        args.reset();
+        future.reset();
+    }
+};
+
+/* Needs the GIL. value == NULL settles the future with a RuntimeError(message). */
+static void SettleFuture(PendingJSCall& call, PyObject* value, const std::string& message) {
+    if (!call.future)
+        return;
+    py_object_owned done;
+    if (value) {
+        done.reset(PyObject_CallMethod(call.future.get(), "set_result", "O", value));
+    }
+    else {
+        py_object_owned error(PyObject_CallFunction(PyExc_RuntimeError, "s", message.c_str()));
+        done.reset(PyObject_CallMethod(call.future.get(), "set_exception", "O", error.get()));
+    }
+    if (!done)
+        PyErr_Clear(); /* cancelled or already settled */
+    call.Reset();
+}
+
+static void SettleFuture(PendingJSCall& call, Napi::Value result) {
+    try {
+        py_object_owned value = ConvertToPython(result);
+        SettleFuture(call, value.get(), std::string());
+    }
+    catch (const Napi::Error& e) {
+        SettleFuture(call, nullptr, e.Message());
+    }
+}
+
+static void RunPendingJSCall(Napi::Env env, const std::shared_ptr<PendingJSCall>& call) {
+    py_ensure_gil ctx;
+    py_object_owned running(PyObject_CallMethod(call->future.get(), "set_running_or_notify_cancel", NULL));
+    if (!running || running.get() != Py_True) {
+        PyErr_Clear();
+        call->Reset();
+        return;
+    }
+
+    Napi::Object fn = WrappedJSObject_get_napi_value(call->fn.get());
+    if (fn.IsEmpty() || !fn.IsFunction()) {
+        SettleFuture(*call, nullptr, fn.IsEmpty() ? "The JavaScript object was garbage collected" : "Not a JavaScript function");
+        return;
+    }
+
+    try {
+        Py_ssize_t len = PyTuple_GET_SIZE(call->args.get());
+        std::vector<napi_value> jsargs(len);
+        for (Py_ssize_t i = 0; i < len; i++) {
+            jsargs[i] = ConvertFromPython(env, PyTuple_GET_ITEM(call->args.get(), i));
+        }
+        Napi::Value result = fn.As<Napi::Function>().Call(fn, jsargs);
+
+        if (result.IsPromise()) {
+            /* Settle once the promise does */
+            auto onResolve = Napi::Function::New(env, [call](const Napi::CallbackInfo& info) {
+                py_ensure_gil ctx;
+                SettleFuture(*call, info[0]);
+            });
+            auto onReject = Napi::Function::New(env, [call](const Napi::CallbackInfo& info) {
+                py_ensure_gil ctx;
+                Napi::Value reason = info[0];
+                std::string message = reason.IsObject() && reason.As<Napi::Object>().Has("message")
+                    ? reason.As<Napi::Object>().Get("message").ToString().Utf8Value()
+                    : reason.ToString().Utf8Value();
+                SettleFuture(*call, nullptr, message);
+            });
+            result.As<Napi::Object>().Get("then").As<Napi::Function>().Call(result, { onResolve, onReject });
+        }
+        else {
+            SettleFuture(*call, result);
+        }
+    }
+    catch (const Napi::Error& e) {
+        SettleFuture(*call, nullptr, e.Message());
+    }
+}
+
+static PyObject* pynode_call_js_async(PyObject* self, PyObject* args) {
+    Py_ssize_t len = PyTuple_GET_SIZE(args);
+    napi_env env = len > 0 ? WrappedJSObject_get_env(PyTuple_GET_ITEM(args, 0)) : nullptr;
+    if (!env) {
+        PyErr_SetString(PyExc_TypeError, "call_js_async needs a JavaScript function");
+        return NULL;
+    }
+
+    py_object_owned futures(PyImport_ImportModule("concurrent.futures"));
+    py_object_owned future(futures ? PyObject_CallMethod(futures.get(), "Future", NULL) : nullptr);
+    if (!future)
+        return NULL;
+
+    auto call = std::make_shared<PendingJSCall>();
+    call->fn = ConvertBorrowedObjectToOwned(PyTuple_GET_ITEM(args, 0));
+    call->args.reset(PyTuple_GetSlice(args, 1, len));
+    call->future = ConvertBorrowedObjectToOwned(future.get());
+
+    trace_span span("call_js_async", "js");
+    if (!PyNodeJSDispatcher::Post(env, [call](Napi::Env env) { RunPendingJSCall(env, call); })) {
+        SettleFuture(*call, nullptr, "The JavaScript environment has shut down");
+    }
+    return future.release();
+}
+
+static py_object_owned SnapshotObject(Napi::Object obj, const std::vector<std::string>* keys, int depth);
+
+/* Values that would come through as WrappedJSObjects are copied too while depth lasts */
+static py_object_owned SnapshotValue(Napi::Value value, int depth) {
+    py_object_owned pyval = ConvertToPython(value);
+    if (depth > 0 && pyval && Py_TYPE(pyval.get()) == &WrappedJSType && value.Type() == napi_object)
+        return SnapshotObject(value.As<Napi::Object>(), nullptr, depth);
+    return pyval;
+}
+
+/* keys, or every enumerable property of obj, as a dict. JS thread with the GIL held. */
+static py_object_owned SnapshotObject(Napi::Object obj, const std::vector<std::string>* keys, int depth) {
+    py_object_owned dict(PyDict_New());
+    auto add = [&](const std::string& name, Napi::Value value) {
+        py_object_owned pyval = SnapshotValue(value, depth - 1);
+        return pyval && PyDict_SetItemString(dict.get(), name.c_str(), pyval.get()) == 0;
+    };
+
+    if (!dict)
+        return dict;
+    if (keys) {
+        for (const std::string& name : *keys) {
+            if (!add(name, obj.Get(name)))
+                return nullptr;
+        }
+    }
+    else {
+        Napi::Array names = obj.GetPropertyNames();
+        for (uint32_t i = 0; i < names.Length(); i++) {
+            std::string name = names.Get(i).ToString();
+            if (!add(name, obj.Get(name)))
+                return nullptr;
+        }
+    }
+    return dict;
+}
+
+static PyObject* pynode_snapshot(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static const char* kwlist[] = { "obj", "keys", "depth", NULL };
+    PyObject* obj;
+    PyObject* keys = Py_None;
+    int depth = 1;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|Oi:snapshot", (char**)kwlist, &obj, &keys, &depth))
+        return NULL;
+
+    napi_env env = WrappedJSObject_get_env(obj);
+    if (!env) {
+        PyErr_SetString(PyExc_TypeError, "snapshot needs a JavaScript object");
+        return NULL;
+    }
+    if (depth < 1) {
+        PyErr_SetString(PyExc_ValueError, "depth must be at least 1");
+        return NULL;
+    }
+
+    std::optional<std::vector<std::string>> names;
+    if (keys != Py_None) {
+        py_object_owned seq(PySequence_Fast(keys, "keys must be a sequence of str"));
+        if (!seq)
+            return NULL;
+        names.emplace();
+        for (Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(seq.get()); i++) {
+            const char* name = PyUnicode_AsUTF8(PySequence_Fast_GET_ITEM(seq.get(), i));
+            if (!name)
+                return NULL;
+            names->push_back(name);
+        }
+    }
+
+    WrappedJSObject* wrapped = (WrappedJSObject*)obj;
+    py_object_owned result;
+    py_exception exception;
+    std::string error;
+    bool collected = false;
+
+    trace_span span("snapshot", "js");
+    bool ran = PyNodeWorker::WrapJSInteractionFromAsyncThread(env, [&]() {
+        auto value = wrapped->cpp.object_reference.Value();
+        if (value.IsEmpty()) {
+            collected = true;
+            return;
+        }
+        try {
+            result = SnapshotObject(value, names ? &*names : nullptr, depth);
+            /* Raised on the JS thread, handed back to the caller's thread state */
+            if (!result)
+                exception = py_exception::Fetch();
+        }
+        catch (const Napi::Error& e) {
+            result.reset();
+            error = e.Message();
+        }
+    });
+    if (!ran)
+        return SetJSUnavailableError();
+
+    if (collected) {
+        SetCollectedJSObjectError();
+        return NULL;
+    }
+    if (exception) {
+        PyErr_Restore(exception.type.release(), exception.value.release(), exception.traceback.release());
+        return NULL;
+    }
+    if (!result) {
+        PyErr_SetString(PyExc_RuntimeError, error.empty() ? "Error copying the JavaScript object" : error.c_str());
+        return NULL;
+    }
+    return result.release();
+}
+
+static PyMethodDef pynodemethods[] = {
+    {"call_js_async", pynode_call_js_async, METH_VARARGS,
+     "call_js_async(fn, *args)\n--\n\nCalls a JavaScript function on its JS thread from any Python thread without waiting. Returns a concurrent.futures.Future, settled when the call (or the promise it returns) does."},
+    {"snapshot", (PyCFunction)(void(*)(void))pynode_snapshot, METH_VARARGS | METH_KEYWORDS,
+     "snapshot(obj, keys=None, depth=1)\n--\n\nCopies keys (or every enumerable property) of a JavaScript object into a dict in a single trip to the JS thread. Values that would otherwise be wrapped JavaScript objects are copied as well, up to depth levels down."},
+    {"register_converter", pynode_register_converter, METH_VARARGS,
+     "register_converter(type, fn)\n--\n\nConvert instances of type (and subclasses) to JS as fn(obj) instead of wrapping them. fn=None unregisters."},
+    {NULL, NULL, 0, NULL}
+};
+
 static PyModuleDef pynodemodule = {
     PyModuleDef_HEAD_INIT,
 };
@@ -188,12 +551,7 @@ static PyMethodDef weakRefCleanupFuncMethodDef = {
             if (removedRef)
             {
                 removedRef.mapped().pyWeakRef.reset(); //deref the python stuff here
-                //Annoying but interally WrapJSInteractionFromAsyncThread does a copy
-                auto existingJSObject = std::make_shared<Napi::ObjectReference>(std::move(removedRef.mapped().existingJSObject));
-                PyNodeWorker::WrapJSInteractionFromAsyncThread([existingJSObject]()
-                {
-                    existingJSObject->Reset();
-                });
+                PyNodeJSDispatcher::Release(std::move(removedRef.mapped().existingJSObject));
             }
             Py_RETURN_NONE;
         },
@@ -211,10 +569,12 @@ PyInit_jswrapper(void)
     WrappedJSType.tp_doc = "A JavaScript object";
     WrappedJSType.tp_basicsize = sizeof(WrappedJSObject);
     WrappedJSType.tp_itemsize = 0;
-    WrappedJSType.tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE;
+    WrappedJSType.tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_HAVE_GC;
     WrappedJSType.tp_new = WrappedJSObject_new;
     WrappedJSType.tp_init = WrappedJSObject_init;
     WrappedJSType.tp_dealloc = WrappedJSObject_dealloc;
+    WrappedJSType.tp_traverse = WrappedJSObject_traverse;
+    WrappedJSType.tp_free = PyObject_GC_Del;
     WrappedJSType.tp_call = WrappedJSObject_call;
     WrappedJSType.tp_getattro = WrappedJSObject_getattro;
     WrappedJSType.tp_str = WrappedJSObject_str;
@@ -222,6 +582,7 @@ PyInit_jswrapper(void)
     pynodemodule.m_name = "pynode";
     pynodemodule.m_doc = "Python <3 JavaScript.";
     pynodemodule.m_size = -1;
+    pynodemodule.m_methods = pynodemethods;
 
     if (PyType_Ready(&WrappedJSType) < 0)
         return NULL;
@@ -242,6 +603,14 @@ PyInit_jswrapper(void)
         return NULL;
     }
 
+    if (PyNodeChannel_AddToModule(m.get()) < 0) {
+        return NULL;
+    }
+
+    if (PyNodeStream_AddToModule(m.get()) < 0) {
+        return NULL;
+    }
+
     WeakRefCleanupFunc = f.get();
 
     return m.release();
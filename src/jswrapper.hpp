@@ -8,6 +8,12 @@
 PyMODINIT_FUNC PyInit_jswrapper(void);
 PyObject *WrappedJSObject_New(Napi::Object value);
 Napi::Object WrappedJSObject_get_napi_value(PyObject *);
+/* The env a WrappedJSObject (or subclass) lives in, NULL for anything else */
+napi_env WrappedJSObject_get_env(PyObject *);
+/* Weakens or restores the reference to the JS object, must be called on its
+   JS thread. Returns false if the JS object has been collected. */
+bool WrappedJSObject_SetWeak(PyObject *, bool weak);
+bool WrappedJSObject_IsWeak(PyObject *);
 extern PyTypeObject WrappedJSType;
 extern PyObject* WeakRefCleanupFunc;
 
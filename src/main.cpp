@@ -1,9 +1,15 @@
 #include "napi.h"
 #include "pynode.hpp"
+#ifdef PYNODE_BENCHMARK
+#include "bench.hpp"
+#endif
 #include <iostream>
 
 Napi::Object Init(Napi::Env env, Napi::Object exports) {
   exports = PyNodeInit(env, exports);
+#ifdef PYNODE_BENCHMARK
+  exports = BenchInit(env, exports);
+#endif
 
   return exports;
 }
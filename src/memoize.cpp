@@ -0,0 +1,379 @@
+#include "memoize.hpp"
+#include "pynode.hpp"
+#include "helpers.hpp"
+#include "pywrapper.hpp"
+#include "pyerror.hpp"
+#include "worker.hpp"
+#include "allocations.hpp"
+#include "tracing.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+namespace {
+    double NowMs()
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    std::shared_ptr<PyObject> ShareResult(PyObject *result)
+    {
+        Py_INCREF(result);
+        return std::shared_ptr<PyObject>(result, [](PyObject *obj) {
+            py_ensure_gil ctx;
+            Py_DECREF(obj);
+        });
+    }
+
+    void AppendRaw(std::string &key, const void *data, size_t length)
+    {
+        key.append(static_cast<const char *>(data), length);
+    }
+
+    void AppendSized(std::string &key, char tag, const void *data, size_t length)
+    {
+        uint32_t size = static_cast<uint32_t>(length);
+        key.push_back(tag);
+        AppendRaw(key, &size, sizeof(size));
+        AppendRaw(key, data, length);
+    }
+
+    /* Structural encoding of a JS value, false for anything whose identity
+       matters (functions, wrapped objects, class instances) or that is too big */
+    bool AppendKey(Napi::Value value, std::string &key, size_t maxBytes, const Napi::Object &objectPrototype, int depth)
+    {
+        if (key.size() > maxBytes || depth > 32)
+            return false;
+
+        switch (value.Type()) {
+        case napi_undefined:
+            key.push_back('u');
+            return true;
+        case napi_null:
+            key.push_back('n');
+            return true;
+        case napi_boolean:
+            key.push_back(value.As<Napi::Boolean>().Value() ? 'T' : 'F');
+            return true;
+        case napi_number: {
+            double number = value.As<Napi::Number>().DoubleValue();
+            key.push_back('d');
+            AppendRaw(key, &number, sizeof(number));
+            return true;
+        }
+        case napi_string: {
+            std::string str = value.As<Napi::String>().Utf8Value();
+            AppendSized(key, 's', str.data(), str.size());
+            return true;
+        }
+        case napi_bigint: {
+            std::string str = value.ToString().Utf8Value();
+            AppendSized(key, 'i', str.data(), str.size());
+            return true;
+        }
+        case napi_object:
+            break;
+        default:
+            return false;
+        }
+
+        if (value.IsTypedArray()) {
+            Napi::TypedArray array = value.As<Napi::TypedArray>();
+            Napi::ArrayBuffer buffer = array.ArrayBuffer();
+            key.push_back(static_cast<char>(array.TypedArrayType()));
+            AppendSized(key, 't', static_cast<uint8_t *>(buffer.Data()) + array.ByteOffset(), array.ByteLength());
+            return key.size() <= maxBytes;
+        }
+        if (value.IsArrayBuffer()) {
+            Napi::ArrayBuffer buffer = value.As<Napi::ArrayBuffer>();
+            AppendSized(key, 'b', buffer.Data(), buffer.ByteLength());
+            return key.size() <= maxBytes;
+        }
+        if (value.IsArray()) {
+            Napi::Array array = value.As<Napi::Array>();
+            uint32_t length = array.Length();
+            key.push_back('a');
+            AppendRaw(key, &length, sizeof(length));
+            for (uint32_t i = 0; i < length; i++) {
+                if (!AppendKey(array.Get(i), key, maxBytes, objectPrototype, depth + 1))
+                    return false;
+            }
+            return true;
+        }
+
+        Napi::Object obj = value.As<Napi::Object>();
+        napi_value prototype;
+        napi_get_prototype(value.Env(), obj, &prototype);
+        if (!objectPrototype.StrictEquals(Napi::Value(value.Env(), prototype)))
+            return false;
+
+        /* Same keys in a different order convert to equal dicts */
+        Napi::Array names = obj.GetPropertyNames();
+        std::vector<std::string> keys;
+        keys.reserve(names.Length());
+        for (uint32_t i = 0; i < names.Length(); i++)
+            keys.push_back(names.Get(i).ToString().Utf8Value());
+        std::sort(keys.begin(), keys.end());
+
+        uint32_t count = static_cast<uint32_t>(keys.size());
+        key.push_back('o');
+        AppendRaw(key, &count, sizeof(count));
+        for (auto &name : keys) {
+            AppendSized(key, 'k', name.data(), name.size());
+            if (!AppendKey(obj.Get(name), key, maxBytes, objectPrototype, depth + 1))
+                return false;
+        }
+        return true;
+    }
+}
+
+PyNodeMemoState::Entry* PyNodeMemoState::Find(const std::string& key)
+{
+    auto it = index.find(key);
+    if (it == index.end())
+        return nullptr;
+    auto entry = it->second;
+    if (entry->ready && entry->expires && entry->expires <= NowMs()) {
+        index.erase(it);
+        entries.erase(entry);
+        return nullptr;
+    }
+    entries.splice(entries.begin(), entries, entry);
+    return &*entry;
+}
+
+PyNodeMemoState::Entry& PyNodeMemoState::Insert(const std::string& key)
+{
+    auto it = index.find(key);
+    if (it != index.end()) {
+        entries.erase(it->second);
+        index.erase(it);
+    }
+    entries.emplace_front();
+    Entry& entry = entries.front();
+    entry.key = key;
+    entry.id = nextId++;
+    index.emplace(key, entries.begin());
+
+    while (entries.size() > std::max<size_t>(maxEntries, 1)) {
+        index.erase(entries.back().key);
+        entries.pop_back();
+        evictions++;
+    }
+    return entry;
+}
+
+void PyNodeMemoState::Fulfill(const std::string& key, uint64_t id, PyObject* value)
+{
+    auto it = index.find(key);
+    if (it == index.end() || it->second->id != id)
+        return;
+    Entry& entry = *it->second;
+    entry.value = ShareResult(value);
+    entry.ready = true;
+    entry.expires = ttlMs > 0 ? NowMs() + ttlMs : 0;
+}
+
+std::shared_ptr<PyObject> PyNodeMemoState::Result(const std::string& key, uint64_t id)
+{
+    auto it = index.find(key);
+    if (it == index.end() || it->second->id != id || !it->second->ready)
+        return nullptr;
+    return it->second->value;
+}
+
+void PyNodeMemoState::Forget(const std::string& key, uint64_t id)
+{
+    auto it = index.find(key);
+    if (it == index.end() || it->second->id != id)
+        return;
+    entries.erase(it->second);
+    index.erase(it);
+}
+
+void PyNodeMemoState::Clear()
+{
+    index.clear();
+    entries.clear();
+}
+
+Napi::Object PyNodeMemoized::Init(Napi::Env env, Napi::Object exports) {
+    Napi::Function func = DefineClass(env, "PyNodeMemoized", {
+        InstanceMethod("__call__", &PyNodeMemoized::Call),
+        InstanceMethod("__callasync__", &PyNodeMemoized::CallAsync),
+        InstanceMethod("__callasync_promise__", &PyNodeMemoized::CallAsyncPromise),
+        InstanceMethod("stats", &PyNodeMemoized::Stats),
+        InstanceMethod("clear", &PyNodeMemoized::Clear),
+    });
+
+    auto instData = env.GetInstanceData<PyNodeEnvData>();
+    instData->PyNodeMemoizedConstructor = Napi::Persistent(func);
+    return exports;
+}
+
+PyNodeMemoized::PyNodeMemoized(const Napi::CallbackInfo &info) : Napi::ObjectWrap<PyNodeMemoized>(info), _state(std::make_shared<PyNodeMemoState>()) {
+    _target = Napi::Persistent(info[0].As<Napi::Object>());
+    if (info.Length() > 1 && info[1].IsObject()) {
+        Napi::Object options = info[1].As<Napi::Object>();
+        if (options.Has("maxEntries"))
+            _state->maxEntries = static_cast<size_t>(std::max<int64_t>(1, options.Get("maxEntries").ToNumber().Int64Value()));
+        if (options.Has("ttlMs"))
+            _state->ttlMs = options.Get("ttlMs").ToNumber().DoubleValue();
+        if (options.Has("maxKeyBytes"))
+            _state->maxKeyBytes = static_cast<size_t>(std::max<int64_t>(0, options.Get("maxKeyBytes").ToNumber().Int64Value()));
+    }
+}
+
+bool PyNodeMemoized::BuildKey(const Napi::CallbackInfo &info, size_t argc, std::string &key) {
+    Napi::Object objectPrototype = GetObjectPrototype(info.Env());
+    for (size_t i = 0; i < argc; i++) {
+        if (!AppendKey(info[i], key, _state->maxKeyBytes, objectPrototype, 0)) {
+            _state->uncacheable++;
+            return false;
+        }
+    }
+    return true;
+}
+
+PyObject* PyNodeMemoized::Target() {
+    return Napi::ObjectWrap<PyNodeWrappedPythonObject>::Unwrap(_target.Value())->getValue();
+}
+
+Napi::Value PyNodeMemoized::Call(const Napi::CallbackInfo &info) {
+    trace_span span("PyNodeMemoized::Call", "pynode");
+    Napi::Env env = info.Env();
+    std::string key;
+    bool cacheable = BuildKey(info, info.Length(), key);
+    py_ensure_gil ctx;
+    if (cacheable) {
+        PyNodeMemoState::Entry* entry = _state->Find(key);
+        if (entry && entry->ready) {
+            _state->hits++;
+            return ConvertFromPython(env, entry->value.get());
+        }
+        _state->misses++;
+        /* Leave a pending async call alone, its callers are still waiting on it */
+        if (entry)
+            cacheable = false;
+    }
+
+    PyObject *target = Target();
+    py_object_owned pArgs = BuildPyArgs(info, 0, info.Length());
+    py_object_owned result;
+    {
+        alloc_scope allocations(target);
+        result.reset(PyObject_CallObject(target, pArgs.get()));
+    }
+    if (!result) {
+        PyNodePythonError::New(env, py_exception::Fetch()).ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    Napi::Value value = ConvertFromPython(env, result.get());
+
+    if (cacheable) {
+        PyNodeMemoState::Entry& entry = _state->Insert(key);
+        _state->Fulfill(key, entry.id, result.get());
+    }
+    return value;
+}
+
+/* A promise for the result of the first argc arguments */
+Napi::Value PyNodeMemoized::Dispatch(Napi::Env env, const Napi::CallbackInfo &info, size_t argc) {
+    std::string key;
+    bool cacheable = BuildKey(info, argc, key);
+    auto state = _state;
+    py_ensure_gil ctx;
+    if (cacheable) {
+        PyNodeMemoState::Entry* entry = _state->Find(key);
+        if (entry) {
+            _state->hits++;
+            if (entry->ready) {
+                auto deferred = Napi::Promise::Deferred::New(env);
+                deferred.Resolve(ConvertFromPython(env, entry->value.get()));
+                return deferred.Promise();
+            }
+            /* Joins the pending call, with a value of its own once it is in */
+            uint64_t id = entry->id;
+            Napi::Promise promise = entry->promise.Value();
+            Napi::Function convert = Napi::Function::New(env, [state, key, id](const Napi::CallbackInfo &info) -> Napi::Value {
+                auto result = state->Result(key, id);
+                if (!result)
+                    return info[0];
+                py_ensure_gil ctx;
+                return ConvertFromPython(info.Env(), result.get());
+            });
+            return promise.Get("then").As<Napi::Function>().Call(promise, { convert });
+        }
+        _state->misses++;
+    }
+
+    auto deferred = Napi::Promise::Deferred::New(env);
+    PyNodeWorker* pnw = new PyNodeWorker(deferred, BuildPyArgs(info, 0, argc), ConvertBorrowedObjectToOwned(Target()));
+    Napi::Promise promise = deferred.Promise();
+    if (!cacheable) {
+        pnw->Queue();
+        return promise;
+    }
+
+    /* Stored right away so concurrent calls with the same arguments join it */
+    PyNodeMemoState::Entry& entry = _state->Insert(key);
+    entry.promise = Napi::Persistent(promise);
+    uint64_t id = entry.id;
+    pnw->SetResultConverter([state, key, id](Napi::Env env, PyObject *result) {
+        Napi::Value value = ConvertFromPython(env, result);
+        state->Fulfill(key, id, result);
+        return value;
+    });
+    pnw->Queue();
+
+    Napi::Function onRejected = Napi::Function::New(env, [state, key, id](const Napi::CallbackInfo &info) {
+        state->Forget(key, id);
+        return info.Env().Undefined();
+    });
+    promise.Get("catch").As<Napi::Function>().Call(promise, { onRejected });
+    return promise;
+}
+
+Napi::Value PyNodeMemoized::CallAsyncPromise(const Napi::CallbackInfo &info) {
+    return Dispatch(info.Env(), info, info.Length());
+}
+
+Napi::Value PyNodeMemoized::CallAsync(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    if (info.Length() == 0 || !info[info.Length() - 1].IsFunction()) {
+        Napi::Error::New(env, "Last argument to 'call' must be a function").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    Napi::Value promise = Dispatch(env, info, info.Length() - 1);
+    auto callback = std::make_shared<Napi::FunctionReference>(Napi::Persistent(info[info.Length() - 1].As<Napi::Function>()));
+    Napi::Function onFulfilled = Napi::Function::New(env, [callback](const Napi::CallbackInfo &info) {
+        callback->Call({ info.Env().Null(), info[0] });
+        return info.Env().Undefined();
+    });
+    Napi::Function onRejected = Napi::Function::New(env, [callback](const Napi::CallbackInfo &info) {
+        callback->Call({ info[0] });
+        return info.Env().Undefined();
+    });
+    promise.As<Napi::Object>().Get("then").As<Napi::Function>().Call(promise, { onFulfilled, onRejected });
+    return env.Undefined();
+}
+
+Napi::Value PyNodeMemoized::Stats(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    Napi::Object stats = Napi::Object::New(env);
+    uint64_t lookups = _state->hits + _state->misses;
+    stats.Set("hits", Napi::Number::New(env, static_cast<double>(_state->hits)));
+    stats.Set("misses", Napi::Number::New(env, static_cast<double>(_state->misses)));
+    stats.Set("uncacheable", Napi::Number::New(env, static_cast<double>(_state->uncacheable)));
+    stats.Set("evictions", Napi::Number::New(env, static_cast<double>(_state->evictions)));
+    stats.Set("entries", Napi::Number::New(env, static_cast<double>(_state->Size())));
+    stats.Set("hitRate", Napi::Number::New(env, lookups ? static_cast<double>(_state->hits) / lookups : 0));
+    return stats;
+}
+
+Napi::Value PyNodeMemoized::Clear(const Napi::CallbackInfo &info) {
+    _state->Clear();
+    return info.Env().Undefined();
+}
@@ -0,0 +1,78 @@
+#ifndef PYNODE_MEMOIZE_HPP
+#define PYNODE_MEMOIZE_HPP
+
+#include <Python.h>
+#include "napi.h"
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+/* LRU/TTL cache of Python results keyed on a structural encoding of the JS
+   arguments. Every hit converts its own JS value, so callers can't change
+   what the next one gets. Only touched on the JS thread. */
+struct PyNodeMemoState
+{
+    struct Entry
+    {
+        std::string key;
+        uint64_t id;
+        bool ready = false;
+        double expires = 0;
+        /* Dropped with the GIL, wherever the entry goes */
+        std::shared_ptr<PyObject> value;
+        Napi::Reference<Napi::Promise> promise;
+    };
+
+    size_t maxEntries = 1024;
+    double ttlMs = 0;
+    size_t maxKeyBytes = 64 * 1024;
+
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t uncacheable = 0;
+    uint64_t evictions = 0;
+
+    /* Live entry for key (moved to the front), or nullptr */
+    Entry* Find(const std::string& key);
+    /* Inserts or replaces key, evicting from the back past maxEntries */
+    Entry& Insert(const std::string& key);
+    void Fulfill(const std::string& key, uint64_t id, PyObject* value);
+    /* Result of that exact entry if it is still cached and ready */
+    std::shared_ptr<PyObject> Result(const std::string& key, uint64_t id);
+    void Forget(const std::string& key, uint64_t id);
+    void Clear();
+    size_t Size() const { return entries.size(); }
+
+private:
+    uint64_t nextId = 1;
+    std::list<Entry> entries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+};
+
+/* Returned by __memoize__, fronts the calls of a PyNodeWrappedPythonObject.
+   Hits are answered from the cache without touching Python, concurrent
+   misses on the same arguments share one call. */
+class PyNodeMemoized : public Napi::ObjectWrap<PyNodeMemoized>
+{
+public:
+    static Napi::Object Init(Napi::Env env, Napi::Object exports);
+    PyNodeMemoized(const Napi::CallbackInfo &info);
+
+private:
+    Napi::Value Call(const Napi::CallbackInfo &info);
+    Napi::Value CallAsync(const Napi::CallbackInfo &info);
+    Napi::Value CallAsyncPromise(const Napi::CallbackInfo &info);
+    Napi::Value Stats(const Napi::CallbackInfo &info);
+    Napi::Value Clear(const Napi::CallbackInfo &info);
+
+    Napi::Value Dispatch(Napi::Env env, const Napi::CallbackInfo &info, size_t argc);
+    bool BuildKey(const Napi::CallbackInfo &info, size_t argc, std::string &key);
+    PyObject* Target();
+
+    Napi::ObjectReference _target;
+    std::shared_ptr<PyNodeMemoState> _state;
+};
+
+#endif
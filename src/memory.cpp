@@ -0,0 +1,267 @@
+#include "memory.hpp"
+#include "helpers.hpp"
+#include "pynode.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <uv.h>
+
+std::mutex PyNodeMemoryPressure::s_optionsMutex;
+PyNodeMemoryPressure::Options PyNodeMemoryPressure::s_options;
+std::mutex PyNodeMemoryPressure::s_notifyMutex;
+std::vector<PyNodeMemoryPressure::EnvState *> PyNodeMemoryPressure::s_notifyStates;
+bool PyNodeMemoryPressure::s_pythonHooksInstalled = false;
+std::atomic<int64_t> PyNodeMemoryPressure::s_wrapperBytes{ 0 };
+std::atomic<int64_t> PyNodeMemoryPressure::s_pythonCollections{ 0 };
+std::atomic<int64_t> PyNodeMemoryPressure::s_v8Notifications{ 0 };
+
+static double NowMs() {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+PyNodeMemoryPressure::Options PyNodeMemoryPressure::GetOptions() {
+    std::unique_lock lock{ s_optionsMutex };
+    return s_options;
+}
+
+/* Runs gc.collect(generation) on a pool thread so the JS thread never waits on the GIL */
+class PyNodeCollectWorker : public Napi::AsyncWorker {
+public:
+    PyNodeCollectWorker(Napi::Env env, PyNodeMemoryPressure::EnvState *state, int generation)
+        : Napi::AsyncWorker(env), state(state), generation(generation) {}
+
+    void Execute() override {
+        trace_span span("PyNodeCollectWorker::Execute", "gc");
+        py_thread_context ctx;
+        py_object_owned gc(PyImport_ImportModule("gc"));
+        py_object_owned collected(gc ? PyObject_CallMethod(gc.get(), "collect", "i", generation) : nullptr);
+        if (!collected)
+            PyErr_Clear();
+    }
+
+    void OnOK() override { state->collectQueued = false; }
+    void OnError(const Napi::Error &) override { state->collectQueued = false; }
+
+private:
+    PyNodeMemoryPressure::EnvState *state;
+    int generation;
+};
+
+int64_t PyNodeMemoryPressure::EstimateExternalSize(PyObject *obj) {
+    Options options = GetOptions();
+    if (!options.reportExternalMemory)
+        return 0;
+    /* Functions, classes and modules are the common wrappers, don't go poking them */
+    if (PyCallable_Check(obj) || PyModule_Check(obj))
+        return 0;
+
+    int64_t size = 0;
+    if (PyObject_CheckBuffer(obj)) {
+        Py_buffer view;
+        if (PyObject_GetBuffer(obj, &view, PyBUF_RECORDS_RO) == 0) {
+            size = view.len;
+            PyBuffer_Release(&view);
+        }
+    }
+    else {
+        /* numpy, pandas and pyarrow all know their size */
+        py_object_owned nbytes(PyObject_GetAttrString(obj, "nbytes"));
+        if (nbytes && PyLong_Check(nbytes.get()))
+            size = PyLong_AsLongLong(nbytes.get());
+    }
+    PyErr_Clear();
+    return size >= options.minReportBytes ? size : 0;
+}
+
+void PyNodeMemoryPressure::AdjustWrapperMemory(Napi::Env env, int64_t delta) {
+    /* Wrappers can be finalized during env teardown, so no env data here */
+    s_wrapperBytes += delta;
+    Napi::MemoryManagement::AdjustExternalMemory(env, delta);
+}
+
+/* There are no GC callbacks in N-API, an unreachable object with a finalizer
+   gets us told about the next V8 collection instead. */
+void PyNodeMemoryPressure::ArmSentinel(Napi::Env env) {
+    env.GetInstanceData<PyNodeEnvData>()->memory.sentinelArmed = true;
+    auto sentinel = Napi::Object::New(env);
+    sentinel.AddFinalizer([](Napi::Env env, void *) { OnV8Collection(env); }, static_cast<void *>(nullptr));
+}
+
+void PyNodeMemoryPressure::OnV8Collection(Napi::Env env) {
+    auto instData = env.GetInstanceData<PyNodeEnvData>();
+    if (!instData || instData->memory.shuttingDown)
+        return;
+    auto &state = instData->memory;
+    state.sentinelArmed = false;
+
+    /* V8 has collected, take back any nudge from Python growth */
+    if (state.bumpedBytes) {
+        Napi::MemoryManagement::AdjustExternalMemory(env, -state.bumpedBytes);
+        state.bumpedBytes = 0;
+    }
+
+    Options options = GetOptions();
+    if (!options.collectPython)
+        return;
+    double now = NowMs();
+    if (PyNodeInterpreterReady() && now - state.lastCollect >= options.minCollectIntervalMs &&
+        !state.collectQueued.exchange(true)) {
+        state.lastCollect = now;
+        s_pythonCollections++;
+        (new PyNodeCollectWorker(env, &state, options.pythonGeneration))->Queue();
+    }
+
+    ArmSentinel(env);
+}
+
+void PyNodeMemoryPressure::OnPythonGrowth(Napi::Env env, int64_t growth) {
+    auto instData = env.GetInstanceData<PyNodeEnvData>();
+    if (!instData || instData->memory.shuttingDown)
+        return;
+    s_v8Notifications++;
+
+    /* With --expose-gc ask for a full collection, otherwise report the growth
+       as external memory until the next collection so V8 schedules one */
+    auto gc = env.Global().Get("gc");
+    if (gc.IsFunction()) {
+        gc.As<Napi::Function>().Call({});
+    }
+    else {
+        instData->memory.bumpedBytes += growth;
+        Napi::MemoryManagement::AdjustExternalMemory(env, growth);
+    }
+}
+
+/* gc.callbacks hook, runs on whichever thread triggered the Python collection */
+PyObject *PyNodeMemoryPressure::OnPythonCollection(PyObject *self, PyObject *args) {
+    static int64_t s_baselineRss = 0;
+    static double s_lastCheck = 0;
+
+    const char *phase;
+    PyObject *info;
+    if (!PyArg_ParseTuple(args, "sO", &phase, &info))
+        return NULL;
+    if (strcmp(phase, "stop") != 0)
+        Py_RETURN_NONE;
+
+    Options options = GetOptions();
+    double now = NowMs();
+    if (!options.collectPython || options.growthThresholdBytes <= 0 || now - s_lastCheck < options.minCollectIntervalMs)
+        Py_RETURN_NONE;
+    s_lastCheck = now;
+
+    size_t rss = 0;
+    if (uv_resident_set_memory(&rss) != 0)
+        Py_RETURN_NONE;
+    int64_t growth = static_cast<int64_t>(rss) - s_baselineRss;
+    if (s_baselineRss == 0 || growth < 0) {
+        s_baselineRss = static_cast<int64_t>(rss);
+        Py_RETURN_NONE;
+    }
+    if (growth < options.growthThresholdBytes)
+        Py_RETURN_NONE;
+    s_baselineRss = static_cast<int64_t>(rss);
+
+    std::unique_lock lock{ s_notifyMutex };
+    for (auto state : s_notifyStates)
+        state->growthNotify.NonBlockingCall([growth](Napi::Env env, Napi::Function) { OnPythonGrowth(env, growth); });
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef onPythonCollectionMethodDef = {
+    "__pynode_gc_callback__",
+    nullptr,
+    METH_VARARGS,
+    nullptr,
+};
+
+void PyNodeMemoryPressure::InstallPythonHooks() {
+    if (s_pythonHooksInstalled || !GetOptions().collectPython)
+        return;
+    s_pythonHooksInstalled = true;
+    onPythonCollectionMethodDef.ml_meth = OnPythonCollection;
+    py_object_owned gc(PyImport_ImportModule("gc"));
+    py_object_owned callbacks(gc ? PyObject_GetAttrString(gc.get(), "callbacks") : nullptr);
+    py_object_owned callback(PyCFunction_New(&onPythonCollectionMethodDef, nullptr));
+    if (!callbacks || !callback || PyList_Append(callbacks.get(), callback.get()) < 0)
+        PyErr_Clear();
+}
+
+static Napi::Value OptionsToObject(Napi::Env env, const PyNodeMemoryPressure::Options &options) {
+    auto result = Napi::Object::New(env);
+    result.Set("reportExternalMemory", Napi::Boolean::New(env, options.reportExternalMemory));
+    result.Set("minReportBytes", Napi::Number::New(env, static_cast<double>(options.minReportBytes)));
+    result.Set("collectPython", Napi::Boolean::New(env, options.collectPython));
+    result.Set("pythonGeneration", Napi::Number::New(env, options.pythonGeneration));
+    result.Set("minCollectIntervalMs", Napi::Number::New(env, options.minCollectIntervalMs));
+    result.Set("growthThresholdBytes", Napi::Number::New(env, static_cast<double>(options.growthThresholdBytes)));
+    return result;
+}
+
+Napi::Value PyNodeMemoryPressure::Configure(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    Options options = GetOptions();
+    if (info.Length() > 0 && info[0].IsObject()) {
+        auto obj = info[0].As<Napi::Object>();
+        if (obj.Has("reportExternalMemory"))
+            options.reportExternalMemory = obj.Get("reportExternalMemory").ToBoolean();
+        if (obj.Has("minReportBytes"))
+            options.minReportBytes = obj.Get("minReportBytes").ToNumber().Int64Value();
+        if (obj.Has("collectPython"))
+            options.collectPython = obj.Get("collectPython").ToBoolean();
+        if (obj.Has("pythonGeneration"))
+            options.pythonGeneration = obj.Get("pythonGeneration").ToNumber().Int32Value();
+        if (obj.Has("minCollectIntervalMs"))
+            options.minCollectIntervalMs = obj.Get("minCollectIntervalMs").ToNumber().DoubleValue();
+        if (obj.Has("growthThresholdBytes"))
+            options.growthThresholdBytes = obj.Get("growthThresholdBytes").ToNumber().Int64Value();
+        if (options.pythonGeneration < 0 || options.pythonGeneration > 2) {
+            Napi::RangeError::New(env, "pythonGeneration must be 0, 1 or 2").ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+        {
+            std::unique_lock lock{ s_optionsMutex };
+            s_options = options;
+        }
+        if (options.collectPython) {
+            if (!env.GetInstanceData<PyNodeEnvData>()->memory.sentinelArmed)
+                ArmSentinel(env);
+            if (PyNodeInterpreterReady()) {
+                py_ensure_gil ctx;
+                InstallPythonHooks();
+            }
+        }
+    }
+
+    auto result = OptionsToObject(env, options).As<Napi::Object>();
+    result.Set("wrapperBytes", Napi::Number::New(env, static_cast<double>(s_wrapperBytes.load())));
+    result.Set("pythonCollections", Napi::Number::New(env, static_cast<double>(s_pythonCollections.load())));
+    result.Set("v8Notifications", Napi::Number::New(env, static_cast<double>(s_v8Notifications.load())));
+    return result;
+}
+
+void PyNodeMemoryPressure::Init(Napi::Env env, Napi::Object exports) {
+    auto &state = env.GetInstanceData<PyNodeEnvData>()->memory;
+
+    state.growthNotify = Napi::ThreadSafeFunction::New(env, Napi::Function::New(env, [](const Napi::CallbackInfo &) {}),
+        "PyNodeMemoryPressure", 0, 1);
+    state.growthNotify.Unref(env);
+    {
+        std::unique_lock lock{ s_notifyMutex };
+        s_notifyStates.push_back(&state);
+    }
+
+    /* Registered after the thread safe function, so this runs before node tears it down */
+    env.AddCleanupHook([env]() {
+        if (auto instData = env.GetInstanceData<PyNodeEnvData>()) {
+            instData->memory.shuttingDown = true;
+            std::unique_lock lock{ s_notifyMutex };
+            s_notifyStates.erase(std::remove(s_notifyStates.begin(), s_notifyStates.end(), &instData->memory), s_notifyStates.end());
+        }
+    });
+
+    if (GetOptions().collectPython)
+        ArmSentinel(env);
+
+    exports.Set("configureMemoryPressure", Napi::Function::New(env, Configure));
+}
@@ -0,0 +1,68 @@
+#ifndef PYNODE_MEMORY_HPP
+#define PYNODE_MEMORY_HPP
+
+#include <Python.h>
+#include "napi.h"
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/* Keeps the two garbage collectors aware of each other, both halves are
+   opt-in through configureMemoryPressure. Wrappers of large Python objects
+   are reported to V8 as external memory (reportExternalMemory). With
+   collectPython, V8 collections are followed by a (throttled) Python gc pass
+   on a pool thread and Python collections that find the process grown past
+   a threshold nudge V8. */
+class PyNodeMemoryPressure
+{
+public:
+    struct Options
+    {
+        bool reportExternalMemory = false;
+        int64_t minReportBytes = 1 << 20;
+        bool collectPython = false;
+        int pythonGeneration = 1;
+        double minCollectIntervalMs = 1000;
+        int64_t growthThresholdBytes = int64_t(512) << 20;
+    };
+
+    /* Per env, lives in PyNodeEnvData */
+    struct EnvState
+    {
+        Napi::ThreadSafeFunction growthNotify;
+        bool shuttingDown = false;
+        bool sentinelArmed = false;
+        int64_t bumpedBytes = 0;
+        double lastCollect = 0;
+        std::atomic<bool> collectQueued{ false };
+    };
+
+    static void Init(Napi::Env env, Napi::Object exports);
+    /* Bytes worth reporting for a new wrapper of obj, 0 if it is small. Needs the GIL. */
+    static int64_t EstimateExternalSize(PyObject *obj);
+    static void AdjustWrapperMemory(Napi::Env env, int64_t delta);
+    /* Hooks gc.callbacks if collectPython is on and it isn't hooked yet. Needs the GIL. */
+    static void InstallPythonHooks();
+
+private:
+    static Napi::Value Configure(const Napi::CallbackInfo &info);
+    static void ArmSentinel(Napi::Env env);
+    static void OnV8Collection(Napi::Env env);
+    static void OnPythonGrowth(Napi::Env env, int64_t growth);
+    static PyObject *OnPythonCollection(PyObject *self, PyObject *args);
+    static Options GetOptions();
+
+    static std::mutex s_optionsMutex;
+    static Options s_options;
+    /* Envs whose growthNotify can still be called. Its own lock, since the gc
+       hook can run wherever Python collects, including under s_envDataMutex. */
+    static std::mutex s_notifyMutex;
+    static std::vector<EnvState *> s_notifyStates;
+    static bool s_pythonHooksInstalled; // guarded by the GIL
+    static std::atomic<int64_t> s_wrapperBytes;
+    static std::atomic<int64_t> s_pythonCollections;
+    static std::atomic<int64_t> s_v8Notifications;
+};
+
+#endif
@@ -0,0 +1,167 @@
+#include "proxy.hpp"
+#include "pynode.hpp"
+#include "pywrapper.hpp"
+#include "pyerror.hpp"
+#include "attrcache.hpp"
+#include "helpers.hpp"
+#include <cstring>
+#include <vector>
+
+namespace {
+    /* Read from the wrapper itself rather than from Python */
+    const char *s_wrapperMembers[] = {
+        "__call__", "__callasync__", "__callasync_promise__", "__callasync_columns__", "__callauto__", "__calljson__", "__columns__",
+        "__memoize__", "__typed__", "__getattr__", "__setattr__", "__repr__", "__pytype__",
+    };
+
+    bool IsWrapperMember(const std::string &name)
+    {
+        if (name.size() < 4 || name[0] != '_' || name[1] != '_')
+            return false;
+        for (const char *member : s_wrapperMembers) {
+            if (name == member)
+                return true;
+        }
+        return false;
+    }
+
+    Napi::Symbol Key(Napi::Env env)
+    {
+        return env.GetInstanceData<PyNodeEnvData>()->ProxyKey.Value();
+    }
+
+    Napi::Object WrapperOf(Napi::Env env, Napi::Value target)
+    {
+        return target.As<Napi::Object>().Get(Key(env)).As<Napi::Object>();
+    }
+
+    Napi::Value Bind(Napi::Value member, Napi::Object self)
+    {
+        if (!member.IsFunction())
+            return member;
+        return member.As<Napi::Object>().Get("bind").As<Napi::Function>().Call(member, { self });
+    }
+}
+
+void PyNodeProxy::Init(Napi::Env env, Napi::Object exports) {
+    auto instData = env.GetInstanceData<PyNodeEnvData>();
+    Napi::Object handler = Napi::Object::New(env);
+    handler.Set("get", Napi::Function::New(env, Get, "get"));
+    handler.Set("set", Napi::Function::New(env, Set, "set"));
+    handler.Set("has", Napi::Function::New(env, Has, "has"));
+    handler.Set("apply", Napi::Function::New(env, Apply, "apply"));
+    instData->ProxyHandler = Napi::Persistent(handler);
+    instData->ProxyConstructor = Napi::Persistent(env.Global().Get("Proxy").As<Napi::Function>());
+    instData->ProxyKey = Napi::Persistent(Napi::Symbol::New(env, "pynode.proxy"));
+}
+
+Napi::Object PyNodeProxy::Wrap(Napi::Env env, Napi::Object wrapper) {
+    auto instData = env.GetInstanceData<PyNodeEnvData>();
+    Napi::Symbol key = instData->ProxyKey.Value();
+    Napi::Value existing = wrapper.Get(key);
+    if (existing.IsFunction())
+        return existing.As<Napi::Object>();
+
+    Napi::Function target = Napi::Function::New(env, [](const Napi::CallbackInfo &info) { return info.Env().Undefined(); }, "PyNodeProxy");
+    target.DefineProperty(Napi::PropertyDescriptor::Value(key, wrapper));
+    Napi::Object proxy = instData->ProxyConstructor.New({ target, instData->ProxyHandler.Value() });
+    wrapper.DefineProperty(Napi::PropertyDescriptor::Value(key, proxy));
+    return proxy;
+}
+
+Napi::Object PyNodeProxy::Unwrap(Napi::Env env, Napi::Object obj) {
+    Napi::Value wrapper = obj.Get(Key(env));
+    if (wrapper.IsObject() && isNapiValueWrappedPython(env, wrapper.As<Napi::Object>()))
+        return wrapper.As<Napi::Object>();
+    return Napi::Object();
+}
+
+Napi::Value PyNodeProxy::FromPython(Napi::Env env, Napi::Value value) {
+    if (value.IsObject() && isNapiValueWrappedPython(env, value.As<Napi::Object>()))
+        return Wrap(env, value.As<Napi::Object>());
+    return value;
+}
+
+Napi::Value PyNodeProxy::Get(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    Napi::Object target = info[0].As<Napi::Object>();
+    if (!info[1].IsString())
+        return target.Get(info[1]);
+
+    Napi::Object wrapper = WrapperOf(env, target);
+    std::string name = info[1].As<Napi::String>();
+    if (IsWrapperMember(name))
+        return Bind(wrapper.Get(name), wrapper);
+    if (name == "__wrapped__")
+        return wrapper;
+    /* Not a thenable, so awaiting a proxy gives the proxy back */
+    if (name == "then")
+        return env.Undefined();
+    if (name == "toString")
+        return Bind(wrapper.Get("__repr__"), wrapper);
+
+    PyObject *obj = Napi::ObjectWrap<PyNodeWrappedPythonObject>::Unwrap(wrapper)->getValue();
+    Napi::Value result;
+    {
+        py_ensure_gil ctx;
+        py_object_owned attr = PyNodeAttributeCache::GetAttr(obj, name);
+        if (!attr) {
+            /* Missing attributes read as undefined, like on any JS object */
+            if (PyErr_ExceptionMatches(PyExc_AttributeError)) {
+                PyErr_Clear();
+                return env.Undefined();
+            }
+            PyNodePythonError::New(env, py_exception::Fetch()).ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+        result = ConvertFromPython(env, attr.get());
+    }
+    return FromPython(env, result);
+}
+
+Napi::Value PyNodeProxy::Set(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    Napi::Object target = info[0].As<Napi::Object>();
+    if (!info[1].IsString()) {
+        target.Set(info[1], info[2]);
+        return Napi::Boolean::New(env, true);
+    }
+
+    PyObject *obj = Napi::ObjectWrap<PyNodeWrappedPythonObject>::Unwrap(WrapperOf(env, target))->getValue();
+    std::string name = info[1].As<Napi::String>();
+    py_ensure_gil ctx;
+    py_object_owned value = ConvertToPython(info[2]);
+    py_object_owned pyName = PyNodeAttributeCache::Intern(name);
+    if (!value || !pyName || PyObject_SetAttr(obj, pyName.get(), value.get()) != 0) {
+        PyNodePythonError::New(env, py_exception::Fetch()).ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    return Napi::Boolean::New(env, true);
+}
+
+Napi::Value PyNodeProxy::Has(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    Napi::Object target = info[0].As<Napi::Object>();
+    /* Own properties of the target have to be reported to keep the Proxy invariants */
+    if (!info[1].IsString() || target.HasOwnProperty(info[1]))
+        return Napi::Boolean::New(env, target.Has(info[1]));
+
+    PyObject *obj = Napi::ObjectWrap<PyNodeWrappedPythonObject>::Unwrap(WrapperOf(env, target))->getValue();
+    std::string name = info[1].As<Napi::String>();
+    py_ensure_gil ctx;
+    py_object_owned pyName = PyNodeAttributeCache::Intern(name);
+    bool has = pyName && PyObject_HasAttr(obj, pyName.get());
+    PyErr_Clear();
+    return Napi::Boolean::New(env, has);
+}
+
+Napi::Value PyNodeProxy::Apply(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    Napi::Object wrapper = WrapperOf(env, info[0]);
+    Napi::Array args = info[2].As<Napi::Array>();
+    std::vector<napi_value> argv(args.Length());
+    for (uint32_t i = 0; i < args.Length(); i++)
+        argv[i] = args.Get(i);
+    Napi::Value result = wrapper.Get("__call__").As<Napi::Function>().Call(wrapper, argv);
+    return FromPython(env, result);
+}
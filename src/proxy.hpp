@@ -0,0 +1,29 @@
+#ifndef PYNODE_PROXY_HPP
+#define PYNODE_PROXY_HPP
+
+#include "napi.h"
+
+/* JS Proxy facade over a PyNodeWrappedPythonObject, so Python objects read
+   like JS ones: obj.model.predict(x) instead of
+   obj.__getattr__('model').__getattr__('predict').__call__(x). The target
+   is a function (so the proxy can be called) that points back at the
+   wrapper; attribute reads go through PyNodeAttributeCache and wrapped
+   results come back as proxies too. */
+class PyNodeProxy
+{
+public:
+    static void Init(Napi::Env env, Napi::Object exports);
+    /* The proxy of a wrapper, created on first use and kept on the wrapper */
+    static Napi::Object Wrap(Napi::Env env, Napi::Object wrapper);
+    /* The wrapper behind a proxy, or an empty object if obj isn't one */
+    static Napi::Object Unwrap(Napi::Env env, Napi::Object obj);
+
+private:
+    static Napi::Value Get(const Napi::CallbackInfo &info);
+    static Napi::Value Set(const Napi::CallbackInfo &info);
+    static Napi::Value Has(const Napi::CallbackInfo &info);
+    static Napi::Value Apply(const Napi::CallbackInfo &info);
+    static Napi::Value FromPython(Napi::Env env, Napi::Value value);
+};
+
+#endif
@@ -0,0 +1,114 @@
+#include "pyerror.hpp"
+#include "pynode.hpp"
+
+py_exception py_exception::Fetch() {
+    PyObject *pErrType = nullptr, *pErrValue = nullptr, *pErrTraceback = nullptr;
+    PyErr_Fetch(&pErrType, &pErrValue, &pErrTraceback);
+    PyErr_NormalizeException(&pErrType, &pErrValue, &pErrTraceback);
+    if (pErrValue && pErrTraceback) {
+        PyException_SetTraceback(pErrValue, pErrTraceback);
+    }
+    return { py_object_owned(pErrType), py_object_owned(pErrValue), py_object_owned(pErrTraceback) };
+}
+
+static std::string PyObjectToString(PyObject* obj) {
+    py_object_owned str(obj ? PyObject_Str(obj) : nullptr);
+    const char* utf8 = str ? PyUnicode_AsUTF8(str.get()) : nullptr;
+    if (!utf8) {
+        PyErr_Clear();
+        return std::string();
+    }
+    return utf8;
+}
+
+Napi::Object PyNodePythonError::Init(Napi::Env env, Napi::Object exports) {
+    Napi::Function func = DefineClass(env, "PythonError", {
+        InstanceAccessor<&PyNodePythonError::GetName>("name"),
+        InstanceAccessor<&PyNodePythonError::GetMessage>("message"),
+        InstanceAccessor<&PyNodePythonError::GetPyType>("pyType"),
+        InstanceAccessor<&PyNodePythonError::GetPyMessage>("pyMessage"),
+        InstanceAccessor<&PyNodePythonError::GetPyException>("pyException"),
+        InstanceAccessor<&PyNodePythonError::GetStack>("stack"),
+    });
+
+    /* Make instances pass `instanceof Error` */
+    auto setPrototypeOf = env.Global().Get("Object").As<Napi::Object>().Get("setPrototypeOf").As<Napi::Function>();
+    auto errorCtor = env.Global().Get("Error").As<Napi::Function>();
+    setPrototypeOf.Call({ func.Get("prototype"), errorCtor.Get("prototype") });
+    setPrototypeOf.Call({ func, errorCtor });
+
+    auto instData = env.GetInstanceData<PyNodeEnvData>();
+    instData->PyNodePythonErrorConstructor = Napi::Persistent(func);
+    exports.Set("PythonError", func);
+    return exports;
+}
+
+Napi::Error PyNodePythonError::New(Napi::Env env, py_exception&& exception) {
+    auto instData = env.GetInstanceData<PyNodeEnvData>();
+    auto exp = Napi::External<py_exception>::New(env, &exception);
+    return Napi::Error(env, instData->PyNodePythonErrorConstructor.New({ exp }));
+}
+
+PyNodePythonError::PyNodePythonError(const Napi::CallbackInfo &info) : Napi::ObjectWrap<PyNodePythonError>(info) {
+    if (info.Length() < 1 || !info[0].IsExternal()) {
+        throw Napi::TypeError::New(info.Env(), "PythonError can only be created by PyNode");
+    }
+    _exception = std::move(*info[0].As<Napi::External<py_exception>>().Data());
+    if (_exception.type) {
+        _pyType = GetPyTypeName((PyTypeObject*)_exception.type.get());
+        _pyMessage = PyObjectToString(_exception.value.get());
+        _message = PyObjectToString(_exception.type.get()) + ": " + _pyMessage;
+    }
+}
+
+PyNodePythonError::~PyNodePythonError()
+{
+    py_ensure_gil ctx;
+    _exception = py_exception();
+}
+
+Napi::Value PyNodePythonError::GetName(const Napi::CallbackInfo& info) {
+    return Napi::String::New(info.Env(), "PythonError");
+}
+
+Napi::Value PyNodePythonError::GetMessage(const Napi::CallbackInfo& info) {
+    return Napi::String::New(info.Env(), _message);
+}
+
+Napi::Value PyNodePythonError::GetPyType(const Napi::CallbackInfo& info) {
+    return Napi::String::New(info.Env(), _pyType);
+}
+
+Napi::Value PyNodePythonError::GetPyMessage(const Napi::CallbackInfo& info) {
+    return Napi::String::New(info.Env(), _pyMessage);
+}
+
+Napi::Value PyNodePythonError::GetPyException(const Napi::CallbackInfo& info) {
+    if (!_exception.value)
+        return info.Env().Null();
+    py_ensure_gil ctx;
+    return ConvertFromPython(info.Env(), _exception.value.get());
+}
+
+Napi::Value PyNodePythonError::GetStack(const Napi::CallbackInfo& info) {
+    if (!_stack) {
+        std::string stack = "PythonError: " + _message;
+        if (_exception.traceback) {
+            py_ensure_gil ctx;
+            py_object_owned tracebackModule(PyImport_ImportModule("traceback"));
+            py_object_owned lines(tracebackModule ? PyObject_CallMethod(tracebackModule.get(), "format_tb", "O", _exception.traceback.get()) : nullptr);
+            py_object_owned empty(PyUnicode_FromString(""));
+            py_object_owned joined(lines ? PyUnicode_Join(empty.get(), lines.get()) : nullptr);
+            const char* utf8 = joined ? PyUnicode_AsUTF8(joined.get()) : nullptr;
+            if (utf8) {
+                stack += "\nTraceback (most recent call last):\n";
+                stack += utf8;
+            }
+            else {
+                PyErr_Clear();
+            }
+        }
+        _stack = std::move(stack);
+    }
+    return Napi::String::New(info.Env(), *_stack);
+}
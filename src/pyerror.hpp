@@ -0,0 +1,45 @@
+#ifndef PYNODE_PYERROR_HPP
+#define PYNODE_PYERROR_HPP
+
+#include "napi.h"
+#include <Python.h>
+#include "helpers.hpp"
+#include <optional>
+#include <string>
+
+/* The pending Python exception, fetched and normalized so it can be carried
+   off the thread that raised it. Must be fetched and released with the GIL. */
+struct py_exception {
+  py_object_owned type;
+  py_object_owned value;
+  py_object_owned traceback;
+
+  static py_exception Fetch();
+  explicit operator bool() const { return type != nullptr; }
+};
+
+/* JS Error subclass thrown/rejected for Python exceptions. The traceback is
+   only formatted when .stack is first read. */
+class PyNodePythonError : public Napi::ObjectWrap<PyNodePythonError> {
+  public:
+    static Napi::Object Init(Napi::Env env, Napi::Object exports);
+    /* Wraps exception in a new PythonError, needs the GIL */
+    static Napi::Error New(Napi::Env env, py_exception&& exception);
+    PyNodePythonError(const Napi::CallbackInfo &info);
+    ~PyNodePythonError();
+    Napi::Value GetName(const Napi::CallbackInfo& info);
+    Napi::Value GetMessage(const Napi::CallbackInfo& info);
+    Napi::Value GetPyType(const Napi::CallbackInfo& info);
+    Napi::Value GetPyMessage(const Napi::CallbackInfo& info);
+    Napi::Value GetPyException(const Napi::CallbackInfo& info);
+    Napi::Value GetStack(const Napi::CallbackInfo& info);
+
+  private:
+    py_exception _exception;
+    std::string _pyType;
+    std::string _pyMessage;
+    std::string _message;
+    std::optional<std::string> _stack;
+};
+
+#endif
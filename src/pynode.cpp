@@ -6,17 +6,59 @@
 #include "worker.hpp"
 #include "pywrapper.hpp"
 #include "jswrapper.hpp"
+#include "tracing.hpp"
+#include "pyerror.hpp"
+#include "channel.hpp"
+#include "stream.hpp"
+#include "memory.hpp"
+#include "cycles.hpp"
+#include "dispatch.hpp"
+#include "shm.hpp"
+#include "allocations.hpp"
+#include "memoize.hpp"
+#include "proxy.hpp"
+#include "schema.hpp"
 #include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <optional>
+#include <vector>
 
 std::mutex PyNodeEnvData::s_envDataMutex;
 std::unordered_set<PyNodeEnvData*> PyNodeEnvData::s_envData;
 
-Napi::Value StartInterpreter(const Napi::CallbackInfo &info) {
-  Napi::Env env = info.Env();
-
-  if (Py_IsInitialized())
-      return env.Undefined();
+struct InterpreterOptions {
+  std::optional<std::string> venvPython;
+  std::optional<std::string> pycachePrefix;
+  std::vector<std::string> preload;
+};
+
+/* Accepts ([venvPython], [{ pycachePrefix, preload }]) */
+static InterpreterOptions GetInterpreterOptions(const Napi::CallbackInfo &info) {
+  InterpreterOptions options;
+  size_t optionsIndex = 0;
+  if (info.Length() > 0 && info[0].IsString()) {
+    options.venvPython = info[0].As<Napi::String>().Utf8Value();
+    optionsIndex = 1;
+  }
+  if (info.Length() > optionsIndex && info[optionsIndex].IsObject()) {
+    auto obj = info[optionsIndex].As<Napi::Object>();
+    if (obj.Has("pycachePrefix") && obj.Get("pycachePrefix").IsString()) {
+      options.pycachePrefix = obj.Get("pycachePrefix").As<Napi::String>().Utf8Value();
+    }
+    if (obj.Has("preload") && obj.Get("preload").IsArray()) {
+      auto preload = obj.Get("preload").As<Napi::Array>();
+      for (uint32_t i = 0; i < preload.Length(); i++) {
+        options.preload.push_back(preload.Get(i).ToString().Utf8Value());
+      }
+    }
+  }
+  return options;
+}
 
+/* Initializes Python on the calling thread and imports PyNode's own module.
+   Returns with the GIL held, or sets error and returns NULL. */
+static py_object_owned InitializeInterpreter(const InterpreterOptions &options, std::string &error) {
 #ifdef LINUX_SO_NAME 
   //automatically do the workaround of manually loading the python .so file on linux
   dlopen(Py_STRINGIFY(LINUX_SO_NAME), RTLD_LAZY | RTLD_GLOBAL);
@@ -24,47 +66,222 @@ Napi::Value StartInterpreter(const Napi::CallbackInfo &info) {
 
   PyImport_AppendInittab("pynode", &PyInit_jswrapper);
 
-  //Assume this is a path to venv folder
-  if (info.Length() == 1 && info[0].IsString()) {
-    std::string pathString = info[0].As<Napi::String>();
-    std::wstring path(pathString.length(), L'#');
-    mbstowcs(&path[0], pathString.c_str(), pathString.length());
-    
-    PyPreConfig preConfig;
-    PyPreConfig_InitIsolatedConfig(&preConfig);
-    Py_PreInitialize(&preConfig);
-    
+  if (options.venvPython || options.pycachePrefix) {
     PyConfig pyConfig;
-    PyConfig_InitIsolatedConfig(&pyConfig);
-    PyConfig_SetString(&pyConfig, &pyConfig.executable, path.c_str());
+    //Assume this is a path to venv folder
+    if (options.venvPython) {
+      std::string pathString = *options.venvPython;
+      std::wstring path(pathString.length(), L'#');
+      mbstowcs(&path[0], pathString.c_str(), pathString.length());
+
+      PyPreConfig preConfig;
+      PyPreConfig_InitIsolatedConfig(&preConfig);
+      Py_PreInitialize(&preConfig);
+
+      PyConfig_InitIsolatedConfig(&pyConfig);
+      PyConfig_SetString(&pyConfig, &pyConfig.executable, path.c_str());
+    }
+    else {
+      PyConfig_InitPythonConfig(&pyConfig);
+    }
 
-    Py_InitializeFromConfig(&pyConfig);
+    /* Shared bytecode cache, so fresh containers don't recompile every module */
+    if (options.pycachePrefix) {
+      PyConfig_SetBytesString(&pyConfig, &pyConfig.pycache_prefix, options.pycachePrefix->c_str());
+    }
 
+    PyStatus status = Py_InitializeFromConfig(&pyConfig);
     PyConfig_Clear(&pyConfig);
+    if (PyStatus_Exception(status)) {
+      error = std::string("Failed to initialize the Python interpreter: ") + (status.err_msg ? status.err_msg : "unknown error");
+      return nullptr;
+    }
   }
   else
   {
     Py_Initialize();
   }
 
-  auto instData = env.GetInstanceData<PyNodeEnvData>();
   /* Load PyNode's own module into Python. This makes WrappedJSObject instances
      behave better (eg, having attributes) */
   py_object_owned pName(PyUnicode_DecodeFSDefault("pynode"));
-  instData->pPyNodeModule.reset(PyImport_Import(pName.get()));
-  if (instData->pPyNodeModule == NULL) {
+  py_object_owned pPyNodeModule(PyImport_Import(pName.get()));
+  if (pPyNodeModule == NULL) {
     PyErr_Print();
-    Napi::Error::New(env, "Failed to load the pynode module into the Python interpreter")
+    error = "Failed to load the pynode module into the Python interpreter";
+  }
+
+  PyNodeTracer::InstallProfiler();
+  PyNodeMemoryPressure::InstallPythonHooks();
+  return pPyNodeModule;
+}
+
+/* Imports modules on a pool thread. Used for importAsync (resolves with the
+   last module) and, without a promise, for background preloading where
+   failures are left for the real import to report. */
+class PyNodeImportWorker : public Napi::AsyncWorker {
+public:
+  PyNodeImportWorker(Napi::Env env, std::vector<std::string>&& modules)
+    : Napi::AsyncWorker(env), modules(std::move(modules)) {}
+
+  PyNodeImportWorker(Napi::Promise::Deferred promise, std::vector<std::string>&& modules)
+    : Napi::AsyncWorker(promise.Env()), promise(promise), modules(std::move(modules)) {}
+
+  void Execute() override {
+    trace_span span("PyNodeImportWorker::Execute", "worker");
+    py_thread_context ctx;
+    for (auto& name : modules) {
+      trace_span importSpan("import", "python");
+      module.reset(PyImport_ImportModule(name.c_str()));
+      if (module == NULL) {
+        exception = py_exception::Fetch();
+        SetError("Failed to load python module " + name);
+        return;
+      }
+    }
+    if (!promise)
+      module = nullptr;
+  }
+
+  void OnOK() override {
+    if (promise) {
+      py_ensure_gil ctx;
+      promise->Resolve(ConvertFromPython(Env(), module.get()));
+      module = nullptr;
+    }
+  }
+
+  void OnError(const Napi::Error &e) override {
+    py_ensure_gil ctx;
+    if (promise)
+      promise->Reject(exception ? PyNodePythonError::New(Env(), std::move(exception)).Value() : e.Value());
+    exception = py_exception();
+    module = nullptr;
+  }
+
+private:
+  std::optional<Napi::Promise::Deferred> promise;
+  std::vector<std::string> modules;
+  py_object_owned module;
+  py_exception exception;
+};
+
+static void PreloadModules(Napi::Env env, std::vector<std::string>&& modules) {
+  if (!modules.empty())
+    (new PyNodeImportWorker(env, std::move(modules)))->Queue();
+}
+
+static std::atomic<bool> s_interpreterStarting{ false };
+
+bool PyNodeInterpreterReady() {
+  return !s_interpreterStarting && Py_IsInitialized();
+}
+
+bool PyNodeRequireInterpreter(Napi::Env env) {
+  if (PyNodeInterpreterReady())
+    return true;
+  Napi::Error::New(env, s_interpreterStarting ? "The Python interpreter is still being started by startInterpreterAsync"
+                                              : "The Python interpreter has not been started")
+      .ThrowAsJavaScriptException();
+  return false;
+}
+
+Napi::Value StartInterpreter(const Napi::CallbackInfo &info) {
+  trace_span span("startInterpreter", "pynode");
+  Napi::Env env = info.Env();
+
+  if (s_interpreterStarting) {
+    Napi::Error::New(env, "The Python interpreter is already being started by startInterpreterAsync")
         .ThrowAsJavaScriptException();
+    return env.Undefined();
   }
 
+  if (Py_IsInitialized())
+      return env.Undefined();
+
+  auto options = GetInterpreterOptions(info);
+  std::string error;
+  auto instData = env.GetInstanceData<PyNodeEnvData>();
+  instData->pPyNodeModule = InitializeInterpreter(options, error);
+
   /* Release the GIL. The other entry points back into Python re-acquire it */
-  PyEval_SaveThread();
+  if (Py_IsInitialized())
+    PyEval_SaveThread();
+
+  if (!error.empty()) {
+    Napi::Error::New(env, error).ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
 
+  PreloadModules(env, std::move(options.preload));
   return env.Undefined();
 }
 
+/* Initializes Python on a pool thread so the event loop stays responsive.
+   That thread becomes Python's main thread, so main thread only APIs such
+   as signal.signal fail when called from JS afterwards. Until the promise
+   settles every other entry point throws rather than racing the start. */
+class PyNodeStartWorker : public Napi::AsyncWorker {
+public:
+  PyNodeStartWorker(Napi::Promise::Deferred promise, InterpreterOptions&& options)
+    : Napi::AsyncWorker(promise.Env()), promise(promise), options(std::move(options)) {}
+
+  void Execute() override {
+    trace_span span("PyNodeStartWorker::Execute", "worker");
+    std::string error;
+    pPyNodeModule = InitializeInterpreter(options, error);
+    if (Py_IsInitialized())
+      PyEval_SaveThread();
+    if (!error.empty())
+      SetError(error);
+  }
+
+  void OnOK() override {
+    s_interpreterStarting = false;
+    Env().GetInstanceData<PyNodeEnvData>()->pPyNodeModule = std::move(pPyNodeModule);
+    PreloadModules(Env(), std::move(options.preload));
+    promise.Resolve(Env().Undefined());
+  }
+
+  void OnError(const Napi::Error &e) override {
+    s_interpreterStarting = false;
+    if (pPyNodeModule) {
+      py_ensure_gil ctx;
+      pPyNodeModule = nullptr;
+    }
+    promise.Reject(e.Value());
+  }
+
+private:
+  Napi::Promise::Deferred promise;
+  InterpreterOptions options;
+  py_object_owned pPyNodeModule;
+};
+
+Napi::Value StartInterpreterAsync(const Napi::CallbackInfo &info) {
+  trace_span span("startInterpreterAsync", "pynode");
+  Napi::Env env = info.Env();
+
+  if (s_interpreterStarting) {
+    Napi::Error::New(env, "The Python interpreter is already being started by startInterpreterAsync")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  auto ret = Napi::Promise::Deferred(env);
+  if (Py_IsInitialized()) {
+    ret.Resolve(env.Undefined());
+    return ret.Promise();
+  }
+
+  s_interpreterStarting = true;
+  PyNodeStartWorker* worker = new PyNodeStartWorker(ret, GetInterpreterOptions(info));
+  worker->Queue();
+  return ret.Promise();
+}
+
 Napi::Value AppendSysPath(const Napi::CallbackInfo &info) {
+  trace_span span("appendSysPath", "pynode");
   Napi::Env env = info.Env();
 
   if (!info[0] || !info[0].IsString()) {
@@ -73,6 +290,9 @@ Napi::Value AppendSysPath(const Napi::CallbackInfo &info) {
     return env.Null();
   }
 
+  if (!PyNodeRequireInterpreter(env))
+    return env.Null();
+
   std::string pathName = info[0].As<Napi::String>().ToString();
   char *appendPathStr;
   size_t len = (size_t)snprintf(NULL, 0, "import sys;sys.path.append(r\"%s\")",
@@ -91,6 +311,7 @@ Napi::Value AppendSysPath(const Napi::CallbackInfo &info) {
 }
 
 Napi::Value OpenFile(const Napi::CallbackInfo &info) {
+  trace_span span("openFile", "pynode");
   Napi::Env env = info.Env();
 
   if (!info[0] || !info[0].IsString()) {
@@ -99,6 +320,9 @@ Napi::Value OpenFile(const Napi::CallbackInfo &info) {
     return env.Undefined();
   }
 
+  if (!PyNodeRequireInterpreter(env))
+    return env.Undefined();
+
   std::string fileName = info[0].As<Napi::String>().ToString();
 
   {
@@ -121,6 +345,7 @@ Napi::Value OpenFile(const Napi::CallbackInfo &info) {
 }
 
 Napi::Value ImportModule(const Napi::CallbackInfo &info) {
+  trace_span span("import", "pynode");
   Napi::Env env = info.Env();
 
   if (!info[0] || !info[0].IsString()) {
@@ -129,6 +354,9 @@ Napi::Value ImportModule(const Napi::CallbackInfo &info) {
     return env.Undefined();
   }
 
+  if (!PyNodeRequireInterpreter(env))
+    return env.Undefined();
+
   std::string moduleName = info[0].As<Napi::String>();
 
   {
@@ -148,7 +376,58 @@ Napi::Value ImportModule(const Napi::CallbackInfo &info) {
   return env.Undefined();
 }
 
+Napi::Value ImportModuleAsync(const Napi::CallbackInfo &info) {
+  trace_span span("importAsync", "pynode");
+  Napi::Env env = info.Env();
+
+  if (!info[0] || !info[0].IsString()) {
+    Napi::Error::New(env, "Must pass a string to 'importAsync'")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  if (!PyNodeRequireInterpreter(env))
+    return env.Undefined();
+
+  auto ret = Napi::Promise::Deferred(env);
+  PyNodeImportWorker* worker = new PyNodeImportWorker(ret, { info[0].As<Napi::String>().Utf8Value() });
+  worker->Queue();
+  return ret.Promise();
+}
+
+PyObject* PyNodeCodeCache::Compile(const std::string& source, int start) {
+  std::string key = std::to_string(start) + ':' + source;
+  auto found = index.find(key);
+  if (found != index.end()) {
+    entries.splice(entries.begin(), entries, found->second);
+    return found->second->second.get();
+  }
+
+  py_object_owned code(Py_CompileString(source.c_str(), "<string>", start));
+  if (code == NULL)
+    return NULL;
+
+  entries.emplace_front(key, std::move(code));
+  index[std::move(key)] = entries.begin();
+  if (entries.size() > capacity) {
+    index.erase(entries.back().first);
+    entries.pop_back();
+  }
+  return entries.front().second.get();
+}
+
+void PyNodeCodeCache::Clear() {
+  index.clear();
+  entries.clear();
+}
+
+static PyObject* GetMainDict() {
+  PyObject* mainModule = PyImport_AddModule("__main__");
+  return mainModule ? PyModule_GetDict(mainModule) : NULL;
+}
+
 Napi::Value Eval(const Napi::CallbackInfo &info) {
+  trace_span span("eval", "pynode");
   Napi::Env env = info.Env();
 
   if (!info[0] || !info[0].IsString()) {
@@ -157,25 +436,198 @@ Napi::Value Eval(const Napi::CallbackInfo &info) {
     return env.Undefined();
   }
 
+  if (!PyNodeRequireInterpreter(env))
+    return env.Undefined();
+
   std::string statement = info[0].As<Napi::String>();
-  int response;
+  int response = -1;
   {
     py_ensure_gil ctx;
 
-    response = PyRun_SimpleString(statement.c_str());
+    /* Same semantics as PyRun_SimpleString, but repeated snippets skip parsing */
+    py_object_owned code = ConvertBorrowedObjectToOwned(env.GetInstanceData<PyNodeEnvData>()->codeCache.Compile(statement, Py_file_input));
+    PyObject* mainDict = code ? GetMainDict() : NULL;
+    py_object_owned result(mainDict ? PyEval_EvalCode(code.get(), mainDict, mainDict) : NULL);
+    if (result == NULL) {
+      PyErr_Print();
+    }
+    else {
+      response = 0;
+    }
   }
 
   return Napi::Number::New(env, response);
 }
 
+Napi::Value Compile(const Napi::CallbackInfo &info) {
+  trace_span span("compile", "pynode");
+  Napi::Env env = info.Env();
+
+  if (!info[0] || !info[0].IsString()) {
+    Napi::TypeError::New(env, "Must pass a string to 'compile'")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  if (!PyNodeRequireInterpreter(env))
+    return env.Undefined();
+
+  std::string source = info[0].As<Napi::String>();
+  std::string mode = info.Length() > 1 && info[1].IsString() ? info[1].As<Napi::String>().Utf8Value() : "exec";
+  std::string filename = info.Length() > 2 && info[2].IsString() ? info[2].As<Napi::String>().Utf8Value() : "<string>";
+
+  int start;
+  if (mode == "exec") {
+    start = Py_file_input;
+  }
+  else if (mode == "eval") {
+    start = Py_eval_input;
+  }
+  else if (mode == "single") {
+    start = Py_single_input;
+  }
+  else {
+    Napi::TypeError::New(env, "Mode passed to 'compile' must be 'exec', 'eval' or 'single'")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  py_ensure_gil ctx;
+  py_object_owned code(Py_CompileString(source.c_str(), filename.c_str(), start));
+  if (code == NULL) {
+    PyNodePythonError::New(env, py_exception::Fetch()).ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  return ConvertFromPython(env, code.get());
+}
+
+/* Globals/locals for 'evaluate': a Python dict (shared) or a JS object (copied) */
+static py_object_owned GetNamespaceArg(Napi::Env env, const Napi::CallbackInfo &info, size_t index) {
+  if (info.Length() <= index || info[index].IsUndefined() || info[index].IsNull())
+    return nullptr;
+  py_object_owned ns = ConvertToPython(info[index]);
+  if (!ns || !PyDict_Check(ns.get())) {
+    throw Napi::TypeError::New(env, "Globals and locals passed to 'evaluate' must be objects or Python dicts");
+  }
+  return ns;
+}
+
+Napi::Value Evaluate(const Napi::CallbackInfo &info) {
+  trace_span span("evaluate", "pynode");
+  Napi::Env env = info.Env();
+
+  if (!PyNodeRequireInterpreter(env))
+    return env.Undefined();
+
+  py_ensure_gil ctx;
+  py_object_owned code;
+  if (info.Length() > 0 && info[0].IsString()) {
+    std::string source = info[0].As<Napi::String>();
+    code = ConvertBorrowedObjectToOwned(env.GetInstanceData<PyNodeEnvData>()->codeCache.Compile(source, Py_eval_input));
+    if (code == NULL) {
+      PyNodePythonError::New(env, py_exception::Fetch()).ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+  }
+  else if (info.Length() > 0 && info[0].IsObject()) {
+    code = ConvertToPython(info[0]);
+  }
+
+  if (!code || !PyCode_Check(code.get())) {
+    Napi::TypeError::New(env, "Must pass a string or a code object from 'compile' to 'evaluate'")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  py_object_owned globals = GetNamespaceArg(env, info, 1);
+  py_object_owned locals = GetNamespaceArg(env, info, 2);
+  if (!globals)
+    globals = ConvertBorrowedObjectToOwned(GetMainDict());
+  if (!locals)
+    locals = ConvertBorrowedObjectToOwned(globals.get());
+
+  py_object_owned result(PyEval_EvalCode(code.get(), globals.get(), locals.get()));
+  if (result == NULL) {
+    PyNodePythonError::New(env, py_exception::Fetch()).ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  return ConvertFromPython(env, result.get());
+}
+
+Napi::Value RegisterToPython(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  if (info.Length() < 2 || !info[0].IsFunction() || !(info[1].IsFunction() || info[1].IsNull() || info[1].IsUndefined())) {
+    Napi::TypeError::New(env, "Must pass a constructor and a converter function (or null) to 'registerToPython'")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  auto prototype = info[0].As<Napi::Function>().Get("prototype");
+  if (!prototype.IsObject()) {
+    Napi::TypeError::New(env, "Constructor has no prototype").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  auto& converters = env.GetInstanceData<PyNodeEnvData>()->toPythonConverters;
+  auto it = std::find_if(converters.begin(), converters.end(), [&](const PyNodeEnvData::ToPythonConverter& c) {
+    return c.prototype.Value().StrictEquals(prototype);
+  });
+  if (info[1].IsFunction()) {
+    if (it == converters.end())
+      it = converters.insert(converters.end(), PyNodeEnvData::ToPythonConverter());
+    it->prototype = Napi::Persistent(prototype.As<Napi::Object>());
+    it->converter = Napi::Persistent(info[1].As<Napi::Function>());
+  }
+  else if (it != converters.end()) {
+    converters.erase(it);
+  }
+  return env.Undefined();
+}
+
+/* Counters for spotting leaks and runaway growth, see soak.js */
+Napi::Value GetStats(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  auto instData = env.GetInstanceData<PyNodeEnvData>();
+  Napi::Object stats = Napi::Object::New(env);
+  {
+    std::unique_lock lock{ PyNodeEnvData::s_envDataMutex };
+    stats.Set("envs", Napi::Number::New(env, static_cast<double>(PyNodeEnvData::s_envData.size())));
+  }
+  if (!PyNodeInterpreterReady()) {
+    return stats;
+  }
+
+  /* The mappings are updated by weakref callbacks and wrapper finalizers. Same
+     order as they lock: the GIL, then s_envDataMutex, let go before Python runs. */
+  py_ensure_gil ctx;
+  {
+    std::unique_lock lock{ PyNodeEnvData::s_envDataMutex };
+    stats.Set("objectMappings", Napi::Number::New(env, static_cast<double>(instData->objectMappings.size())));
+    stats.Set("weakRefs", Napi::Number::New(env, static_cast<double>(instData->weakRefToSlot.size())));
+  }
+  py_object_owned sys(PyImport_ImportModule("sys"));
+  py_object_owned blocks(sys ? PyObject_CallMethod(sys.get(), "getallocatedblocks", NULL) : NULL);
+  if (blocks)
+    stats.Set("pyAllocatedBlocks", Napi::Number::New(env, PyLong_AsDouble(blocks.get())));
+  /* Only debug builds of Python count references */
+  py_object_owned refTotal(sys && PyObject_HasAttrString(sys.get(), "gettotalrefcount") ? PyObject_CallMethod(sys.get(), "gettotalrefcount", NULL) : NULL);
+  if (refTotal)
+    stats.Set("pyTotalRefcount", Napi::Number::New(env, PyLong_AsDouble(refTotal.get())));
+  PyErr_Clear();
+  return stats;
+}
 
 Napi::Object PyNodeInit(Napi::Env env, Napi::Object exports) {
 
   env.SetInstanceData(new PyNodeEnvData());
+  PyNodeJSDispatcher::Init(env);
   
   exports.Set(Napi::String::New(env, "startInterpreter"),
               Napi::Function::New(env, StartInterpreter));
 
+  exports.Set(Napi::String::New(env, "startInterpreterAsync"),
+              Napi::Function::New(env, StartInterpreterAsync));
+
   exports.Set(Napi::String::New(env, "appendSysPath"),
               Napi::Function::New(env, AppendSysPath));
 
@@ -185,9 +637,38 @@ Napi::Object PyNodeInit(Napi::Env env, Napi::Object exports) {
   exports.Set(Napi::String::New(env, "import"),
               Napi::Function::New(env, ImportModule));
 
+  exports.Set(Napi::String::New(env, "importAsync"),
+              Napi::Function::New(env, ImportModuleAsync));
+
   exports.Set(Napi::String::New(env, "eval"), Napi::Function::New(env, Eval));
 
+  exports.Set(Napi::String::New(env, "compile"),
+              Napi::Function::New(env, Compile));
+
+  exports.Set(Napi::String::New(env, "evaluate"),
+              Napi::Function::New(env, Evaluate));
+
+  exports.Set(Napi::String::New(env, "registerToPython"),
+              Napi::Function::New(env, RegisterToPython));
+
+  exports.Set(Napi::String::New(env, "getStats"),
+              Napi::Function::New(env, GetStats));
+
   PyNodeWrappedPythonObject::Init(env, exports);
+  PyNodePythonError::Init(env, exports);
+  PyNodeChannel::Init(env, exports);
+  PyNodeStream::Init(env, exports);
+  PyNodeTracer::Init(env, exports);
+  PyNodeMemoryPressure::Init(env, exports);
+  PyNodeCycleCollector::Init(env, exports);
+  PyNodeSharedMemory::Init(env, exports);
+  PyNodeAllocations::Init(env, exports);
+  PyNodeMemoized::Init(env, exports);
+  PyNodeProxy::Init(env, exports);
+  PyNodeAutoDispatch::Init(env, exports);
+  PyNodeSchema::Init(env, exports);
+  PyNodeTyped::Init(env, exports);
+  PyNodeConversion::Init(env, exports);
 
   return exports;
 }
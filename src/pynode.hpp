@@ -4,15 +4,62 @@
 #include "napi.h"
 #include <Python.h>
 #include "helpers.hpp"
+#include "memory.hpp"
+#include "autodispatch.hpp"
+#include "conversion.hpp"
 #include <unordered_map>
 #include <map>
 #include <unordered_set>
+#include <list>
+#include <vector>
+#include <string>
+
+/* LRU of compiled code objects keyed on source text and compile mode. Only
+   touched with the GIL held. */
+class PyNodeCodeCache
+{
+public:
+    explicit PyNodeCodeCache(size_t capacity = 256) : capacity(capacity) {}
+
+    /* Returns a borrowed code object, or NULL with a Python error set */
+    PyObject* Compile(const std::string& source, int start);
+    void Clear();
+
+private:
+    size_t capacity;
+    std::list<std::pair<std::string, py_object_owned>> entries;
+    std::unordered_map<std::string, std::list<std::pair<std::string, py_object_owned>>::iterator> index;
+};
 
 struct PyNodeEnvData
 {
     py_object_owned pPyNodeModule;
+    PyNodeCodeCache codeCache;
+    PyNodeMemoryPressure::EnvState memory;
+    PyNodeAutoDispatch::EnvState autoDispatch;
+    PyNodeConversion::EnvState conversion;
 
     Napi::FunctionReference PyNodeWrappedPythonObjectConstructor;
+    Napi::FunctionReference PyNodePythonErrorConstructor;
+    Napi::FunctionReference PyNodeChannelConstructor;
+    Napi::FunctionReference PyNodeStreamConstructor;
+    Napi::FunctionReference PyNodeMemoizedConstructor;
+    Napi::FunctionReference PyNodeSchemaConstructor;
+    Napi::FunctionReference PyNodeTypedConstructor;
+    Napi::ObjectReference ObjectPrototype;
+
+    // __proxy__ facade, see proxy.hpp
+    Napi::FunctionReference ProxyConstructor;
+    Napi::ObjectReference ProxyHandler;
+    Napi::Reference<Napi::Symbol> ProxyKey;
+
+    // registerToPython, matched on the exact prototype of an object
+    struct ToPythonConverter
+    {
+        Napi::ObjectReference prototype;
+        Napi::FunctionReference converter;
+    };
+    std::vector<ToPythonConverter> toPythonConverters;
     
     struct WeakRef
     {
@@ -20,6 +67,9 @@ struct PyNodeEnvData
         Napi::ObjectReference existingJSObject;
     };
 
+    // WrappedJSObjects the last collectCycles made weak, see cycles.hpp
+    std::vector<py_object_owned> weakJSObjects;
+
     std::map<PyObject*, WeakRef> objectMappings;
     std::unordered_map<PyObject*, std::map<PyObject*, WeakRef>::iterator> weakRefToSlot;
 
@@ -34,6 +84,10 @@ struct PyNodeEnvData
         py_ensure_gil gil;
         weakRefToSlot.clear();
         objectMappings.clear();
+        codeCache.Clear();
+        weakJSObjects.clear();
+        autoDispatch.pending.clear();
+        autoDispatch.profiles.clear();
         pPyNodeModule.reset();
     }
 
@@ -41,6 +95,12 @@ struct PyNodeEnvData
     static std::unordered_set<PyNodeEnvData*> s_envData;
 };
 
+/* Python is up and startInterpreterAsync isn't still running. Only
+   meaningful on a JS thread. */
+bool PyNodeInterpreterReady();
+/* Same, but throws a JS error when it isn't */
+bool PyNodeRequireInterpreter(Napi::Env env);
+
 Napi::Object PyNodeInit(Napi::Env env, Napi::Object exports);
 
 #endif
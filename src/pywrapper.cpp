@@ -1,9 +1,30 @@
 #include "pywrapper.hpp"
 #include "pynode.hpp"
 #include "worker.hpp"
+#include "pyerror.hpp"
+#include "columnar.hpp"
+#include "memory.hpp"
+#include "allocations.hpp"
+#include "attrcache.hpp"
+#include "proxy.hpp"
+#include "autodispatch.hpp"
+#include "json.hpp"
+#include "cycles.hpp"
 #include <napi.h>
 #include <iostream>
 
+namespace {
+    /* Request text (or the JS buffer it lives in) and response bytes of a
+       __calljson__, shared by the main and the worker thread */
+    struct JsonCall
+    {
+        std::string text;
+        const char* data = nullptr;
+        size_t length = 0;
+        Napi::Reference<Napi::Value> source;
+        std::string output;
+    };
+}
 
 Napi::Object PyNodeWrappedPythonObject::Init(Napi::Env env, Napi::Object exports) {
     // This method is used to hook the accessor and method callbacks
@@ -11,6 +32,13 @@ Napi::Object PyNodeWrappedPythonObject::Init(Napi::Env env, Napi::Object exports
         InstanceMethod("__call__", &PyNodeWrappedPythonObject::Call),
         InstanceMethod("__callasync__", &PyNodeWrappedPythonObject::CallAsync),
         InstanceMethod("__callasync_promise__", &PyNodeWrappedPythonObject::CallAsyncPromise),
+        InstanceMethod("__callasync_columns__", &PyNodeWrappedPythonObject::CallAsyncColumns),
+        InstanceMethod("__callauto__", &PyNodeWrappedPythonObject::CallAuto),
+        InstanceMethod("__calljson__", &PyNodeWrappedPythonObject::CallJson),
+        InstanceMethod("__columns__", &PyNodeWrappedPythonObject::Columns),
+        InstanceMethod("__memoize__", &PyNodeWrappedPythonObject::Memoize),
+        InstanceMethod("__typed__", &PyNodeWrappedPythonObject::Typed),
+        InstanceMethod("__proxy__", &PyNodeWrappedPythonObject::Proxy),
         InstanceMethod("__getattr__", &PyNodeWrappedPythonObject::GetAttr),
         InstanceMethod("__setattr__", &PyNodeWrappedPythonObject::SetAttr),
         InstanceMethod("__repr__", &PyNodeWrappedPythonObject::Repr),
@@ -25,19 +53,34 @@ Napi::Object PyNodeWrappedPythonObject::Init(Napi::Env env, Napi::Object exports
 
 PyNodeWrappedPythonObject::PyNodeWrappedPythonObject(const Napi::CallbackInfo &info) : Napi::ObjectWrap<PyNodeWrappedPythonObject>(info) {
     _value = ConvertBorrowedObjectToOwned(info[0].As<Napi::External<PyObject>>().Data());
+    /* Let V8 know how much a small wrapper really keeps alive. WrapPythonObject
+       measures it up front, outside the lock on the object mappings. */
+    _externalMemory = info.Length() > 1 && info[1].IsNumber() ? info[1].As<Napi::Number>().Int64Value()
+                                                              : PyNodeMemoryPressure::EstimateExternalSize(_value.get());
+    if (_externalMemory)
+        PyNodeMemoryPressure::AdjustWrapperMemory(info.Env(), _externalMemory);
 }
 
 PyNodeWrappedPythonObject::~PyNodeWrappedPythonObject()
 {
+    if (_externalMemory)
+        PyNodeMemoryPressure::AdjustWrapperMemory(Env(), -_externalMemory);
     py_ensure_gil ctx;
     _value = nullptr;
 }
 
+void PyNodeWrappedPythonObject::LeaveCycle()
+{
+    _cycleRoot = false;
+    PyNodeCycleCollector::Restore(Env());
+}
+
 Napi::Value PyNodeWrappedPythonObject::GetAttr(const Napi::CallbackInfo &info){
+    trace_span span("PyNodeWrappedPythonObject::GetAttr", "pynode");
     py_ensure_gil ctx;
     Napi::Env env = info.Env();
     std::string attrname = info[0].As<Napi::String>();
-    py_object_owned attr(PyObject_GetAttrString(_value.get(), attrname.c_str()));
+    py_object_owned attr = PyNodeAttributeCache::GetAttr(getValue(), attrname);
     if (attr == NULL) {
         std::string error("Attribute " + attrname + " not found.");
         Napi::Error::New(env, error).ThrowAsJavaScriptException();
@@ -47,6 +90,7 @@ Napi::Value PyNodeWrappedPythonObject::GetAttr(const Napi::CallbackInfo &info){
 }
 
 Napi::Value PyNodeWrappedPythonObject::SetAttr(const Napi::CallbackInfo &info){
+    trace_span span("PyNodeWrappedPythonObject::SetAttr", "pynode");
     py_ensure_gil ctx;
     Napi::Env env = info.Env();
     if (info.Length() != 2) {
@@ -56,7 +100,7 @@ Napi::Value PyNodeWrappedPythonObject::SetAttr(const Napi::CallbackInfo &info){
     }
     py_object_owned pValue = ConvertToPython(info[1]);
     std::string attrname = info[0].ToString();
-    if (PyObject_SetAttrString(_value.get(), attrname.c_str(), pValue.get()) != 0) {
+    if (PyObject_SetAttrString(getValue(), attrname.c_str(), pValue.get()) != 0) {
         std::string error("Attribute " + attrname + " not found.");
         Napi::Error::New(env, error).ThrowAsJavaScriptException();
         return env.Undefined();
@@ -65,31 +109,33 @@ Napi::Value PyNodeWrappedPythonObject::SetAttr(const Napi::CallbackInfo &info){
 }
 
 Napi::Value PyNodeWrappedPythonObject::Call(const Napi::CallbackInfo &info){
+    trace_span span("PyNodeWrappedPythonObject::Call", "pynode");
     py_ensure_gil ctx;
     Napi::Env env = info.Env();
-    int callable = PyCallable_Check(_value.get());
+    int callable = PyCallable_Check(getValue());
     if (! callable) {
         std::string error("This Python object is not callable.");
         Napi::Error::New(env, error).ThrowAsJavaScriptException();
         return env.Undefined();
     }
     py_object_owned pArgs = BuildPyArgs(info, 0, info.Length());
-    py_object_owned pReturnValue(PyObject_CallObject(_value.get(), pArgs.get()));
-    PyObject *error_occurred = PyErr_Occurred();
-    if (error_occurred != NULL) {
-        // TODO - get the traceback string into Javascript
-        std::string error("A Python error occurred.");
-        PyErr_Print();
-        Napi::Error::New(env, error).ThrowAsJavaScriptException();
+    py_object_owned pReturnValue;
+    {
+        alloc_scope allocations(getValue());
+        pReturnValue.reset(PyObject_CallObject(getValue(), pArgs.get()));
+    }
+    if (pReturnValue == NULL) {
+        PyNodePythonError::New(env, py_exception::Fetch()).ThrowAsJavaScriptException();
         return env.Undefined();
     }
     return ConvertFromPython(env, pReturnValue.get());
 }
 
 Napi::Value PyNodeWrappedPythonObject::CallAsync(const Napi::CallbackInfo& info) {
+    trace_span span("PyNodeWrappedPythonObject::CallAsync", "pynode");
     py_ensure_gil ctx;
     Napi::Env env = info.Env();
-    int callable = PyCallable_Check(_value.get());
+    int callable = PyCallable_Check(getValue());
     if (!callable) {
         std::string error("This Python object is not callable.");
         Napi::Error::New(env, error).ThrowAsJavaScriptException();
@@ -106,15 +152,108 @@ Napi::Value PyNodeWrappedPythonObject::CallAsync(const Napi::CallbackInfo& info)
     auto pArgs = BuildPyArgs(info, 0, info.Length() - 1);
 
     Napi::Function cb = info[info.Length() - 1].As<Napi::Function>();
-    PyNodeWorker* pnw = new PyNodeWorker(cb, std::move(pArgs),  ConvertBorrowedObjectToOwned(_value.get()));
+    PyNodeWorker* pnw = new PyNodeWorker(cb, std::move(pArgs),  ConvertBorrowedObjectToOwned(getValue()));
     pnw->Queue();
     return env.Undefined();
 }
 
 Napi::Value PyNodeWrappedPythonObject::CallAsyncPromise(const Napi::CallbackInfo& info) {
+    trace_span span("PyNodeWrappedPythonObject::CallAsyncPromise", "pynode");
+    return QueueCallPromise(info, nullptr);
+}
+
+Napi::Value PyNodeWrappedPythonObject::CallAsyncColumns(const Napi::CallbackInfo& info) {
+    trace_span span("PyNodeWrappedPythonObject::CallAsyncColumns", "pynode");
+    return QueueCallPromise(info, ConvertFromPythonColumnar);
+}
+
+Napi::Value PyNodeWrappedPythonObject::CallAuto(const Napi::CallbackInfo& info) {
+    trace_span span("PyNodeWrappedPythonObject::CallAuto", "pynode");
     py_ensure_gil ctx;
     Napi::Env env = info.Env();
-    int callable = PyCallable_Check(_value.get());
+    if (!PyCallable_Check(getValue())) {
+        Napi::Error::New(env, "This Python object is not callable.").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    auto pArgs = BuildPyArgs(info, 0, info.Length());
+    auto profile = PyNodeAutoDispatch::ProfileFor(env, getValue());
+    if (!profile) {
+        if (!_profile)
+            _profile = std::make_shared<PyNodeCallProfile>();
+        profile = _profile;
+    }
+    return PyNodeAutoDispatch::Call(env, getValue(), std::move(pArgs), profile);
+}
+
+Napi::Value PyNodeWrappedPythonObject::CallJson(const Napi::CallbackInfo& info) {
+    trace_span span("PyNodeWrappedPythonObject::CallJson", "pynode");
+    Napi::Env env = info.Env();
+    auto call = std::make_shared<JsonCall>();
+    Napi::Value body = info.Length() > 0 ? info[0] : env.Undefined();
+    if (body.IsString()) {
+        call->text = body.As<Napi::String>().Utf8Value();
+        call->data = call->text.data();
+        call->length = call->text.size();
+    }
+    else if (body.IsTypedArray()) {
+        /* Read in place on the worker, so the buffer must not change until the call settles */
+        Napi::TypedArray array = body.As<Napi::TypedArray>();
+        call->data = static_cast<const char*>(array.ArrayBuffer().Data()) + array.ByteOffset();
+        call->length = array.ByteLength();
+        call->source = Napi::Persistent(body);
+    }
+    else if (body.IsArrayBuffer()) {
+        Napi::ArrayBuffer buffer = body.As<Napi::ArrayBuffer>();
+        call->data = static_cast<const char*>(buffer.Data());
+        call->length = buffer.ByteLength();
+        call->source = Napi::Persistent(body);
+    }
+    else {
+        Napi::TypeError::New(env, "__calljson__ takes a JSON string, Buffer or ArrayBuffer").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    py_ensure_gil ctx;
+    if (!PyCallable_Check(getValue())) {
+        Napi::Error::New(env, "This Python object is not callable.").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    auto pArgs = BuildPyArgs(info, 1, info.Length() - 1);
+
+    auto ret = Napi::Promise::Deferred(env);
+    PyNodeWorker* pnw = new PyNodeWorker(ret, std::move(pArgs), ConvertBorrowedObjectToOwned(getValue()));
+    pnw->SetArgsBuilder([call](PyObject* args) -> py_object_owned {
+        py_object_owned parsed = PyNodeJson::Parse(call->data, call->length);
+        if (!parsed)
+            return nullptr;
+        Py_ssize_t count = PyTuple_GET_SIZE(args);
+        py_object_owned withBody(PyTuple_New(count + 1));
+        if (!withBody)
+            return nullptr;
+        PyTuple_SET_ITEM(withBody.get(), 0, parsed.release());
+        for (Py_ssize_t i = 0; i < count; i++)
+            PyTuple_SET_ITEM(withBody.get(), i + 1, Py_NewRef(PyTuple_GET_ITEM(args, i)));
+        return withBody;
+    });
+    pnw->SetResultEncoder([call](PyObject* result) {
+        return PyNodeJson::Serialize(result, call->output);
+    });
+    pnw->SetResultConverter([call](Napi::Env env, PyObject*) -> Napi::Value {
+        /* The Buffer takes the bytes over, nothing is copied on the main thread */
+        auto output = new std::string(std::move(call->output));
+        return Napi::Buffer<char>::New(env, output->data(), output->size(), [](Napi::Env, char*, std::string* bytes) {
+            delete bytes;
+        }, output);
+    });
+    pnw->Queue();
+    return ret.Promise();
+}
+
+Napi::Value PyNodeWrappedPythonObject::QueueCallPromise(const Napi::CallbackInfo& info, std::function<Napi::Value(Napi::Env, PyObject*)> converter) {
+    py_ensure_gil ctx;
+    Napi::Env env = info.Env();
+    int callable = PyCallable_Check(getValue());
     if (!callable) {
         std::string error("This Python object is not callable.");
         Napi::Error::New(env, error).ThrowAsJavaScriptException();
@@ -124,16 +263,55 @@ Napi::Value PyNodeWrappedPythonObject::CallAsyncPromise(const Napi::CallbackInfo
     auto pArgs = BuildPyArgs(info, 0, info.Length());
 
     auto ret = Napi::Promise::Deferred(env);
-    PyNodeWorker* pnw = new PyNodeWorker(ret, std::move(pArgs), ConvertBorrowedObjectToOwned(_value.get()));
+    PyNodeWorker* pnw = new PyNodeWorker(ret, std::move(pArgs), ConvertBorrowedObjectToOwned(getValue()));
+    pnw->SetResultConverter(std::move(converter));
     pnw->Queue();
     return ret.Promise();
 }
 
+Napi::Value PyNodeWrappedPythonObject::Columns(const Napi::CallbackInfo& info) {
+    trace_span span("PyNodeWrappedPythonObject::Columns", "conversion");
+    py_ensure_gil ctx;
+    return ConvertFromPythonColumnar(info.Env(), getValue());
+}
+
+Napi::Value PyNodeWrappedPythonObject::Memoize(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    {
+        py_ensure_gil ctx;
+        if (!PyCallable_Check(getValue())) {
+            Napi::Error::New(env, "This Python object is not callable.").ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+    }
+    Napi::Value options = info.Length() > 0 ? info[0] : env.Undefined();
+    return env.GetInstanceData<PyNodeEnvData>()->PyNodeMemoizedConstructor.New({ info.This(), options });
+}
+
+Napi::Value PyNodeWrappedPythonObject::Typed(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    {
+        py_ensure_gil ctx;
+        if (!PyCallable_Check(getValue())) {
+            Napi::Error::New(env, "This Python object is not callable.").ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+    }
+    Napi::Value args = info.Length() > 0 ? info[0] : env.Undefined();
+    Napi::Value result = info.Length() > 1 ? info[1] : env.Undefined();
+    return env.GetInstanceData<PyNodeEnvData>()->PyNodeTypedConstructor.New({ info.This(), args, result });
+}
+
+Napi::Value PyNodeWrappedPythonObject::Proxy(const Napi::CallbackInfo& info) {
+    return PyNodeProxy::Wrap(info.Env(), info.This().As<Napi::Object>());
+}
+
 Napi::Value PyNodeWrappedPythonObject::Repr(const Napi::CallbackInfo &info){
+    trace_span span("PyNodeWrappedPythonObject::Repr", "pynode");
     py_ensure_gil ctx;
     Napi::Env env = info.Env();
     std::string attrname = info[0].As<Napi::String>();
-    py_object_owned repr(PyObject_Repr(_value.get()));
+    py_object_owned repr(PyObject_Repr(getValue()));
     if (repr == NULL) {
         std::string error("repr() failed.");
         Napi::Error::New(env, error).ThrowAsJavaScriptException();
@@ -147,18 +325,6 @@ Napi::Value PyNodeWrappedPythonObject::Repr(const Napi::CallbackInfo &info){
 Napi::Value PyNodeWrappedPythonObject::GetPyType(const Napi::CallbackInfo& info)
 {
     Napi::Env env = info.Env();
-#if PY_VERSION_HEX >= 0x030B0000
-    py_object_owned nameStr(PyType_GetQualName(Py_TYPE(_value.get())));
-    return Napi::String::New(env, PyUnicode_AsUTF8(nameStr.get()));
-#else
-    auto type = Py_TYPE(_value.get());
-    if (type->tp_flags & Py_TPFLAGS_HEAPTYPE) {
-        PyHeapTypeObject* et = (PyHeapTypeObject*)type;
-        return Napi::String::New(env, PyUnicode_AsUTF8(et->ht_qualname));
-    }
-    else {
-        return Napi::String::New(env, type->tp_name);
-    }
-#endif
+    return Napi::String::New(env, GetPyTypeName(Py_TYPE(getValue())));
 }
 
@@ -4,6 +4,10 @@
 #include "Python.h"
 #include "helpers.hpp"
 #include "napi.h"
+#include <functional>
+#include <memory>
+
+struct PyNodeCallProfile;
 
 class PyNodeWrappedPythonObject : public Napi::ObjectWrap<PyNodeWrappedPythonObject> {
   public:
@@ -13,14 +17,32 @@ class PyNodeWrappedPythonObject : public Napi::ObjectWrap<PyNodeWrappedPythonObj
     Napi::Value Call(const Napi::CallbackInfo &info);
     Napi::Value CallAsync(const Napi::CallbackInfo& info);
     Napi::Value CallAsyncPromise(const Napi::CallbackInfo& info);
+    Napi::Value CallAsyncColumns(const Napi::CallbackInfo& info);
+    Napi::Value CallAuto(const Napi::CallbackInfo& info);
+    Napi::Value CallJson(const Napi::CallbackInfo& info);
+    Napi::Value Columns(const Napi::CallbackInfo& info);
+    Napi::Value Memoize(const Napi::CallbackInfo& info);
+    Napi::Value Typed(const Napi::CallbackInfo& info);
+    Napi::Value Proxy(const Napi::CallbackInfo& info);
     Napi::Value GetAttr(const Napi::CallbackInfo &info);
     Napi::Value SetAttr(const Napi::CallbackInfo &info);
     Napi::Value Repr(const Napi::CallbackInfo &info);
     Napi::Value GetPyType(const Napi::CallbackInfo& info);
-    PyObject * getValue() { return _value.get(); };
+    /* Everything that hands the object to Python goes through here */
+    PyObject * getValue() {
+        if (_cycleRoot)
+            LeaveCycle();
+        return _value.get();
+    };
+    void MarkCycleRoot(bool root) { _cycleRoot = root; }
 
   private:
+    Napi::Value QueueCallPromise(const Napi::CallbackInfo& info, std::function<Napi::Value(Napi::Env, PyObject*)> converter);
     py_object_owned _value;
+    void LeaveCycle();
+    int64_t _externalMemory = 0;
+    bool _cycleRoot = false; // collectCycles made references reachable from here weak
+    std::shared_ptr<PyNodeCallProfile> _profile; // for callables PyNodeAutoDispatch can't key on
 };
 
 #endif
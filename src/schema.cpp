@@ -0,0 +1,596 @@
+#include "schema.hpp"
+#include "pynode.hpp"
+#include "pywrapper.hpp"
+#include "pyerror.hpp"
+#include "worker.hpp"
+#include "allocations.hpp"
+#include <cmath>
+
+using Kind = PyNodeSchemaNode::Kind;
+
+namespace {
+    /* Thrown while converting, the path is built up on the way out so the
+       happy path never formats anything */
+    struct SchemaMismatch
+    {
+        std::string path;
+        std::string message;
+    };
+
+    const char *JSTypeName(Napi::Value value)
+    {
+        switch (value.Type()) {
+        case napi_undefined: return "undefined";
+        case napi_null: return "null";
+        case napi_boolean: return "boolean";
+        case napi_number: return "number";
+        case napi_string: return "string";
+        case napi_symbol: return "symbol";
+        case napi_function: return "function";
+        case napi_bigint: return "bigint";
+        case napi_object: return value.IsArray() ? "array" : "object";
+        default: return "external";
+        }
+    }
+
+    [[noreturn]] void ThrowMismatch(const PyNodeSchemaNode &node, const char *got, std::string path = std::string())
+    {
+        throw SchemaMismatch{ std::move(path), "expected " + node.Describe() + ", got " + got };
+    }
+
+    [[noreturn]] void ThrowPythonError(Napi::Env env)
+    {
+        throw PyNodePythonError::New(env, py_exception::Fetch());
+    }
+
+    std::string Index(size_t i)
+    {
+        return "[" + std::to_string(i) + "]";
+    }
+
+    py_object_owned NodeToPython(const PyNodeSchemaNode &node, Napi::Value value)
+    {
+        if (node.optional && (value.IsNull() || value.IsUndefined()))
+            return ConvertBorrowedObjectToOwned(Py_None);
+        return node.toPython(node, value);
+    }
+
+    Napi::Value NodeFromPython(const PyNodeSchemaNode &node, Napi::Env env, PyObject *obj)
+    {
+        if (node.optional && obj == Py_None)
+            return env.Null();
+        return node.fromPython(node, env, obj);
+    }
+
+    /* Scalars without the probing of ConvertToPython/ConvertFromPython. NULL
+       or an empty value means the type didn't match. */
+    template <Kind K> struct Scalar;
+
+    template <> struct Scalar<Kind::Int>
+    {
+        static py_object_owned ToPython(Napi::Value value)
+        {
+            if (!value.IsNumber())
+                return nullptr;
+            double num = value.As<Napi::Number>().DoubleValue();
+            if (std::trunc(num) != num || std::fabs(num) >= 9.2e18)
+                return nullptr;
+            return py_object_owned(PyLong_FromLongLong(static_cast<long long>(num)));
+        }
+
+        static Napi::Value FromPython(Napi::Env env, PyObject *obj)
+        {
+            if (!PyLong_Check(obj) || PyBool_Check(obj))
+                return Napi::Value();
+            double num = PyLong_AsDouble(obj);
+            if (num == -1.0 && PyErr_Occurred()) {
+                PyErr_Clear();
+                return Napi::Value();
+            }
+            return Napi::Number::New(env, num);
+        }
+    };
+
+    template <> struct Scalar<Kind::Float>
+    {
+        static py_object_owned ToPython(Napi::Value value)
+        {
+            if (!value.IsNumber())
+                return nullptr;
+            return py_object_owned(PyFloat_FromDouble(value.As<Napi::Number>().DoubleValue()));
+        }
+
+        static Napi::Value FromPython(Napi::Env env, PyObject *obj)
+        {
+            if (PyFloat_Check(obj))
+                return Napi::Number::New(env, PyFloat_AS_DOUBLE(obj));
+            return Scalar<Kind::Int>::FromPython(env, obj);
+        }
+    };
+
+    template <> struct Scalar<Kind::Str>
+    {
+        static py_object_owned ToPython(Napi::Value value)
+        {
+            if (!value.IsString())
+                return nullptr;
+            std::string str = value.As<Napi::String>();
+            return py_object_owned(PyUnicode_FromStringAndSize(str.data(), str.size()));
+        }
+
+        static Napi::Value FromPython(Napi::Env env, PyObject *obj)
+        {
+            Py_ssize_t size;
+            const char *data = PyUnicode_Check(obj) ? PyUnicode_AsUTF8AndSize(obj, &size) : nullptr;
+            if (!data) {
+                PyErr_Clear();
+                return Napi::Value();
+            }
+            return Napi::String::New(env, data, size);
+        }
+    };
+
+    template <> struct Scalar<Kind::Bool>
+    {
+        static py_object_owned ToPython(Napi::Value value)
+        {
+            if (!value.IsBoolean())
+                return nullptr;
+            return py_object_owned(PyBool_FromLong(value.As<Napi::Boolean>().Value()));
+        }
+
+        static Napi::Value FromPython(Napi::Env env, PyObject *obj)
+        {
+            if (!PyBool_Check(obj))
+                return Napi::Value();
+            return Napi::Boolean::New(env, obj == Py_True);
+        }
+    };
+
+    template <Kind K>
+    py_object_owned ScalarToPython(const PyNodeSchemaNode &node, Napi::Value value)
+    {
+        py_object_owned result = Scalar<K>::ToPython(value);
+        if (!result)
+            ThrowMismatch(node, JSTypeName(value));
+        return result;
+    }
+
+    template <Kind K>
+    Napi::Value ScalarFromPython(const PyNodeSchemaNode &node, Napi::Env env, PyObject *obj)
+    {
+        Napi::Value result = Scalar<K>::FromPython(env, obj);
+        if (result.IsEmpty())
+            ThrowMismatch(node, Py_TYPE(obj)->tp_name);
+        return result;
+    }
+
+    Napi::Array ExpectArray(const PyNodeSchemaNode &node, Napi::Value value)
+    {
+        if (!value.IsArray())
+            ThrowMismatch(node, JSTypeName(value));
+        return value.As<Napi::Array>();
+    }
+
+    void ExpectSequence(const PyNodeSchemaNode &node, PyObject *obj)
+    {
+        if (!PyList_Check(obj) && !PyTuple_Check(obj))
+            ThrowMismatch(node, Py_TYPE(obj)->tp_name);
+    }
+
+    /* Lists are allocated at their final size, a half filled one is fine to
+       drop on a mismatch since list_dealloc skips the NULL slots */
+    template <Kind K>
+    py_object_owned ScalarListToPython(const PyNodeSchemaNode &node, Napi::Value value)
+    {
+        Napi::Array array = ExpectArray(node, value);
+        uint32_t length = array.Length();
+        py_object_owned list(PyList_New(length));
+        if (!list)
+            ThrowPythonError(value.Env());
+        for (uint32_t i = 0; i < length; i++) {
+            Napi::Value item = array.Get(i);
+            PyObject *pyitem = Scalar<K>::ToPython(item).release();
+            if (!pyitem)
+                ThrowMismatch(*node.element, JSTypeName(item), Index(i));
+            PyList_SET_ITEM(list.get(), i, pyitem);
+        }
+        return list;
+    }
+
+    template <Kind K>
+    Napi::Value ScalarListFromPython(const PyNodeSchemaNode &node, Napi::Env env, PyObject *obj)
+    {
+        ExpectSequence(node, obj);
+        Py_ssize_t length = PySequence_Fast_GET_SIZE(obj);
+        PyObject **items = PySequence_Fast_ITEMS(obj);
+        Napi::Array array = Napi::Array::New(env, length);
+        for (Py_ssize_t i = 0; i < length; i++) {
+            Napi::Value item = Scalar<K>::FromPython(env, items[i]);
+            if (item.IsEmpty())
+                ThrowMismatch(*node.element, Py_TYPE(items[i])->tp_name, Index(i));
+            array.Set(static_cast<uint32_t>(i), item);
+        }
+        return array;
+    }
+
+    py_object_owned ListToPython(const PyNodeSchemaNode &node, Napi::Value value)
+    {
+        Napi::Array array = ExpectArray(node, value);
+        uint32_t length = array.Length();
+        py_object_owned list(PyList_New(length));
+        if (!list)
+            ThrowPythonError(value.Env());
+        for (uint32_t i = 0; i < length; i++) {
+            try {
+                PyList_SET_ITEM(list.get(), i, NodeToPython(*node.element, array.Get(i)).release());
+            }
+            catch (SchemaMismatch &mismatch) {
+                mismatch.path = Index(i) + mismatch.path;
+                throw;
+            }
+        }
+        return list;
+    }
+
+    Napi::Value ListFromPython(const PyNodeSchemaNode &node, Napi::Env env, PyObject *obj)
+    {
+        ExpectSequence(node, obj);
+        Py_ssize_t length = PySequence_Fast_GET_SIZE(obj);
+        Napi::Array array = Napi::Array::New(env, length);
+        /* 'any' elements can run Python code, so re-read the size and hold each item */
+        for (Py_ssize_t i = 0; i < length && i < PySequence_Fast_GET_SIZE(obj); i++) {
+            py_object_owned item = ConvertBorrowedObjectToOwned(PySequence_Fast_GET_ITEM(obj, i));
+            try {
+                array.Set(static_cast<uint32_t>(i), NodeFromPython(*node.element, env, item.get()));
+            }
+            catch (SchemaMismatch &mismatch) {
+                mismatch.path = Index(i) + mismatch.path;
+                throw;
+            }
+        }
+        return array;
+    }
+
+    py_object_owned ObjectToPython(const PyNodeSchemaNode &node, Napi::Value value)
+    {
+        if (value.Type() != napi_object || value.IsArray())
+            ThrowMismatch(node, JSTypeName(value));
+        Napi::Object obj = value.As<Napi::Object>();
+        py_object_owned dict(_PyDict_NewPresized(static_cast<Py_ssize_t>(node.fields.size())));
+        if (!dict)
+            ThrowPythonError(value.Env());
+        for (const auto &field : node.fields) {
+            py_object_owned item;
+            try {
+                item = NodeToPython(*field.node, obj.Get(field.jsKey.Value()));
+            }
+            catch (SchemaMismatch &mismatch) {
+                mismatch.path = "." + field.name + mismatch.path;
+                throw;
+            }
+            if (PyDict_SetItem(dict.get(), field.pyKey.get(), item.get()) < 0)
+                ThrowPythonError(value.Env());
+        }
+        return dict;
+    }
+
+    /* Dicts are read by key, any other object (dataclasses, namedtuples...) by attribute */
+    Napi::Value ObjectFromPython(const PyNodeSchemaNode &node, Napi::Env env, PyObject *obj)
+    {
+        bool isDict = PyDict_Check(obj);
+        if (!isDict && (obj == Py_None || PyLong_Check(obj) || PyFloat_Check(obj) || PyUnicode_Check(obj) ||
+                        PyList_Check(obj) || PyTuple_Check(obj)))
+            ThrowMismatch(node, Py_TYPE(obj)->tp_name);
+
+        Napi::Object result = Napi::Object::New(env);
+        for (const auto &field : node.fields) {
+            py_object_owned item;
+            if (isDict) {
+                item = ConvertBorrowedObjectToOwned(PyDict_GetItemWithError(obj, field.pyKey.get()));
+            }
+            else {
+                item.reset(PyObject_GetAttr(obj, field.pyKey.get()));
+                if (!item && PyErr_ExceptionMatches(PyExc_AttributeError))
+                    PyErr_Clear();
+            }
+            if (!item && PyErr_Occurred())
+                ThrowPythonError(env);
+            if (!item && !field.node->optional)
+                throw SchemaMismatch{ "." + field.name, "missing required field of type " + field.node->Describe() };
+
+            try {
+                result.Set(field.jsKey.Value(), item ? NodeFromPython(*field.node, env, item.get()) : env.Null());
+            }
+            catch (SchemaMismatch &mismatch) {
+                mismatch.path = "." + field.name + mismatch.path;
+                throw;
+            }
+        }
+        return result;
+    }
+
+    py_object_owned AnyToPython(const PyNodeSchemaNode &, Napi::Value value)
+    {
+        py_object_owned result = ConvertToPython(value);
+        if (!result && PyErr_Occurred())
+            ThrowPythonError(value.Env());
+        return result ? std::move(result) : ConvertBorrowedObjectToOwned(Py_None);
+    }
+
+    Napi::Value AnyFromPython(const PyNodeSchemaNode &, Napi::Env env, PyObject *obj)
+    {
+        return ConvertFromPython(env, obj);
+    }
+
+    template <Kind K>
+    void SelectScalarSteps(PyNodeSchemaNode &node)
+    {
+        node.toPython = ScalarToPython<K>;
+        node.fromPython = ScalarFromPython<K>;
+    }
+
+    template <Kind K>
+    void SelectScalarListSteps(PyNodeSchemaNode &node)
+    {
+        node.toPython = ScalarListToPython<K>;
+        node.fromPython = ScalarListFromPython<K>;
+    }
+
+    void SelectSteps(PyNodeSchemaNode &node)
+    {
+        switch (node.kind) {
+        case Kind::Int: SelectScalarSteps<Kind::Int>(node); break;
+        case Kind::Float: SelectScalarSteps<Kind::Float>(node); break;
+        case Kind::Str: SelectScalarSteps<Kind::Str>(node); break;
+        case Kind::Bool: SelectScalarSteps<Kind::Bool>(node); break;
+        case Kind::Any:
+            node.toPython = AnyToPython;
+            node.fromPython = AnyFromPython;
+            break;
+        case Kind::Object:
+            node.toPython = ObjectToPython;
+            node.fromPython = ObjectFromPython;
+            break;
+        case Kind::List:
+            node.toPython = ListToPython;
+            node.fromPython = ListFromPython;
+            if (node.element->optional)
+                break;
+            switch (node.element->kind) {
+            case Kind::Int: SelectScalarListSteps<Kind::Int>(node); break;
+            case Kind::Float: SelectScalarListSteps<Kind::Float>(node); break;
+            case Kind::Str: SelectScalarListSteps<Kind::Str>(node); break;
+            case Kind::Bool: SelectScalarListSteps<Kind::Bool>(node); break;
+            default: break;
+            }
+            break;
+        }
+    }
+
+    std::unique_ptr<PyNodeSchemaNode> Compile(Napi::Env env, Napi::Value spec, const std::string &path);
+
+    std::unique_ptr<PyNodeSchemaNode> CompileName(Napi::Env env, const std::string &name, const std::string &path)
+    {
+        std::unique_ptr<PyNodeSchemaNode> node;
+        if (name.size() > 1 && name.back() == '?') {
+            node = CompileName(env, name.substr(0, name.size() - 1), path);
+            node->optional = true;
+            return node;
+        }
+
+        node = std::make_unique<PyNodeSchemaNode>();
+        if (name.size() > 2 && name.compare(name.size() - 2, 2, "[]") == 0) {
+            node->kind = Kind::List;
+            node->element = CompileName(env, name.substr(0, name.size() - 2), path + "[]");
+        }
+        else if (name == "int")
+            node->kind = Kind::Int;
+        else if (name == "float")
+            node->kind = Kind::Float;
+        else if (name == "str" || name == "string")
+            node->kind = Kind::Str;
+        else if (name == "bool" || name == "boolean")
+            node->kind = Kind::Bool;
+        else if (name == "any")
+            node->kind = Kind::Any;
+        else
+            throw Napi::TypeError::New(env, "Invalid schema at " + path + ": unknown type '" + name + "'");
+        SelectSteps(*node);
+        return node;
+    }
+
+    /* Needs the GIL for the interned keys */
+    std::unique_ptr<PyNodeSchemaNode> Compile(Napi::Env env, Napi::Value spec, const std::string &path)
+    {
+        if (spec.IsString())
+            return CompileName(env, spec.As<Napi::String>(), path);
+
+        auto node = std::make_unique<PyNodeSchemaNode>();
+        if (spec.IsArray()) {
+            Napi::Array array = spec.As<Napi::Array>();
+            if (array.Length() != 1)
+                throw Napi::TypeError::New(env, "Invalid schema at " + path + ": a list is written as [element]");
+            node->kind = Kind::List;
+            node->element = Compile(env, array.Get(0u), path + "[]");
+        }
+        else if (spec.Type() == napi_object) {
+            Napi::Object obj = spec.As<Napi::Object>();
+            Napi::Array names = obj.GetPropertyNames();
+            node->kind = Kind::Object;
+            node->fields.reserve(names.Length());
+            for (uint32_t i = 0; i < names.Length(); i++) {
+                PyNodeSchemaNode::Field field;
+                field.name = names.Get(i).ToString().Utf8Value();
+                field.jsKey = Napi::Persistent(Napi::String::New(env, field.name));
+                field.pyKey.reset(PyUnicode_InternFromString(field.name.c_str()));
+                if (!field.pyKey)
+                    ThrowPythonError(env);
+                field.node = Compile(env, obj.Get(field.name), path + "." + field.name);
+                node->fields.push_back(std::move(field));
+            }
+        }
+        else {
+            throw Napi::TypeError::New(env, "Invalid schema at " + path + ": expected a type name, [element] or {field: schema}");
+        }
+        SelectSteps(*node);
+        return node;
+    }
+}
+
+std::string PyNodeSchemaNode::Describe() const {
+    std::string description;
+    switch (kind) {
+    case Kind::Int: description = "int"; break;
+    case Kind::Float: description = "float"; break;
+    case Kind::Str: description = "str"; break;
+    case Kind::Bool: description = "bool"; break;
+    case Kind::Any: description = "any"; break;
+    case Kind::List: description = element->Describe() + "[]"; break;
+    case Kind::Object:
+        description = "{";
+        for (const auto &field : fields) {
+            if (description.size() > 1)
+                description += ", ";
+            description += field.name + ": " + field.node->Describe();
+        }
+        description += "}";
+        break;
+    }
+    return optional ? description + "?" : description;
+}
+
+Napi::Object PyNodeSchema::Init(Napi::Env env, Napi::Object exports) {
+    Napi::Function func = DefineClass(env, "PyNodeSchema", {
+        InstanceMethod("toString", &PyNodeSchema::ToString),
+    });
+
+    auto instData = env.GetInstanceData<PyNodeEnvData>();
+    instData->PyNodeSchemaConstructor = Napi::Persistent(func);
+    exports.Set("schema", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto instData = info.Env().GetInstanceData<PyNodeEnvData>();
+        return instData->PyNodeSchemaConstructor.New({ info[0] });
+    }));
+    return exports;
+}
+
+PyNodeSchema::PyNodeSchema(const Napi::CallbackInfo &info) : Napi::ObjectWrap<PyNodeSchema>(info) {
+    _root = Get(info.Env(), info[0]);
+}
+
+Napi::Value PyNodeSchema::ToString(const Napi::CallbackInfo &info) {
+    return Napi::String::New(info.Env(), _root->Describe());
+}
+
+std::shared_ptr<PyNodeSchemaNode> PyNodeSchema::Get(Napi::Env env, Napi::Value schemaOrSpec) {
+    auto instData = env.GetInstanceData<PyNodeEnvData>();
+    if (schemaOrSpec.IsObject() && schemaOrSpec.As<Napi::Object>().InstanceOf(instData->PyNodeSchemaConstructor.Value()))
+        return Unwrap(schemaOrSpec.As<Napi::Object>())->_root;
+
+    if (!PyNodeInterpreterReady())
+        throw Napi::Error::New(env, "The Python interpreter has not been started");
+    py_ensure_gil ctx;
+    /* The interned keys go away with the GIL, wherever the last owner lets go */
+    return std::shared_ptr<PyNodeSchemaNode>(Compile(env, schemaOrSpec, "schema").release(), [](PyNodeSchemaNode *node) {
+        py_ensure_gil ctx;
+        delete node;
+    });
+}
+
+py_object_owned PyNodeSchema::ToPython(const PyNodeSchemaNode &root, Napi::Value value, const std::string &what) {
+    try {
+        return NodeToPython(root, value);
+    }
+    catch (const SchemaMismatch &mismatch) {
+        throw Napi::TypeError::New(value.Env(), "Schema mismatch at " + what + mismatch.path + ": " + mismatch.message);
+    }
+}
+
+Napi::Value PyNodeSchema::FromPython(const PyNodeSchemaNode &root, Napi::Env env, PyObject *obj, const std::string &what) {
+    try {
+        return NodeFromPython(root, env, obj);
+    }
+    catch (const SchemaMismatch &mismatch) {
+        throw Napi::TypeError::New(env, "Schema mismatch at " + what + mismatch.path + ": " + mismatch.message);
+    }
+}
+
+Napi::Object PyNodeTyped::Init(Napi::Env env, Napi::Object exports) {
+    Napi::Function func = DefineClass(env, "PyNodeTyped", {
+        InstanceMethod("__call__", &PyNodeTyped::Call),
+        InstanceMethod("__callasync_promise__", &PyNodeTyped::CallAsyncPromise),
+    });
+
+    auto instData = env.GetInstanceData<PyNodeEnvData>();
+    instData->PyNodeTypedConstructor = Napi::Persistent(func);
+    return exports;
+}
+
+PyNodeTyped::PyNodeTyped(const Napi::CallbackInfo &info) : Napi::ObjectWrap<PyNodeTyped>(info) {
+    Napi::Env env = info.Env();
+    _target = Napi::Persistent(info[0].As<Napi::Object>());
+    if (info.Length() > 1 && !info[1].IsUndefined() && !info[1].IsNull()) {
+        if (!info[1].IsArray())
+            throw Napi::TypeError::New(env, "__typed__ takes an array of argument schemas");
+        Napi::Array args = info[1].As<Napi::Array>();
+        for (uint32_t i = 0; i < args.Length(); i++)
+            _args.push_back(PyNodeSchema::Get(env, args.Get(i)));
+    }
+    if (info.Length() > 2 && !info[2].IsUndefined() && !info[2].IsNull())
+        _result = PyNodeSchema::Get(env, info[2]);
+}
+
+PyObject *PyNodeTyped::Target() {
+    return Napi::ObjectWrap<PyNodeWrappedPythonObject>::Unwrap(_target.Value())->getValue();
+}
+
+/* Arguments past the schemas convert as usual. Needs the GIL. */
+py_object_owned PyNodeTyped::BuildArgs(const Napi::CallbackInfo &info) {
+    trace_span span("PyNodeTyped::BuildArgs", "conversion");
+    size_t count = info.Length();
+    py_object_owned args(PyTuple_New(count));
+    if (!args)
+        ThrowPythonError(info.Env());
+    for (size_t i = 0; i < count; i++) {
+        py_object_owned arg = i < _args.size() ? PyNodeSchema::ToPython(*_args[i], info[i], "args" + Index(i)) : ConvertToPython(info[i]);
+        PyTuple_SET_ITEM(args.get(), i, arg.release());
+    }
+    return args;
+}
+
+Napi::Value PyNodeTyped::Call(const Napi::CallbackInfo &info) {
+    trace_span span("PyNodeTyped::Call", "pynode");
+    py_ensure_gil ctx;
+    Napi::Env env = info.Env();
+    py_object_owned args = BuildArgs(info);
+    py_object_owned result;
+    {
+        alloc_scope allocations(Target());
+        result.reset(PyObject_CallObject(Target(), args.get()));
+    }
+    if (!result) {
+        PyNodePythonError::New(env, py_exception::Fetch()).ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    if (!_result)
+        return ConvertFromPython(env, result.get());
+    return PyNodeSchema::FromPython(*_result, env, result.get(), "result");
+}
+
+Napi::Value PyNodeTyped::CallAsyncPromise(const Napi::CallbackInfo &info) {
+    trace_span span("PyNodeTyped::CallAsyncPromise", "pynode");
+    py_ensure_gil ctx;
+    Napi::Env env = info.Env();
+    py_object_owned args = BuildArgs(info);
+
+    auto ret = Napi::Promise::Deferred(env);
+    PyNodeWorker* pnw = new PyNodeWorker(ret, std::move(args), ConvertBorrowedObjectToOwned(Target()));
+    if (_result) {
+        auto schema = _result;
+        pnw->SetResultConverter([schema](Napi::Env env, PyObject *obj) {
+            return PyNodeSchema::FromPython(*schema, env, obj, "result");
+        });
+    }
+    pnw->Queue();
+    return ret.Promise();
+}
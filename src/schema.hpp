@@ -0,0 +1,81 @@
+#ifndef PYNODE_SCHEMA_HPP
+#define PYNODE_SCHEMA_HPP
+
+#include <Python.h>
+#include "napi.h"
+#include "helpers.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+struct PyNodeSchemaNode;
+using PyNodeSchemaToPython = py_object_owned (*)(const PyNodeSchemaNode &node, Napi::Value value);
+using PyNodeSchemaFromPython = Napi::Value (*)(const PyNodeSchemaNode &node, Napi::Env env, PyObject *obj);
+
+/* One node of a compiled schema. The conversion steps are picked once at
+   compile time, lists of scalars get a loop specialized on the element
+   type and object keys are interned on both sides. */
+struct PyNodeSchemaNode
+{
+    enum class Kind { Int, Float, Str, Bool, Any, List, Object };
+
+    struct Field
+    {
+        std::string name;
+        Napi::Reference<Napi::String> jsKey;
+        py_object_owned pyKey;
+        std::unique_ptr<PyNodeSchemaNode> node;
+    };
+
+    Kind kind = Kind::Any;
+    bool optional = false;
+    std::unique_ptr<PyNodeSchemaNode> element;
+    std::vector<Field> fields;
+    PyNodeSchemaToPython toPython = nullptr;
+    PyNodeSchemaFromPython fromPython = nullptr;
+
+    std::string Describe() const;
+};
+
+/* Returned by pynode.schema(spec). A spec is a type name ('int', 'float',
+   'str', 'bool', 'any'), optionally suffixed with '[]' for a list and '?'
+   for null/None, a one element array for a list, or a plain object of
+   field specs for an object/dict. */
+class PyNodeSchema : public Napi::ObjectWrap<PyNodeSchema>
+{
+public:
+    static Napi::Object Init(Napi::Env env, Napi::Object exports);
+    PyNodeSchema(const Napi::CallbackInfo &info);
+
+    /* A PyNodeSchema's compiled root, or spec compiled on the spot */
+    static std::shared_ptr<PyNodeSchemaNode> Get(Napi::Env env, Napi::Value schemaOrSpec);
+    /* Both need the GIL and throw a TypeError naming the path of a mismatch */
+    static py_object_owned ToPython(const PyNodeSchemaNode &root, Napi::Value value, const std::string &what);
+    static Napi::Value FromPython(const PyNodeSchemaNode &root, Napi::Env env, PyObject *obj, const std::string &what);
+
+private:
+    Napi::Value ToString(const Napi::CallbackInfo &info);
+
+    std::shared_ptr<PyNodeSchemaNode> _root;
+};
+
+/* Returned by __typed__, calls a PyNodeWrappedPythonObject converting the
+   arguments and the result through schemas */
+class PyNodeTyped : public Napi::ObjectWrap<PyNodeTyped>
+{
+public:
+    static Napi::Object Init(Napi::Env env, Napi::Object exports);
+    PyNodeTyped(const Napi::CallbackInfo &info);
+
+private:
+    Napi::Value Call(const Napi::CallbackInfo &info);
+    Napi::Value CallAsyncPromise(const Napi::CallbackInfo &info);
+    py_object_owned BuildArgs(const Napi::CallbackInfo &info);
+    PyObject *Target();
+
+    Napi::ObjectReference _target;
+    std::vector<std::shared_ptr<PyNodeSchemaNode>> _args;
+    std::shared_ptr<PyNodeSchemaNode> _result;
+};
+
+#endif
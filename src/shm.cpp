@@ -0,0 +1,137 @@
+#include "shm.hpp"
+#include <string>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+struct PyNodeMapping
+{
+    void* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE handle = NULL;
+#endif
+
+    ~PyNodeMapping() {
+#ifdef _WIN32
+        if (data)
+            UnmapViewOfFile(data);
+        if (handle)
+            CloseHandle(handle);
+#else
+        if (data)
+            munmap(data, size);
+#endif
+    }
+};
+
+#ifdef _WIN32
+
+static bool MapSegment(const std::string& name, size_t size, bool create, PyNodeMapping& mapping, std::string& error) {
+    if (create) {
+        mapping.handle = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+            static_cast<DWORD>(static_cast<uint64_t>(size) >> 32), static_cast<DWORD>(size & 0xffffffff), name.c_str());
+        if (mapping.handle && GetLastError() == ERROR_ALREADY_EXISTS) {
+            error = "Shared memory segment " + name + " already exists";
+            return false;
+        }
+    }
+    else {
+        mapping.handle = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name.c_str());
+    }
+    if (!mapping.handle) {
+        error = "Failed to open shared memory segment " + name + " (error " + std::to_string(GetLastError()) + ")";
+        return false;
+    }
+    mapping.data = MapViewOfFile(mapping.handle, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if (!mapping.data) {
+        error = "Failed to map shared memory segment " + name + " (error " + std::to_string(GetLastError()) + ")";
+        return false;
+    }
+    mapping.size = size;
+    return true;
+}
+
+#else
+
+/* Same naming as Python's _posixshmem, which adds the leading slash */
+static std::string PosixName(const std::string& name) {
+    return name[0] == '/' ? name : "/" + name;
+}
+
+static bool MapSegment(const std::string& name, size_t size, bool create, PyNodeMapping& mapping, std::string& error) {
+    std::string posixName = PosixName(name);
+    int fd = shm_open(posixName.c_str(), create ? (O_CREAT | O_EXCL | O_RDWR) : O_RDWR, 0600);
+    if (fd < 0) {
+        error = "Failed to open shared memory segment " + name + ": " + strerror(errno);
+        return false;
+    }
+    if (create && ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        error = "Failed to size shared memory segment " + name + ": " + strerror(errno);
+        close(fd);
+        shm_unlink(posixName.c_str());
+        return false;
+    }
+    void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        error = "Failed to map shared memory segment " + name + ": " + strerror(errno);
+        return false;
+    }
+    mapping.data = data;
+    mapping.size = size;
+    return true;
+}
+
+#endif
+
+Napi::Value PyNodeSharedMemory::Open(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    if (info.Length() < 2 || !info[0].IsString() || !info[1].IsNumber()) {
+        Napi::TypeError::New(env, "Must pass a segment name and size to 'openSharedMemory'").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    std::string name = info[0].As<Napi::String>();
+    int64_t size = info[1].As<Napi::Number>().Int64Value();
+    bool create = info.Length() > 2 && info[2].ToBoolean();
+    if (name.empty() || size <= 0) {
+        Napi::RangeError::New(env, "Shared memory segments need a name and a positive size").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    auto mapping = new PyNodeMapping();
+    std::string error;
+    if (!MapSegment(name, static_cast<size_t>(size), create, *mapping, error)) {
+        delete mapping;
+        Napi::Error::New(env, error).ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    return Napi::ArrayBuffer::New(env, mapping->data, mapping->size,
+        [](Napi::Env, void*, PyNodeMapping* mapping) { delete mapping; }, mapping);
+}
+
+Napi::Value PyNodeSharedMemory::Unlink(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    if (info.Length() < 1 || !info[0].IsString()) {
+        Napi::TypeError::New(env, "Must pass a segment name to 'unlinkSharedMemory'").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+#ifndef _WIN32
+    /* Windows segments go away with the last handle */
+    std::string name = info[0].As<Napi::String>();
+    shm_unlink(PosixName(name).c_str());
+#endif
+    return env.Undefined();
+}
+
+void PyNodeSharedMemory::Init(Napi::Env env, Napi::Object exports) {
+    exports.Set("openSharedMemory", Napi::Function::New(env, Open));
+    exports.Set("unlinkSharedMemory", Napi::Function::New(env, Unlink));
+}
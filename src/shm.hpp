@@ -0,0 +1,20 @@
+#ifndef PYNODE_SHM_HPP
+#define PYNODE_SHM_HPP
+
+#include "napi.h"
+
+/* Named shared memory segments for the process pool (pool.js). Names follow
+   multiprocessing.shared_memory, so the Python side attaches with
+   SharedMemory(name). */
+class PyNodeSharedMemory
+{
+public:
+    static void Init(Napi::Env env, Napi::Object exports);
+
+private:
+    /* openSharedMemory(name, size, create) => ArrayBuffer, unmapped once collected */
+    static Napi::Value Open(const Napi::CallbackInfo &info);
+    static Napi::Value Unlink(const Napi::CallbackInfo &info);
+};
+
+#endif
@@ -0,0 +1,604 @@
+#define PY_SSIZE_T_CLEAN
+#include "stream.hpp"
+#include "pynode.hpp"
+#include "dispatch.hpp"
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+/* Drives the source's iterator on the JS thread. Keeps itself alive while
+   the source is live, the state only has a weak pointer to it. */
+class PyNodeStreamPump : public std::enable_shared_from_this<PyNodeStreamPump> {
+public:
+  PyNodeStreamPump(Napi::Object iterator, std::shared_ptr<PyNodeStreamState> state)
+    : iterator(Napi::Persistent(iterator)), state(std::move(state)) {}
+
+  void Start() {
+    self = shared_from_this();
+    state->pump = self;
+    Pull();
+  }
+
+  void Pull();
+  void Stop(bool cancel);
+
+private:
+  void OnResult(Napi::Value result);
+
+  Napi::ObjectReference iterator;
+  std::shared_ptr<PyNodeStreamState> state;
+  std::shared_ptr<PyNodeStreamPump> self;
+  bool stopped = false;
+};
+
+namespace {
+  std::string ErrorMessage(Napi::Value error) {
+    if (error.IsObject()) {
+      Napi::Value message = error.As<Napi::Object>().Get("message");
+      if (message.IsString())
+        return message.As<Napi::String>();
+    }
+    return error.ToString();
+  }
+
+  /* Points at the bytes of a chunk without copying where JS allows it */
+  bool ToChunk(Napi::Value value, PyNodeStreamState::Chunk& chunk) {
+    if (value.IsString()) {
+      auto str = std::make_shared<std::string>(value.As<Napi::String>().Utf8Value());
+      chunk.data = reinterpret_cast<const uint8_t*>(str->data());
+      chunk.length = str->size();
+      chunk.owner = str;
+      return true;
+    }
+    if (value.IsTypedArray()) {
+      auto array = value.As<Napi::TypedArray>();
+      chunk.data = static_cast<const uint8_t*>(array.ArrayBuffer().Data()) + array.ByteOffset();
+      chunk.length = array.ByteLength();
+    }
+    else if (value.IsArrayBuffer()) {
+      auto buffer = value.As<Napi::ArrayBuffer>();
+      chunk.data = static_cast<const uint8_t*>(buffer.Data());
+      chunk.length = buffer.ByteLength();
+    }
+    else {
+      return false;
+    }
+    /* The reference has to go on the JS thread, wherever Python drops the chunk */
+    chunk.owner = std::shared_ptr<Napi::ObjectReference>(new Napi::ObjectReference(Napi::Persistent(value.As<Napi::Object>())),
+      [](Napi::ObjectReference* reference) {
+        PyNodeJSDispatcher::Release(std::move(*reference));
+        delete reference;
+      });
+    return true;
+  }
+}
+
+/* State */
+
+bool PyNodeStreamState::Push(Chunk&& chunk) {
+  {
+    std::unique_lock lock(mutex);
+    if (cancelled)
+      return false;
+    buffered += chunk.length;
+    chunks.push_back(std::move(chunk));
+    stalled = buffered >= highWaterMark;
+  }
+  condition.notify_all();
+  return !stalled;
+}
+
+void PyNodeStreamState::Finish(const std::string& message) {
+  {
+    std::unique_lock lock(mutex);
+    ended = true;
+    error = message;
+  }
+  condition.notify_all();
+}
+
+bool PyNodeStreamState::Pop(Chunk& chunk, std::string& message) {
+  bool resume = false;
+  {
+    std::unique_lock lock(mutex);
+    condition.wait(lock, [&]() { return !chunks.empty() || ended || cancelled; });
+    if (chunks.empty()) {
+      message = cancelled ? std::string() : error;
+      return false;
+    }
+    chunk = std::move(chunks.front());
+    chunks.pop_front();
+    buffered -= chunk.length;
+    if (stalled && buffered <= highWaterMark / 2) {
+      stalled = false;
+      resume = true;
+    }
+  }
+  if (resume) {
+    PyNodeJSDispatcher::Post(env, [weak = pump](Napi::Env) {
+      if (auto pump = weak.lock())
+        pump->Pull();
+    });
+  }
+  return true;
+}
+
+bool PyNodeStreamState::HasData() {
+  std::unique_lock lock(mutex);
+  return !chunks.empty() || ended || cancelled;
+}
+
+void PyNodeStreamState::Cancel() {
+  std::deque<Chunk> dropped;
+  {
+    std::unique_lock lock(mutex);
+    if (cancelled)
+      return;
+    cancelled = true;
+    dropped.swap(chunks);
+    buffered = 0;
+    stalled = false;
+  }
+  condition.notify_all();
+
+  auto stop = [weak = pump](Napi::Env) {
+    if (auto pump = weak.lock())
+      pump->Stop(true);
+  };
+  if (PyNodeJSDispatcher::IsJSThread(env))
+    stop(Napi::Env(env));
+  else
+    PyNodeJSDispatcher::Post(env, stop);
+}
+
+/* Pump */
+
+void PyNodeStreamPump::Pull() {
+  if (stopped)
+    return;
+  Napi::Env env = iterator.Env();
+  try {
+    Napi::Object it = iterator.Value();
+    Napi::Value next = it.Get("next").As<Napi::Function>().Call(it, {});
+    /* Sync iterators hand back plain results, async ones promises */
+    Napi::Object promiseCtor = env.Global().Get("Promise").As<Napi::Object>();
+    Napi::Object promise = promiseCtor.Get("resolve").As<Napi::Function>().Call(promiseCtor, { next }).As<Napi::Object>();
+
+    auto pump = shared_from_this();
+    Napi::Function onFulfilled = Napi::Function::New(env, [pump](const Napi::CallbackInfo& info) {
+      pump->OnResult(info[0]);
+      return info.Env().Undefined();
+    });
+    Napi::Function onRejected = Napi::Function::New(env, [pump](const Napi::CallbackInfo& info) {
+      pump->state->Finish(ErrorMessage(info[0]));
+      pump->Stop(false);
+      return info.Env().Undefined();
+    });
+    promise.Get("then").As<Napi::Function>().Call(promise, { onFulfilled, onRejected });
+  }
+  catch (const Napi::Error& e) {
+    state->Finish(e.Message());
+    Stop(false);
+  }
+}
+
+void PyNodeStreamPump::OnResult(Napi::Value result) {
+  if (stopped)
+    return;
+  Napi::Object obj = result.IsObject() ? result.As<Napi::Object>() : Napi::Object::New(result.Env());
+  if (obj.Get("done").ToBoolean()) {
+    state->Finish(std::string());
+    Stop(false);
+    return;
+  }
+
+  PyNodeStreamState::Chunk chunk;
+  if (!ToChunk(obj.Get("value"), chunk)) {
+    state->Finish("JS stream produced a chunk that isn't a string, typed array or ArrayBuffer");
+    Stop(true);
+    return;
+  }
+  if (state->Push(std::move(chunk)))
+    Pull();
+}
+
+void PyNodeStreamPump::Stop(bool cancel) {
+  if (stopped)
+    return;
+  stopped = true;
+  if (cancel) {
+    /* Lets the source clean up, eg destroys a Readable */
+    try {
+      Napi::Object it = iterator.Value();
+      Napi::Value ret = it.Get("return");
+      if (ret.IsFunction())
+        ret.As<Napi::Function>().Call(it, {});
+    }
+    catch (const Napi::Error&) {
+    }
+  }
+  iterator.Reset();
+  self.reset();
+}
+
+/* JS side */
+
+Napi::Object PyNodeStream::Init(Napi::Env env, Napi::Object exports) {
+    Napi::Function func = DefineClass(env, "PyNodeStream", {});
+
+    auto instData = env.GetInstanceData<PyNodeEnvData>();
+    instData->PyNodeStreamConstructor = Napi::Persistent(func);
+    exports.Set("PyNodeStream", func);
+    exports.Set("createStream", Napi::Function::New(env, [](const Napi::CallbackInfo& info) -> Napi::Value {
+        auto instData = info.Env().GetInstanceData<PyNodeEnvData>();
+        return instData->PyNodeStreamConstructor.New({ info[0], info[1] });
+    }));
+    return exports;
+}
+
+PyNodeStream::PyNodeStream(const Napi::CallbackInfo &info) : Napi::ObjectWrap<PyNodeStream>(info) {
+    Napi::Env env = info.Env();
+    if (info.Length() < 1 || !info[0].IsObject()) {
+        throw Napi::TypeError::New(env, "Must pass a stream or iterable to 'createStream'");
+    }
+
+    size_t highWaterMark = 1 << 20;
+    if (info.Length() > 1 && info[1].IsObject()) {
+        auto options = info[1].As<Napi::Object>();
+        if (options.Has("highWaterMark"))
+            highWaterMark = static_cast<size_t>(std::max<int64_t>(1, options.Get("highWaterMark").ToNumber().Int64Value()));
+    }
+
+    /* Readable and other async iterables, then sync iterables, then bare iterators */
+    Napi::Object source = info[0].As<Napi::Object>();
+    Napi::Value asyncIterator = source.Get(Napi::Symbol::WellKnown(env, "asyncIterator"));
+    Napi::Value syncIterator = source.Get(Napi::Symbol::WellKnown(env, "iterator"));
+    Napi::Value iterator;
+    if (asyncIterator.IsFunction())
+        iterator = asyncIterator.As<Napi::Function>().Call(source, {});
+    else if (syncIterator.IsFunction())
+        iterator = syncIterator.As<Napi::Function>().Call(source, {});
+    else if (source.Get("next").IsFunction())
+        iterator = source;
+    if (iterator.IsEmpty() || !iterator.IsObject()) {
+        throw Napi::TypeError::New(env, "Must pass a stream or iterable to 'createStream'");
+    }
+
+    _state = std::make_shared<PyNodeStreamState>(env, highWaterMark);
+    std::make_shared<PyNodeStreamPump>(iterator.As<Napi::Object>(), _state)->Start();
+}
+
+/* Python side */
+
+struct PyNodeStreamObject {
+    PyObject_HEAD
+    std::shared_ptr<PyNodeStreamState> state;
+    /* What a short read left of the last chunk */
+    PyNodeStreamState::Chunk pending;
+    size_t offset;
+    bool closed;
+};
+
+/* Exports one chunk's bytes to memoryviews without copying them */
+struct PyNodeStreamChunkObject {
+    PyObject_HEAD
+    PyNodeStreamState::Chunk chunk;
+};
+
+PyTypeObject PyNodeStreamType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+};
+
+static PyTypeObject PyNodeStreamChunkType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+};
+
+PyObject* PyNodeStream_New(std::shared_ptr<PyNodeStreamState> state) {
+    /* A second reader would race the first for chunks and cancel it on dealloc */
+    if (state->reader)
+        return Py_NewRef(state->reader);
+    auto self = (PyNodeStreamObject*)PyNodeStreamType.tp_alloc(&PyNodeStreamType, 0);
+    if (self != NULL) {
+        state->reader = (PyObject*)self;
+        new (&self->state) std::shared_ptr<PyNodeStreamState>(std::move(state));
+        new (&self->pending) PyNodeStreamState::Chunk();
+        self->offset = 0;
+        self->closed = false;
+    }
+    return (PyObject*)self;
+}
+
+static void
+PyNodeStream_dealloc(PyObject* obj)
+{
+    auto self = (PyNodeStreamObject*)obj;
+    self->state->reader = nullptr;
+    /* Nobody is going to read the rest, let the source stop producing */
+    if (!self->closed)
+        self->state->Cancel();
+    self->pending.~Chunk();
+    self->state.~shared_ptr();
+    Py_TYPE(self)->tp_free(obj);
+}
+
+static void
+PyNodeStreamChunk_dealloc(PyObject* obj)
+{
+    ((PyNodeStreamChunkObject*)obj)->chunk.~Chunk();
+    Py_TYPE(obj)->tp_free(obj);
+}
+
+static int
+PyNodeStreamChunk_getbuffer(PyObject* obj, Py_buffer* view, int flags)
+{
+    auto& chunk = ((PyNodeStreamChunkObject*)obj)->chunk;
+    return PyBuffer_FillInfo(view, obj, (void*)chunk.data, chunk.length, 1, flags);
+}
+
+/* 1 with the next chunk in chunk, 0 at the end of the stream, -1 with a Python error */
+static int
+PyNodeStream_next_chunk(PyNodeStreamObject* self, PyNodeStreamState::Chunk& chunk)
+{
+    if (self->closed) {
+        PyErr_SetString(PyExc_ValueError, "I/O operation on closed stream");
+        return -1;
+    }
+    if (self->pending.data && self->offset < self->pending.length) {
+        chunk = std::move(self->pending);
+        chunk.data += self->offset;
+        chunk.length -= self->offset;
+        self->pending = PyNodeStreamState::Chunk();
+        self->offset = 0;
+        return 1;
+    }
+
+    auto state = self->state;
+    /* The JS thread can't wait on itself */
+    if (!state->HasData() && PyNodeJSDispatcher::IsJSThread(state->env)) {
+        PyErr_SetString(PyExc_RuntimeError, "Reading a JS stream would block the JS thread, call this function with __callasync__");
+        return -1;
+    }
+
+    bool available;
+    std::string error;
+    Py_BEGIN_ALLOW_THREADS
+    available = state->Pop(chunk, error);
+    Py_END_ALLOW_THREADS
+    if (available)
+        return 1;
+    if (!error.empty()) {
+        PyErr_SetString(PyExc_OSError, error.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+static PyObject*
+PyNodeStream_chunk_view(PyNodeStreamState::Chunk&& chunk)
+{
+    auto exporter = (PyNodeStreamChunkObject*)PyNodeStreamChunkType.tp_alloc(&PyNodeStreamChunkType, 0);
+    if (exporter == NULL)
+        return NULL;
+    new (&exporter->chunk) PyNodeStreamState::Chunk(std::move(chunk));
+    py_object_owned owner((PyObject*)exporter);
+    return PyMemoryView_FromObject(owner.get());
+}
+
+/* Keeps the part of chunk past used for the next read */
+static void
+PyNodeStream_keep_rest(PyNodeStreamObject* self, PyNodeStreamState::Chunk&& chunk, size_t used)
+{
+    if (used < chunk.length) {
+        self->pending = std::move(chunk);
+        self->offset = used;
+    }
+}
+
+static PyObject *
+PyNodeStream_iternext(PyObject* obj)
+{
+    PyNodeStreamState::Chunk chunk;
+    int result = PyNodeStream_next_chunk((PyNodeStreamObject*)obj, chunk);
+    if (result <= 0)
+        return NULL; /* StopIteration at the end */
+    return PyNodeStream_chunk_view(std::move(chunk));
+}
+
+static PyObject *
+PyNodeStream_anext_blocking(PyObject* obj, PyObject*)
+{
+    PyNodeStreamState::Chunk chunk;
+    int result = PyNodeStream_next_chunk((PyNodeStreamObject*)obj, chunk);
+    if (result < 0)
+        return NULL;
+    if (result == 0) {
+        PyErr_SetNone(PyExc_StopAsyncIteration);
+        return NULL;
+    }
+    return PyNodeStream_chunk_view(std::move(chunk));
+}
+
+static PyObject *
+PyNodeStream_anext(PyObject* obj)
+{
+    /* Waits for the next chunk on the event loop's default executor, like Channel.wait_async */
+    py_object_owned asyncio(PyImport_ImportModule("asyncio"));
+    py_object_owned loop(asyncio ? PyObject_CallMethod(asyncio.get(), "get_running_loop", NULL) : NULL);
+    py_object_owned next(loop ? PyObject_GetAttrString(obj, "_next_blocking") : NULL);
+    if (!next)
+        return NULL;
+    return PyObject_CallMethod(loop.get(), "run_in_executor", "OO", Py_None, next.get());
+}
+
+static PyObject *
+PyNodeStream_read(PyObject* obj, PyObject* args)
+{
+    auto self = (PyNodeStreamObject*)obj;
+    Py_ssize_t size = -1;
+    if (!PyArg_ParseTuple(args, "|n", &size))
+        return NULL;
+
+    PyNodeStreamState::Chunk chunk;
+    if (size >= 0) {
+        int result = size == 0 ? 0 : PyNodeStream_next_chunk(self, chunk);
+        if (result < 0)
+            return NULL;
+        size_t used = result ? std::min<size_t>(size, chunk.length) : 0;
+        PyObject* bytes = PyBytes_FromStringAndSize((const char*)chunk.data, used);
+        PyNodeStream_keep_rest(self, std::move(chunk), used);
+        return bytes;
+    }
+
+    std::string all;
+    int result;
+    while ((result = PyNodeStream_next_chunk(self, chunk)) > 0)
+        all.append((const char*)chunk.data, chunk.length);
+    if (result < 0)
+        return NULL;
+    return PyBytes_FromStringAndSize(all.data(), all.size());
+}
+
+static PyObject *
+PyNodeStream_readinto(PyObject* obj, PyObject* arg)
+{
+    auto self = (PyNodeStreamObject*)obj;
+    Py_buffer buffer;
+    if (PyObject_GetBuffer(arg, &buffer, PyBUF_WRITABLE | PyBUF_C_CONTIGUOUS) < 0)
+        return NULL;
+
+    PyNodeStreamState::Chunk chunk;
+    int result = buffer.len == 0 ? 0 : PyNodeStream_next_chunk(self, chunk);
+    size_t used = 0;
+    if (result > 0) {
+        used = std::min<size_t>(buffer.len, chunk.length);
+        memcpy(buffer.buf, chunk.data, used);
+        PyNodeStream_keep_rest(self, std::move(chunk), used);
+    }
+    PyBuffer_Release(&buffer);
+    if (result < 0)
+        return NULL;
+    return PyLong_FromSize_t(used);
+}
+
+static PyObject *
+PyNodeStream_close(PyObject* obj, PyObject*)
+{
+    auto self = (PyNodeStreamObject*)obj;
+    if (!self->closed) {
+        self->closed = true;
+        self->pending = PyNodeStreamState::Chunk();
+        self->state->Cancel();
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+PyNodeStream_true(PyObject*, PyObject*)
+{
+    Py_RETURN_TRUE;
+}
+
+static PyObject *
+PyNodeStream_false(PyObject*, PyObject*)
+{
+    Py_RETURN_FALSE;
+}
+
+static PyObject *
+PyNodeStream_flush(PyObject*, PyObject*)
+{
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+PyNodeStream_unsupported(PyObject*, PyObject*)
+{
+    PyErr_SetString(PyExc_OSError, "JS streams are not seekable");
+    return NULL;
+}
+
+static PyObject *
+PyNodeStream_enter(PyObject* obj, PyObject*)
+{
+    return Py_NewRef(obj);
+}
+
+static PyObject *
+PyNodeStream_exit(PyObject* obj, PyObject*)
+{
+    return PyNodeStream_close(obj, NULL);
+}
+
+static PyObject *
+PyNodeStream_get_closed(PyObject* obj, void*)
+{
+    return PyBool_FromLong(((PyNodeStreamObject*)obj)->closed);
+}
+
+static PyMethodDef PyNodeStream_methods[] = {
+    { "read", PyNodeStream_read, METH_VARARGS, "read(size=-1): up to size bytes from the next chunk, everything left if size is negative, b'' at the end" },
+    { "readall", (PyCFunction)(void(*)(void))PyNodeStream_read, METH_VARARGS, "Reads until the end of the stream" },
+    { "readinto", PyNodeStream_readinto, METH_O, "Fills a writable buffer from the next chunk, returns the byte count (0 at the end)" },
+    { "_next_blocking", PyNodeStream_anext_blocking, METH_NOARGS, "Next chunk for __anext__, raises StopAsyncIteration at the end" },
+    { "close", PyNodeStream_close, METH_NOARGS, "Stops reading and lets the JS source clean up" },
+    { "readable", PyNodeStream_true, METH_NOARGS, NULL },
+    { "writable", PyNodeStream_false, METH_NOARGS, NULL },
+    { "seekable", PyNodeStream_false, METH_NOARGS, NULL },
+    { "isatty", PyNodeStream_false, METH_NOARGS, NULL },
+    { "tell", PyNodeStream_unsupported, METH_NOARGS, NULL },
+    { "flush", PyNodeStream_flush, METH_NOARGS, NULL },
+    { "__enter__", PyNodeStream_enter, METH_NOARGS, NULL },
+    { "__exit__", PyNodeStream_exit, METH_VARARGS, NULL },
+    { NULL }
+};
+
+static PyGetSetDef PyNodeStream_getset[] = {
+    { "closed", PyNodeStream_get_closed, NULL, "True once close() was called", NULL },
+    { NULL }
+};
+
+static PyAsyncMethods PyNodeStream_as_async = {
+    PyObject_SelfIter,
+    PyNodeStream_anext,
+    NULL,
+};
+
+static PyBufferProcs PyNodeStreamChunk_as_buffer = {
+    PyNodeStreamChunk_getbuffer,
+    NULL,
+};
+
+int PyNodeStream_AddToModule(PyObject* module) {
+    PyNodeStreamChunkType.tp_name = "pynode.JSStreamChunk";
+    PyNodeStreamChunkType.tp_basicsize = sizeof(PyNodeStreamChunkObject);
+    PyNodeStreamChunkType.tp_flags = Py_TPFLAGS_DEFAULT;
+    PyNodeStreamChunkType.tp_dealloc = PyNodeStreamChunk_dealloc;
+    PyNodeStreamChunkType.tp_as_buffer = &PyNodeStreamChunk_as_buffer;
+    if (PyType_Ready(&PyNodeStreamChunkType) < 0)
+        return -1;
+
+    PyNodeStreamType.tp_name = "pynode.JSStream";
+    PyNodeStreamType.tp_doc = "JS stream or (async) iterable read from Python, created by pynode.createStream(). "
+        "Iterating yields the chunks as read only memoryviews, read()/readinto() make it a raw binary file.";
+    PyNodeStreamType.tp_basicsize = sizeof(PyNodeStreamObject);
+    PyNodeStreamType.tp_itemsize = 0;
+    PyNodeStreamType.tp_flags = Py_TPFLAGS_DEFAULT;
+    PyNodeStreamType.tp_dealloc = PyNodeStream_dealloc;
+    PyNodeStreamType.tp_iter = PyObject_SelfIter;
+    PyNodeStreamType.tp_iternext = PyNodeStream_iternext;
+    PyNodeStreamType.tp_as_async = &PyNodeStream_as_async;
+    PyNodeStreamType.tp_methods = PyNodeStream_methods;
+    PyNodeStreamType.tp_getset = PyNodeStream_getset;
+    if (PyType_Ready(&PyNodeStreamType) < 0)
+        return -1;
+
+    /* io.BufferedReader, TextIOWrapper and isinstance checks accept it as a raw stream */
+    py_object_owned io(PyImport_ImportModule("io"));
+    py_object_owned rawIOBase(io ? PyObject_GetAttrString(io.get(), "RawIOBase") : NULL);
+    if (!rawIOBase)
+        return -1;
+    py_object_owned result(PyObject_CallMethod(rawIOBase.get(), "register", "O", (PyObject*)&PyNodeStreamType));
+    if (!result)
+        return -1;
+    return PyModule_AddObjectRef(module, "JSStream", (PyObject*)&PyNodeStreamType);
+}
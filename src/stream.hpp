@@ -0,0 +1,72 @@
+#ifndef PYNODE_STREAM_HPP
+#define PYNODE_STREAM_HPP
+
+#include <Python.h>
+#include "napi.h"
+#include "helpers.hpp"
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+
+class PyNodeStreamPump;
+
+/* Chunks of a JS stream or (async) iterable on their way to Python. The JS
+   thread pushes until highWaterMark bytes are buffered, Python pops and
+   restarts the pump once the queue drained to half of that. Chunks point at
+   the JS buffer they came from and keep it referenced until Python is done. */
+struct PyNodeStreamState {
+  struct Chunk {
+    const uint8_t* data = nullptr;
+    size_t length = 0;
+    std::shared_ptr<void> owner;
+  };
+
+  PyNodeStreamState(napi_env env, size_t highWaterMark) : env(env), highWaterMark(highWaterMark) {}
+
+  /* JS thread. False once the pump should stop pulling for now. */
+  bool Push(Chunk&& chunk);
+  void Finish(const std::string& error);
+
+  /* Python side, without the GIL. Blocks until a chunk is available, false
+     (with error set if the source failed) at the end of the stream. */
+  bool Pop(Chunk& chunk, std::string& error);
+  bool HasData();
+  /* Stops the pump and drops whatever is buffered, from any thread */
+  void Cancel();
+
+  napi_env env;
+  size_t highWaterMark;
+  std::weak_ptr<PyNodeStreamPump> pump;
+  /* The one JSStream reading this state, borrowed and cleared when it goes
+     away. Every conversion hands back the same object. Needs the GIL. */
+  PyObject* reader = nullptr;
+
+private:
+  std::mutex mutex;
+  std::condition_variable condition;
+  std::deque<Chunk> chunks;
+  size_t buffered = 0;
+  bool ended = false;
+  bool cancelled = false;
+  bool stalled = false;
+  std::string error;
+};
+
+class PyNodeStream : public Napi::ObjectWrap<PyNodeStream> {
+  public:
+    static Napi::Object Init(Napi::Env env, Napi::Object exports);
+    PyNodeStream(const Napi::CallbackInfo &info);
+    std::shared_ptr<PyNodeStreamState> getState() { return _state; }
+
+  private:
+    std::shared_ptr<PyNodeStreamState> _state;
+};
+
+/* Python side of a stream, pynode.JSStream */
+extern PyTypeObject PyNodeStreamType;
+int PyNodeStream_AddToModule(PyObject* module);
+PyObject* PyNodeStream_New(std::shared_ptr<PyNodeStreamState> state);
+
+#endif
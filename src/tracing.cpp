@@ -0,0 +1,231 @@
+#include "tracing.hpp"
+#include "helpers.hpp"
+#include "pynode.hpp"
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <vector>
+#include <map>
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+std::atomic<bool> PyNodeTracer::s_enabled{ false };
+
+namespace {
+  struct TraceEvent {
+    std::string name;
+    const char* category;
+    char phase;
+    int tid;
+    int64_t ts;
+    int64_t dur;
+  };
+
+  std::mutex s_traceMutex;
+  std::vector<TraceEvent> s_events;
+  std::map<int, std::string> s_threadNames;
+  size_t s_maxEvents = 1000000;
+  std::atomic<bool> s_pythonFrames{ false };
+  bool s_dropped = false;
+
+  std::atomic<int> s_nextTid{ 1 };
+  thread_local int t_tid = 0;
+
+  int CurrentTid() {
+    if (t_tid == 0)
+      t_tid = s_nextTid++;
+    return t_tid;
+  }
+
+  void Record(TraceEvent&& event) {
+    std::unique_lock lock{ s_traceMutex };
+    if (s_events.size() >= s_maxEvents) {
+      s_dropped = true;
+      return;
+    }
+    s_events.push_back(std::move(event));
+  }
+
+  void WriteJSONString(std::ostream& out, const std::string& str) {
+    out << '"';
+    for (char c : str) {
+      switch (c) {
+      case '"': out << "\\\""; break;
+      case '\\': out << "\\\\"; break;
+      case '\n': out << "\\n"; break;
+      case '\t': out << "\\t"; break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20)
+          out << ' ';
+        else
+          out << c;
+      }
+    }
+    out << '"';
+  }
+
+  int ProfileFunc(PyObject*, PyFrameObject* frame, int what, PyObject* arg) {
+    /* Stop only clears the profiler on its own thread, worker thread states
+       drop theirs the next time they run Python */
+    if (!PyNodeTracer::IsEnabled() || !s_pythonFrames) {
+      PyEval_SetProfile(nullptr, nullptr);
+      return 0;
+    }
+
+    switch (what) {
+    case PyTrace_CALL: {
+      PyCodeObject* code = PyFrame_GetCode(frame);
+#if PY_VERSION_HEX >= 0x030B0000
+      const char* utf8 = PyUnicode_AsUTF8(code->co_qualname);
+#else
+      const char* utf8 = PyUnicode_AsUTF8(code->co_name);
+#endif
+      if (!utf8)
+        PyErr_Clear();
+      PyNodeTracer::Begin(utf8 ? utf8 : "<python>", "python");
+      Py_DECREF(code);
+      break;
+    }
+    case PyTrace_C_CALL:
+      PyNodeTracer::Begin(PyCFunction_Check(arg) ? reinterpret_cast<PyCFunctionObject*>(arg)->m_ml->ml_name : "<builtin>", "python");
+      break;
+    case PyTrace_RETURN:
+    case PyTrace_C_RETURN:
+    case PyTrace_C_EXCEPTION:
+      PyNodeTracer::End();
+      break;
+    }
+    return 0;
+  }
+}
+
+void PyNodeTracer::Complete(const char* name, const char* category, int64_t start, int64_t duration) {
+  Record({ name, category, 'X', CurrentTid(), start, duration });
+}
+
+void PyNodeTracer::Begin(std::string&& name, const char* category) {
+  Record({ std::move(name), category, 'B', CurrentTid(), Now(), 0 });
+}
+
+void PyNodeTracer::End() {
+  Record({ std::string(), "python", 'E', CurrentTid(), Now(), 0 });
+}
+
+void PyNodeTracer::NameThread(const char* name) {
+  if (!IsEnabled())
+    return;
+  int tid = CurrentTid();
+  std::unique_lock lock{ s_traceMutex };
+  s_threadNames.emplace(tid, name);
+}
+
+void PyNodeTracer::InstallProfiler() {
+  if (IsEnabled() && s_pythonFrames)
+    PyEval_SetProfile(ProfileFunc, nullptr);
+}
+
+Napi::Value PyNodeTracer::Start(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  bool pythonFrames = false;
+  size_t maxEvents = 1000000;
+  if (info.Length() > 0 && info[0].IsObject()) {
+    auto options = info[0].As<Napi::Object>();
+    if (options.Has("pythonFrames"))
+      pythonFrames = options.Get("pythonFrames").ToBoolean();
+    if (options.Has("maxEvents")) {
+      double value = options.Get("maxEvents").ToNumber().DoubleValue();
+      if (!(value >= 0)) {
+        Napi::RangeError::New(env, "maxEvents must not be negative")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+      }
+      maxEvents = value >= static_cast<double>(SIZE_MAX) ? SIZE_MAX : static_cast<size_t>(value);
+    }
+  }
+
+  {
+    std::unique_lock lock{ s_traceMutex };
+    s_events.clear();
+    s_threadNames.clear();
+    s_maxEvents = maxEvents;
+    s_pythonFrames = pythonFrames;
+    s_dropped = false;
+  }
+  s_enabled = true;
+  NameThread("JavaScript");
+
+  if (PyNodeInterpreterReady()) {
+    py_ensure_gil ctx;
+    InstallProfiler();
+  }
+  return env.Undefined();
+}
+
+Napi::Value PyNodeTracer::Stop(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+
+  if (!info[0] || !info[0].IsString()) {
+    Napi::Error::New(env, "Must pass a file name to 'stopTracing'")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  s_enabled = false;
+  if (PyNodeInterpreterReady()) {
+    py_ensure_gil ctx;
+    PyEval_SetProfile(nullptr, nullptr);
+  }
+
+  std::vector<TraceEvent> events;
+  std::map<int, std::string> threadNames;
+  bool dropped;
+  {
+    std::unique_lock lock{ s_traceMutex };
+    events.swap(s_events);
+    threadNames.swap(s_threadNames);
+    dropped = s_dropped;
+  }
+
+  std::string fileName = info[0].As<Napi::String>();
+  std::ofstream out(fileName, std::ios::out | std::ios::trunc);
+  if (!out) {
+    Napi::Error::New(env, "Failed to open trace file " + fileName)
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  const int pid = getpid();
+  out << "{\"traceEvents\":[\n";
+  out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"args\":{\"name\":\"PyNode\"}}";
+  for (auto& thread : threadNames) {
+    out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << thread.first << ",\"args\":{\"name\":";
+    WriteJSONString(out, thread.second);
+    out << "}}";
+  }
+  for (auto& event : events) {
+    out << ",\n{\"name\":";
+    WriteJSONString(out, event.name);
+    out << ",\"cat\":\"" << event.category << "\",\"ph\":\"" << event.phase << "\",\"pid\":" << pid
+        << ",\"tid\":" << event.tid << ",\"ts\":" << event.ts;
+    if (event.phase == 'X')
+      out << ",\"dur\":" << event.dur;
+    out << '}';
+  }
+  out << "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"truncated\":" << (dropped ? "true" : "false") << "}}\n";
+
+  return Napi::Number::New(env, static_cast<double>(events.size()));
+}
+
+Napi::Object PyNodeTracer::Init(Napi::Env env, Napi::Object exports) {
+  exports.Set(Napi::String::New(env, "startTracing"),
+              Napi::Function::New(env, Start));
+
+  exports.Set(Napi::String::New(env, "stopTracing"),
+              Napi::Function::New(env, Stop));
+
+  return exports;
+}
@@ -0,0 +1,52 @@
+#ifndef PYNODE_TRACING_HPP
+#define PYNODE_TRACING_HPP
+
+#include "napi.h"
+#include <Python.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+
+/* Opt-in recorder for Chrome trace event format (chrome://tracing, Perfetto).
+   Timestamps come from the monotonic clock, like Node's --cpu-prof output. */
+class PyNodeTracer {
+public:
+  static Napi::Object Init(Napi::Env env, Napi::Object exports);
+
+  static bool IsEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+  static int64_t Now() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  static void Complete(const char* name, const char* category, int64_t start, int64_t duration);
+  static void Begin(std::string&& name, const char* category);
+  static void End();
+  static void NameThread(const char* name);
+
+  /* Installs the Python frame profiler on the current thread state if requested, needs the GIL */
+  static void InstallProfiler();
+
+private:
+  static Napi::Value Start(const Napi::CallbackInfo& info);
+  static Napi::Value Stop(const Napi::CallbackInfo& info);
+
+  static std::atomic<bool> s_enabled;
+};
+
+/* Records a complete ('X') event covering its lifetime when tracing is enabled */
+class trace_span {
+public:
+  trace_span(const char* name, const char* category) : name(name), category(category), start(PyNodeTracer::IsEnabled() ? PyNodeTracer::Now() : -1) {}
+
+  ~trace_span() {
+    if (start >= 0 && PyNodeTracer::IsEnabled())
+      PyNodeTracer::Complete(name, category, start, PyNodeTracer::Now() - start);
+  }
+
+private:
+  const char* name;
+  const char* category;
+  int64_t start;
+};
+
+#endif
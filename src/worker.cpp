@@ -1,7 +1,9 @@
 #include "worker.hpp"
-#include <frameobject.h>
+#include "allocations.hpp"
+#include "autodispatch.hpp"
+#include "conversion.hpp"
+#include <chrono>
 #include <iostream>
-#include <sstream>
 
 thread_local PyNodeWorker* PyNodeWorker::s_currentWorker = nullptr;
 
@@ -14,47 +16,30 @@ PyNodeWorker::PyNodeWorker(Napi::Promise::Deferred promise, py_object_owned&& py
     :Napi::AsyncProgressQueueWorker<std::shared_ptr<PyNodeWorkerCallback>>(promise.Env()), promise(promise), pyArgs(std::move(pyArgs)), pFunc(std::move(pFunc)), pValue(nullptr) {};
 
 void PyNodeWorker::Execute(const ExecutionProgress& progress) {
+  trace_span span("PyNodeWorker::Execute", "worker");
   {
     py_thread_context_worker ctx(this, progress);
 
-    pValue.reset(PyObject_CallObject(pFunc.get(), pyArgs.get()));
+    if (argsBuilder) {
+      pyArgs = argsBuilder(pyArgs.get());
+    }
+
+    if (pyArgs) {
+      alloc_scope allocations(pFunc.get());
+      auto start = std::chrono::steady_clock::now();
+      pValue.reset(PyObject_CallObject(pFunc.get(), pyArgs.get()));
+      elapsedUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+    if (pValue && resultEncoder && !resultEncoder(pValue.get())) {
+      pValue = nullptr;
+    }
     PyObject* errOccurred = PyErr_Occurred();
 
     if (errOccurred != NULL) {
-      std::string error;
-      PyObject *pErrType = nullptr, *pErrValue = nullptr, *pErrTraceback = nullptr;
-      PyErr_Fetch(&pErrType, &pErrValue, &pErrTraceback);
-      py_object_owned pTypeString(PyObject_Str(pErrType));
-      py_object_owned pValueString(PyObject_Str(pErrValue));
-
-      const char *value = PyUnicode_AsUTF8(pValueString.get());
-      const char *type = PyUnicode_AsUTF8(pTypeString.get());
-      PyTracebackObject *tb = (PyTracebackObject *)pErrTraceback;
-      _frame *frame = tb ? tb->tb_frame : nullptr;
-
-      if (!frame) {
-          error.append(std::string(type) + ": " + std::string(value));
-      }
-
-      while (frame != NULL) {
-        int line = PyCode_Addr2Line(frame->f_code, frame->f_lasti);
-        const char *filename = PyUnicode_AsUTF8(frame->f_code->co_filename);
-        const char *funcname = PyUnicode_AsUTF8(frame->f_code->co_name);
-        if (filename) {
-          error.append("File \"" + std::string(filename) + "\"");
-        }
-        if (funcname) {
-          error.append(" Line " + std::to_string(line) + ", in " + std::string(funcname) +
-                     "\n");
-        }
-        error.append(std::string(type) + ": " + std::string(value));
-        frame = frame->f_back;
-      }
-
-      PyErr_Restore(pErrType, pErrValue, pErrTraceback);
-      PyErr_Print();
+      /* Only fetch here, the PythonError (and its traceback text) is built lazily on the JS thread */
+      exception = py_exception::Fetch();
       pValue = nullptr;
-      SetError(error);
+      SetError("A Python error occurred.");
     }
     else if (!pValue)
     {
@@ -70,7 +55,12 @@ void PyNodeWorker::OnProgress(const std::shared_ptr<PyNodeWorkerCallback>* data,
 {
     for (size_t i = 0; i < count; i++)
     {
-        data[i]->work();
+        {
+            /* The worker thread waits with the GIL released */
+            trace_span span("js.callback", "js");
+            py_ensure_gil ctx;
+            data[i]->work();
+        }
         std::unique_lock lock(data[i]->mutex);
         data[i]->done = true;
         data[i]->condition.notify_all();
@@ -82,31 +72,68 @@ std::vector<napi_value> PyNodeWorker::GetResult(Napi::Env env)
     Napi::Value ret = env.Undefined();
     {
         py_thread_context ctx;
-        ret = ConvertFromPython(env, pValue.get());
+        trace_span span("ConvertFromPython", "conversion");
+        ret = resultConverter ? resultConverter(env, pValue.get()) : ConvertFromPython(env, pValue.get());
         pValue = nullptr;
     }
     return { env.Null(),  ret };
 }
 
 void PyNodeWorker::OnOK() {
-  if (promise)
+  if (profile)
+      profile->Record(elapsedUs);
+  try
   {
-      promise->Resolve(GetResult(promise->Env())[1]);
+      if (promise)
+      {
+          if (!resultConverter)
+          {
+              py_ensure_gil ctx;
+              if (PyNodeConversion::ConvertIncrementally(promise->Env(), pValue, *promise))
+                  return;
+          }
+          promise->Resolve(GetResult(promise->Env())[1]);
+      }
+      else
+      {
+          Napi::AsyncWorker::OnOK();
+      }
   }
-  else
+  catch (const Napi::Error& e)
   {
-       Napi::AsyncWorker::OnOK();
+      // A converter that refuses the result fails the call instead of throwing from the completion callback
+      {
+          py_ensure_gil ctx;
+          pValue = nullptr;
+      }
+      if (promise)
+      {
+          promise->Reject(e.Value());
+      }
+      else
+      {
+          Callback().Call({ e.Value() });
+      }
   }
-  
 }
 
 void PyNodeWorker::OnError(const Napi::Error &e) {
+    if (profile)
+        profile->Record(elapsedUs);
+    Napi::Error error = e;
+    if (exception)
+    {
+        py_ensure_gil ctx;
+        error = PyNodePythonError::New(Env(), std::move(exception));
+        exception = py_exception();
+    }
+
     if (promise) 
     {
-        promise->Reject(e.Value());
+        promise->Reject(error.Value());
     }
     else
     {
-        Napi::AsyncWorker::OnError(e);
+        Napi::AsyncWorker::OnError(error);
     }
 }
@@ -4,10 +4,16 @@
 #include "Python.h"
 #include "pywrapper.hpp"
 #include "helpers.hpp"
+#include "pyerror.hpp"
+#include "dispatch.hpp"
 #include "napi.h"
 #include <optional>
 #include <mutex>
 #include <condition_variable>
+#include <functional>
+#include <memory>
+
+struct PyNodeCallProfile;
 
 struct PyNodeWorkerCallback
 {
@@ -20,6 +26,14 @@ struct PyNodeWorkerCallback
 
 class PyNodeWorker : public Napi::AsyncProgressQueueWorker<std::shared_ptr<PyNodeWorkerCallback>> {
 public:
+  // Turns the call result into JS on the main thread, with the GIL held. Defaults to ConvertFromPython.
+  using ResultConverter = std::function<Napi::Value(Napi::Env, PyObject*)>;
+  // Run on the worker thread with the GIL held, before and after the call. A
+  // NULL from the builder or false from the encoder fails the call with the
+  // Python error that is set. Both are destroyed with the worker, on the main thread.
+  using ArgsBuilder = std::function<py_object_owned(PyObject* args)>;
+  using ResultEncoder = std::function<bool(PyObject* result)>;
+
   PyNodeWorker(Napi::Function callback, py_object_owned&& pyArgs, py_object_owned&& pFunc);
   PyNodeWorker(Napi::Promise::Deferred promise, py_object_owned&& pyArgs, py_object_owned&& pFunc);
   void Execute(const ExecutionProgress& progress) override;
@@ -27,24 +41,45 @@ public:
   std::vector<napi_value> GetResult(Napi::Env env) override;
   void OnOK() override;
   void OnError(const Napi::Error &e) override;
-  
+  void SetResultConverter(ResultConverter converter) { resultConverter = std::move(converter); }
+  void SetArgsBuilder(ArgsBuilder builder) { argsBuilder = std::move(builder); }
+  void SetResultEncoder(ResultEncoder encoder) { resultEncoder = std::move(encoder); }
+  /* Times the Python call and records it on the JS thread once done, for __callauto__ */
+  void SetProfile(std::shared_ptr<PyNodeCallProfile> p) { profile = std::move(p); }
+
+  /* Runs work on env's JS thread and waits for it. A PyNodeWorker of that env
+     goes through its progress queue, any other Python thread through the env's
+     threadsafe function, the JS thread itself just runs it. False if work
+     never ran because the env is shutting down. */
   template <typename T>
-  static void WrapJSInteractionFromAsyncThread(T&& work)
+  static bool WrapJSInteractionFromAsyncThread(napi_env env, T&& work)
   {
-	  if (s_currentWorker)
+	  if (s_currentWorker && (napi_env)s_currentWorker->Env() == env)
 	  {
 		  auto item = std::make_shared<PyNodeWorkerCallback>();
 		  item->work = std::forward<T>(work);
 		  s_currentWorker->execProgress->Send(&item, 1);
 
+		  trace_span span("js.callback.roundtrip", "js");
 		  Py_BEGIN_ALLOW_THREADS
 		  std::unique_lock lock(item->mutex);
 		  item->condition.wait(lock, [&]() { return item->done; });
 		  Py_END_ALLOW_THREADS
+		  return true;
 	  }
-	  else
+	  else if (PyNodeJSDispatcher::IsJSThread(env))
 	  {
 		  work();
+		  return true;
+	  }
+	  else
+	  {
+		  trace_span span("js.callback.roundtrip", "js");
+		  bool ran;
+		  Py_BEGIN_ALLOW_THREADS
+		  ran = PyNodeJSDispatcher::RunBlocking(env, std::forward<T>(work));
+		  Py_END_ALLOW_THREADS
+		  return ran;
 	  }
   }
 private:
@@ -52,6 +87,12 @@ private:
   py_object_owned pyArgs;
   py_object_owned pFunc;
   py_object_owned pValue;
+  py_exception exception;
+  ResultConverter resultConverter;
+  ArgsBuilder argsBuilder;
+  ResultEncoder resultEncoder;
+  std::shared_ptr<PyNodeCallProfile> profile;
+  double elapsedUs = 0;
   friend struct py_thread_context_worker;
 
   const ExecutionProgress* execProgress;
@@ -64,6 +105,8 @@ struct py_thread_context_worker : public py_thread_context
 	{
 		c->execProgress = &ep;
 		PyNodeWorker::s_currentWorker = c;
+		PyNodeTracer::NameThread("PyNodeWorker");
+		PyNodeTracer::InstallProfiler();
 	}
 
 	~py_thread_context_worker()
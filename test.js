@@ -1,6 +1,11 @@
 import { expect } from "chai"
-import { pynode } from "./index.js"
+import { pynode, createPool } from "./index.js"
 import { promisify } from "util"
+import { mkdtempSync, readdirSync, readFileSync, rmSync, unlinkSync } from "fs"
+import { execFileSync } from "child_process"
+import { tmpdir } from "os"
+import { join } from "path"
+import { Readable } from "stream"
 const nodePython = pynode
 
 nodePython.startInterpreter()
@@ -23,6 +28,29 @@ describe('nodePython', () => {
     })
   })
 
+  describe('#evaluate', () => {
+    it('should return the value of an expression', () => {
+      expect(nodePython.evaluate('1 + 2')).to.equal(3)
+      expect(nodePython.evaluate('1 + 2')).to.equal(3)
+    })
+
+    it('should use the given globals and locals', () => {
+      expect(nodePython.evaluate('x * y', { x: 3 }, { y: 4 })).to.equal(12)
+    })
+
+    it('should run compiled code objects', () => {
+      const code = nodePython.compile('a + len(b)', 'eval')
+      expect(code.__pytype__).to.equal('code')
+      expect(nodePython.evaluate(code, { a: 1, b: [1, 2] })).to.equal(3)
+      expect(nodePython.evaluate(code, { a: 2, b: [] })).to.equal(2)
+    })
+
+    it('should throw a PythonError on failure', () => {
+      expect(() => nodePython.evaluate('undefined_name_11')).to.throw(nodePython.PythonError)
+      expect(() => nodePython.compile('def', 'exec')).to.throw(nodePython.PythonError)
+    })
+  })
+
   describe('#call', () => {
     it('should fail if the last parameter is not a function', () => {
       try {
@@ -45,6 +73,30 @@ describe('nodePython', () => {
         })
     })
 
+    it('should reject with a structured PythonError', done => {
+      call('causes_runtime_error')
+        .catch(err => {
+          expect(err).to.be.instanceOf(Error)
+          expect(err).to.be.instanceOf(nodePython.PythonError)
+          expect(err.pyType).to.equal('NameError')
+          expect(err.pyMessage).to.equal("name 'secon' is not defined")
+          expect(err.stack).to.include('causes_runtime_error')
+          done()
+        })
+    })
+
+    it('should throw a structured PythonError from sync calls', () => {
+      const fn = tools.__getattr__('causes_runtime_error')
+      try {
+        fn.__call__()
+        expect.fail('should have thrown')
+      } catch (err) {
+        expect(err).to.be.instanceOf(nodePython.PythonError)
+        expect(err.pyType).to.equal('NameError')
+        expect(err.message).to.equal("<class 'NameError'>: name 'secon' is not defined")
+      }
+    })
+
     it('should return the custom type', done => {
       call('return_class_object')
         .then(result => {
@@ -309,6 +361,748 @@ describe('nodePython', () => {
     })
   })
 
+  describe('converters', () => {
+    it('should use Python converters for a type and its subclasses', async () => {
+      await call('register_point_converter', true)
+      try {
+        expect(await call('make_point', 1, 2)).to.deep.equal({ x: 1, y: 2 })
+        expect(await call('make_point', 1, 2, 3)).to.deep.equal({ x: 1, y: 2, z: 3 })
+      } finally {
+        await call('register_point_converter', false)
+      }
+      expect((await call('make_point', 1, 2)).__pytype__).to.equal('Point')
+    })
+
+    it('should use JS converters for an exact prototype', async () => {
+      nodePython.registerToPython(Map, (m) => Object.fromEntries(m))
+      try {
+        expect(await call('describe', new Map([['a', 1]]))).to.deep.equal(['dict', { a: 1 }])
+      } finally {
+        nodePython.registerToPython(Map, null)
+      }
+      expect((await call('describe', new Map()))[0]).to.equal('WrappedJSObject')
+    })
+
+    it('should convert integers and bigints losslessly', async () => {
+      expect(await call('describe', 2 ** 40)).to.deep.equal(['int', 2 ** 40])
+      expect(await call('describe', 1.5)).to.deep.equal(['float', 1.5])
+      expect((await call('describe', 12n))[0]).to.equal('int')
+    })
+  })
+
+  describe('JS calls from Python threads', () => {
+    it('should call JS functions from a thread pool', async () => {
+      expect(await call('call_from_threads', (i) => i * 10, 8)).to.deep.equal([0, 10, 20, 30, 40, 50, 60, 70])
+    })
+
+    it('should raise JS errors thrown into a waiting thread', async () => {
+      const result = await call('call_from_thread_catching', () => { throw new Error('nope') })
+      expect(result).to.equal('error: nope')
+    })
+
+    it('should return a future from call_js_async', async () => {
+      expect(await call('call_js_async_from_thread', (x) => x * 2, 21)).to.equal(42)
+    })
+
+    it('should settle the future with the resolved value of a promise', async () => {
+      expect(await call('call_js_async_from_thread', async (x) => x + 1, 41)).to.equal(42)
+    })
+
+    it('should settle the future with JS errors', async () => {
+      const result = await call('call_js_async_from_thread', () => { throw new Error('nope') }, 0)
+      expect(result).to.equal('error: nope')
+    })
+  })
+
+  describe('#collectCycles', () => {
+    const makeHolder = (js) => tools.__getattr__('make_holder').__call__(js)
+
+    it('should weaken references only reachable from JS', () => {
+      const js = { name: 'cyclic' }
+      js.holder = makeHolder(js)
+      expect(nodePython.collectCycles().weak).to.be.at.least(1)
+      expect(js.holder.__getattr__('js')).to.equal(js)
+    })
+
+    it('should make references strong again once the wrapper is used', async function () {
+      if (typeof global.gc !== 'function') {
+        this.skip()
+      }
+      ;(() => {
+        const js = { name: 'kept' }
+        js.holder = makeHolder(js)
+        expect(nodePython.collectCycles().weak).to.be.at.least(1)
+        tools.__getattr__('keep').__call__(js.holder)
+      })()
+      try {
+        for (let i = 0; i < 5; i++) {
+          global.gc()
+          await new Promise((resolve) => setTimeout(resolve, 10))
+        }
+        expect(tools.__getattr__('kept_js_name').__call__()).to.equal('kept')
+      } finally {
+        tools.__getattr__('keep').__call__(null)
+      }
+    })
+
+    it('should let V8 free cross heap cycles', async function () {
+      if (typeof global.gc !== 'function') {
+        this.skip()
+      }
+      let collected = false
+      const registry = new FinalizationRegistry(() => { collected = true })
+      ;(() => {
+        const js = {}
+        js.holder = makeHolder(js)
+        registry.register(js, 0)
+      })()
+      nodePython.collectCycles()
+      for (let i = 0; i < 10 && !collected; i++) {
+        global.gc()
+        await new Promise((resolve) => setTimeout(resolve, 10))
+      }
+      expect(collected).to.equal(true)
+    })
+  })
+
+  describe('#configureMemoryPressure', () => {
+    afterEach(() => {
+      nodePython.configureMemoryPressure({ reportExternalMemory: false, collectPython: false })
+    })
+
+    it('should be off by default', () => {
+      const options = nodePython.configureMemoryPressure()
+      expect(options.reportExternalMemory).to.equal(false)
+      expect(options.collectPython).to.equal(false)
+      const before = options.wrapperBytes
+      nodePython.evaluate('bytearray(4 << 20)')
+      expect(nodePython.configureMemoryPressure().wrapperBytes).to.equal(before)
+    })
+
+    it('should report large wrapped objects as external memory', () => {
+      const before = nodePython.configureMemoryPressure({ reportExternalMemory: true }).wrapperBytes
+      const big = nodePython.evaluate('bytearray(4 << 20)')
+      expect(big.__pytype__).to.equal('bytearray')
+      expect(nodePython.configureMemoryPressure().wrapperBytes - before).to.be.at.least(4 << 20)
+    })
+
+    it('should ignore small objects', () => {
+      const before = nodePython.configureMemoryPressure({ reportExternalMemory: true }).wrapperBytes
+      nodePython.evaluate('bytearray(16)')
+      expect(nodePython.configureMemoryPressure().wrapperBytes).to.equal(before)
+    })
+
+    it('should not deadlock when measuring an object collects garbage', () => {
+      nodePython.configureMemoryPressure({ reportExternalMemory: true, collectPython: true })
+      const obj = nodePython.evaluate('type("Sized", (), {"nbytes": property(lambda self: (__import__("gc").collect(), 16)[1])})()')
+      expect(obj.__pytype__).to.equal('Sized')
+    })
+
+    it('should update and validate options', () => {
+      const defaults = nodePython.configureMemoryPressure()
+      try {
+        expect(nodePython.configureMemoryPressure({ pythonGeneration: 0 }).pythonGeneration).to.equal(0)
+        expect(() => nodePython.configureMemoryPressure({ pythonGeneration: 3 })).to.throw(RangeError)
+      } finally {
+        nodePython.configureMemoryPressure(defaults)
+      }
+    })
+  })
+
+  describe('#columns', () => {
+    it('should convert a list of dicts to columns', async () => {
+      const result = await tools.__getattr__('return_records').__callasync_columns__(4)
+      expect(result.length).to.equal(4)
+      expect(Array.from(result.columns.id)).to.deep.equal([0, 1, 2, 3])
+      expect(result.columns.name.dictionary).to.deep.equal(['even', 'odd'])
+      expect(Array.from(result.columns.name.indices)).to.deep.equal([0, 1, 0, 1])
+      expect(Array.from(result.columns.flag)).to.deep.equal([0, 1, 1, 1])
+      expect(Number.isNaN(result.columns.score[1])).to.equal(true)
+      expect(Array.from(result.validity.score)).to.deep.equal([1, 0, 1, 1])
+      expect(result.validity.id).to.equal(undefined)
+    })
+
+    it('should name the problem with a malformed __arrow_c_array__', async () => {
+      let error
+      await tools.__getattr__('return_bad_arrow').__callasync_columns__().catch((e) => { error = e })
+      expect(error).to.be.an.instanceof(nodePython.PythonError)
+      expect(error.message).to.match(/capsule pair/)
+    })
+
+    it('should reject unsupported results', async () => {
+      let error
+      await tools.__getattr__('return_immediate').__callasync_columns__(1).catch((e) => { error = e })
+      expect(error).to.be.an.instanceof(TypeError)
+    })
+
+    it('should alias Arrow buffers', function () {
+      try {
+        nodePython.import('pyarrow')
+      } catch (e) {
+        this.skip()
+      }
+      const batch = nodePython.evaluate('pyarrow.record_batch({"x": [1.5, 2.5], "s": ["a", None]})', { pyarrow: nodePython.import('pyarrow') })
+      const result = batch.__columns__()
+      expect(result.length).to.equal(2)
+      expect(result.columns.x).to.be.an.instanceof(Float64Array)
+      expect(Array.from(result.columns.x)).to.deep.equal([1.5, 2.5])
+      expect(Array.from(result.columns.s.indices)).to.deep.equal([0, -1])
+      expect(Array.from(result.validity.s)).to.deep.equal([1, 0])
+    })
+
+    it('should keep nulls and encode strings across Arrow stream batches', function () {
+      let pyarrow
+      try {
+        pyarrow = nodePython.import('pyarrow')
+      } catch (e) {
+        this.skip()
+      }
+      const table = nodePython.evaluate('pyarrow.Table.from_batches([pyarrow.record_batch({"x": [1.5, None], "s": [None, "constructor"]}), pyarrow.record_batch({"x": [None, 4.5], "s": ["__proto__", "constructor"]})])', { pyarrow })
+      const result = table.__columns__()
+      expect(result.length).to.equal(4)
+      expect(result.columns.x).to.deep.equal([1.5, null, null, 4.5])
+      expect(Array.from(result.validity.x)).to.deep.equal([1, 0, 0, 1])
+      expect(result.columns.s.dictionary).to.deep.equal(['constructor', '__proto__'])
+      expect(Array.from(result.columns.s.indices)).to.deep.equal([-1, 0, 1, 0])
+      expect(Array.from(result.validity.s)).to.deep.equal([0, 1, 1, 1])
+    })
+  })
+
+  describe('#startInterpreterAsync', () => {
+    it('should use pycachePrefix, preload modules and refuse calls while starting', function () {
+      this.timeout(30000)
+      const prefix = mkdtempSync(join(tmpdir(), 'pynode-pycache-'))
+      // Needs a fresh process, this one already has an interpreter
+      const script = `
+        import { pynode } from ${JSON.stringify(new URL('./index.js', import.meta.url).href)}
+        const started = pynode.startInterpreterAsync({ pycachePrefix: ${JSON.stringify(prefix)}, preload: ['colorsys'] })
+        let refused = false
+        try { pynode.eval('x = 1') } catch (e) { refused = true }
+        await started
+        while (!pynode.evaluate('"colorsys" in __import__("sys").modules'))
+          await new Promise(resolve => setTimeout(resolve, 10))
+        console.log(JSON.stringify({ refused, prefix: pynode.evaluate('__import__("sys").pycache_prefix') }))
+      `
+      try {
+        const output = execFileSync(process.execPath, ['--input-type=module', '-e', script], { encoding: 'utf8' })
+        const result = JSON.parse(output.trim().split('\n').pop())
+        expect(result.refused).to.equal(true)
+        expect(result.prefix).to.equal(prefix)
+        expect(readdirSync(prefix, { recursive: true }).some(f => f.endsWith('.pyc'))).to.equal(true)
+      } finally {
+        rmSync(prefix, { recursive: true, force: true })
+      }
+    })
+  })
+
+  describe('#importAsync', () => {
+    it('should resolve when the interpreter is already started', () => {
+      return nodePython.startInterpreterAsync()
+    })
+
+    it('should import a module on a worker thread', () => {
+      return nodePython.importAsync('tools')
+        .then(mod => {
+          expect(mod).to.equal(tools)
+        })
+    })
+
+    it('should reject with a PythonError for missing modules', done => {
+      nodePython.importAsync('randommodulethatshouldnotexist11')
+        .catch(err => {
+          expect(err.pyType).to.equal('ModuleNotFoundError')
+          done()
+        })
+    })
+  })
+
+  describe('#createChannel', () => {
+    it('should stream records from JS to a Python consumer', done => {
+      const ch = nodePython.createChannel(1024)
+      expect(ch.capacity).to.equal(1024)
+      expect(ch.write('a')).to.equal(true)
+      expect(ch.write(Buffer.from('bc'))).to.equal(true)
+      expect(Atomics.load(ch.header, 0)).to.equal(11)
+      const consumer = call('drain_channel', ch)
+      setTimeout(() => ch.close(), 10)
+      consumer
+        .then(result => {
+          expect(result).to.deep.equal(['a', 'bc'])
+          expect(Atomics.load(ch.header, 1)).to.equal(11)
+          done()
+        })
+        .catch(done)
+    })
+
+    it('should refuse records that do not fit', () => {
+      const ch = nodePython.createChannel(64)
+      expect(ch.write(new Uint8Array(61))).to.equal(false)
+      expect(ch.write(new Uint8Array(60))).to.equal(true)
+    })
+  })
+
+  describe('#getStats', () => {
+    it('should count envs and live wrapper mappings', () => {
+      const before = nodePython.getStats()
+      const keep = tools.__getattr__('return_class_object').__call__()
+      const after = nodePython.getStats()
+      expect(after.envs).to.be.at.least(1)
+      expect(after.objectMappings).to.equal(before.objectMappings + 1)
+      expect(after.pyAllocatedBlocks).to.be.a('number')
+      expect(keep).to.be.an('object')
+    })
+  })
+
+  describe('#createStream', () => {
+    it('should iterate a Readable from Python', async () => {
+      const source = Readable.from([Buffer.from('ab'), Buffer.from('cd'), 'ef'])
+      const stream = nodePython.createStream(source, { highWaterMark: 2 })
+      expect(await call('read_stream', stream)).to.equal('abcdef')
+    })
+
+    it('should hand Python the same reader each time a stream is passed', async () => {
+      const stream = nodePython.createStream(Readable.from(['ab', 'cd']))
+      expect(await call('read_stream_split', stream, stream)).to.deep.equal([true, 'abcd'])
+    })
+
+    it('should read as a raw file', async () => {
+      const stream = nodePython.createStream(Readable.from(['a\nb', '\nc\n']))
+      expect(await call('read_stream_lines', stream)).to.deep.equal(['a', 'b', 'c'])
+    })
+
+    it('should support async for over async iterables', async () => {
+      async function* generate() {
+        yield 'x'
+        yield new Uint8Array([121])
+      }
+      expect(await call('read_stream_async', nodePython.createStream(generate()))).to.deep.equal(['x', 'y'])
+    })
+
+    it('should raise errors from the source in Python', async () => {
+      async function* failing() {
+        yield 'x'
+        throw new Error('source failed')
+      }
+      expect(await call('read_stream_error', nodePython.createStream(failing()))).to.equal('source failed')
+    })
+  })
+
+  describe('tracing', () => {
+    it('should write a chrome trace with worker and python frame spans', done => {
+      const file = join(tmpdir(), `pynode-trace-${process.pid}.json`)
+      nodePython.startTracing({ pythonFrames: true })
+      call('call_callback', () => {})
+        .then(() => {
+          const count = nodePython.stopTracing(file)
+          const trace = JSON.parse(readFileSync(file, 'utf8'))
+          unlinkSync(file)
+          const names = trace.traceEvents.map(e => e.name)
+          expect(count).to.be.greaterThan(0)
+          expect(names).to.include('PyNodeWorker::Execute')
+          expect(names).to.include('js.callback')
+          expect(names).to.include('call_callback')
+          done()
+        })
+        .catch(done)
+    })
+
+    it('should not record python frames once a later trace turns them off', async () => {
+      const file = join(tmpdir(), `pynode-trace-${process.pid}.json`)
+      nodePython.startTracing({ pythonFrames: true })
+      await call('call_callback', () => {})
+      nodePython.stopTracing(file)
+      nodePython.startTracing({ pythonFrames: false })
+      await call('call_callback', () => {})
+      nodePython.stopTracing(file)
+      const trace = JSON.parse(readFileSync(file, 'utf8'))
+      unlinkSync(file)
+      expect(trace.traceEvents.filter(e => e.ph === 'B')).to.deep.equal([])
+    })
+
+    it('should reject a negative maxEvents', () => {
+      expect(() => nodePython.startTracing({ maxEvents: -1 })).to.throw(RangeError)
+    })
+  })
+
+  describe('#__proxy__', () => {
+    it('should read attributes and call methods like a JS object', () => {
+      const py = tools.__proxy__()
+      expect(py.multiply(2, 3)).to.equal(6)
+      const t = py.return_class_object()
+      expect(t.v).to.equal('Test string')
+      expect(t.t()).to.equal('Test string')
+      t.v = 'changed'
+      expect(t.t()).to.equal('changed')
+      expect('v' in t).to.equal(true)
+      expect(t.missing).to.equal(undefined)
+      expect(py.return_immediate(t).v).to.equal('changed')
+    })
+
+    it('should see changes to the class after a lookup was cached', () => {
+      const py = tools.__proxy__()
+      const s = py.make_slotted()
+      expect(s.value()).to.equal(1)
+      s.x = 2
+      expect(s.value()).to.equal(2)
+      py.patch_slotted()
+      expect(s.value()).to.equal(20)
+    })
+
+    it('should resolve methods, class and instance attributes of plain classes', () => {
+      const py = tools.__proxy__()
+      const p = py.make_plain()
+      expect(p.value()).to.equal(1)
+      expect(p.label).to.equal('plain')
+      p.label = 'mine'
+      expect(p.label).to.equal('mine')
+      expect(py.make_plain().label).to.equal('plain')
+      p.value = 5
+      expect(p.value).to.equal(5)
+      py.patch_plain()
+      expect(py.make_plain().value()).to.equal(10)
+    })
+
+    it('should expose the wrapper methods', async () => {
+      const py = tools.__proxy__()
+      expect(await py.multiply.__callasync_promise__(3, 4)).to.equal(12)
+      expect(py.__wrapped__).to.equal(tools)
+      expect(tools.__proxy__()).to.equal(py)
+    })
+  })
+
+  describe('#snapshot', () => {
+    class Tls {
+      constructor () {
+        this.cert = 'pem'
+      }
+    }
+    class Config {
+      constructor () {
+        this.name = 'svc'
+        this.port = 8080
+        this.tls = new Tls()
+      }
+    }
+
+    it('should copy the requested fields from a worker thread', async () => {
+      const config = new Config()
+      const result = await tools.__getattr__('snapshot').__callasync_promise__(config, ['name', 'port', 'missing'])
+      expect(result).to.deep.equal({ name: 'svc', port: 8080, missing: null })
+    })
+
+    it('should copy nested objects up to depth', () => {
+      const config = new Config()
+      const snapshot = tools.__getattr__('snapshot')
+      expect(snapshot.__call__(config).tls).to.equal(config.tls)
+      const deep = snapshot.__call__(config, null, 2)
+      expect(deep.tls).to.not.be.an.instanceof(Tls)
+      expect(deep.tls).to.deep.equal({ cert: 'pem' })
+    })
+
+    it('should only accept JavaScript objects', () => {
+      expect(() => tools.__getattr__('snapshot').__call__(1)).to.throw(nodePython.PythonError)
+    })
+  })
+
+  describe('#schema', () => {
+    const request = nodePython.schema({ ids: 'int[]', weights: 'float[]', tag: 'str' })
+    const response = { tag: 'str', total: 'float', note: 'str?' }
+
+    it('should convert arguments and results through the schemas', async () => {
+      const score = tools.__getattr__('score').__typed__([request], response)
+      const payload = { ids: [1, 2], weights: [0.5, 0.25], tag: 'a' }
+      expect(score.__call__(payload)).to.deep.equal({ tag: 'a', total: 1, note: null })
+      expect(await score.__callasync_promise__(payload)).to.deep.equal({ tag: 'a', total: 1, note: null })
+      expect(String(request)).to.equal('{ids: int[], weights: float[], tag: str}')
+    })
+
+    it('should name the path of a mismatch', async () => {
+      const score = tools.__getattr__('score').__typed__([request], response)
+      expect(() => score.__call__({ ids: [1, 'x'], weights: [], tag: 'a' }))
+        .to.throw(TypeError, 'Schema mismatch at args[0].ids[1]: expected int, got string')
+      expect(() => score.__call__({ ids: [], weights: [] }))
+        .to.throw(TypeError, 'Schema mismatch at args[0].tag: expected str, got undefined')
+      let error
+      await tools.__getattr__('score').__typed__([request], 'int').__callasync_promise__({ ids: [], weights: [], tag: 'a' })
+        .catch((e) => { error = e })
+      expect(error).to.be.an.instanceof(TypeError)
+      expect(error.message).to.equal('Schema mismatch at result: expected int, got dict')
+    })
+
+    it('should read object results by attribute', () => {
+      const scoreObject = tools.__getattr__('score_object').__typed__(['str', 'float'], { tag: 'str', total: 'float' })
+      expect(scoreObject.__call__('b', 2.5)).to.deep.equal({ tag: 'b', total: 2.5 })
+    })
+
+    it('should reject invalid specs', () => {
+      expect(() => nodePython.schema({ a: 'number' })).to.throw(TypeError, "Invalid schema at schema.a: unknown type 'number'")
+      expect(() => nodePython.schema(['int', 'str'])).to.throw(TypeError)
+    })
+  })
+
+  describe('#__calljson__', () => {
+    it('should take JSON text or bytes and return a JSON Buffer', async () => {
+      const summarize = tools.__getattr__('summarize')
+      const body = JSON.stringify({ items: [1, 2, 3.5], name: 'batch' })
+      const fromString = await summarize.__calljson__(body, 2)
+      expect(Buffer.isBuffer(fromString)).to.equal(true)
+      expect(JSON.parse(fromString.toString())).to.deep.equal({ count: 3, total: 13, name: 'batch' })
+      const fromBuffer = await summarize.__calljson__(Buffer.from(body))
+      expect(JSON.parse(fromBuffer.toString())).to.deep.equal({ count: 3, total: 6.5, name: 'batch' })
+    })
+
+    it('should round trip escapes, unicode and big integers', async () => {
+      const text = '{"s":"a\\u00e9\\ud83d\\ude00\\"\\n","big":123456789012345678901234567890,"list":[null,true,false,-0.5e3,[]]}'
+      const result = (await tools.__getattr__('echo').__calljson__(text)).toString()
+      expect(result).to.include('"big":123456789012345678901234567890')
+      expect(JSON.parse(result)).to.deep.include({ s: 'a\u00e9\ud83d\ude00"\n', list: [null, true, false, -500, []] })
+    })
+
+    it('should reject malformed JSON and unserializable results', async () => {
+      let error
+      await tools.__getattr__('echo').__calljson__('{"a": [1, 2}').catch((e) => { error = e })
+      expect(error).to.be.an.instanceof(nodePython.PythonError)
+      expect(error.pyType).to.equal('ValueError')
+      expect(error.pyMessage).to.include('offset 11')
+      error = undefined
+      await tools.__getattr__('return_set').__calljson__('{}').catch((e) => { error = e })
+      expect(error.pyType).to.equal('TypeError')
+      expect(() => tools.__getattr__('echo').__calljson__(42)).to.throw(TypeError)
+    })
+  })
+
+  describe('#configureConversion', () => {
+    let defaults
+    beforeEach(() => { defaults = nodePython.configureConversion() })
+    afterEach(() => { nodePython.configureConversion(defaults) })
+
+    it('should convert in handle scope chunks', () => {
+      nodePython.configureConversion({ chunkSize: 3 })
+      const records = tools.__getattr__('return_records').__call__(10)
+      expect(records.length).to.equal(10)
+      expect(records.map((r) => r.id)).to.deep.equal([0, 1, 2, 3, 4, 5, 6, 7, 8, 9])
+    })
+
+    it('should spread large async results over event loop turns', async () => {
+      nodePython.configureConversion({ chunkSize: 256, incrementalThreshold: 1000, timeBudgetMs: 0 })
+      const before = nodePython.configureConversion()
+      const result = await tools.__getattr__('return_range').__callasync_promise__(5000)
+      const after = nodePython.configureConversion()
+      expect(result.length).to.equal(5000)
+      expect(result[4999]).to.equal(4999)
+      expect(after.incrementalConversions - before.incrementalConversions).to.equal(1)
+      expect(after.slices - before.slices).to.be.above(1)
+      expect(await tools.__getattr__('return_range').__callasync_promise__(10)).to.have.length(10)
+      expect(nodePython.configureConversion().incrementalConversions).to.equal(after.incrementalConversions)
+    })
+
+    it('should validate options', () => {
+      expect(() => nodePython.configureConversion({ chunkSize: 0 })).to.throw(RangeError)
+    })
+  })
+
+  describe('#__callauto__', () => {
+    it('should run fast callables inline in one batch once profiled', async () => {
+      const multiply = tools.__getattr__('multiply')
+      expect(await multiply.__callauto__(2, 3)).to.equal(6)
+      const before = nodePython.configureAutoDispatch()
+      const results = await Promise.all([1, 2, 3, 4].map((i) => multiply.__callauto__(i, 2)))
+      expect(results).to.deep.equal([2, 4, 6, 8])
+      const after = nodePython.configureAutoDispatch()
+      expect(after.inlineCalls - before.inlineCalls).to.equal(4)
+      expect(after.batches - before.batches).to.equal(1)
+    })
+
+    it('should profile bound methods by their function', async () => {
+      const obj = tools.__getattr__('make_slotted').__call__()
+      await obj.__getattr__('value').__callauto__()
+      const before = nodePython.configureAutoDispatch()
+      await obj.__getattr__('value').__callauto__()
+      const after = nodePython.configureAutoDispatch()
+      expect(after.inlineCalls - before.inlineCalls).to.equal(1)
+    })
+
+    it('should keep slow callables off the event loop', async () => {
+      const sleep = tools.__getattr__('sleep_ms')
+      await sleep.__callauto__(5)
+      const before = nodePython.configureAutoDispatch()
+      expect(await sleep.__callauto__(5)).to.equal(5)
+      const after = nodePython.configureAutoDispatch()
+      expect(after.offloadedCalls - before.offloadedCalls).to.equal(1)
+      expect(after.inlineCalls).to.equal(before.inlineCalls)
+    })
+
+    it('should reject with the Python error on both paths', async () => {
+      const failing = tools.__getattr__('causes_runtime_error')
+      for (let i = 0; i < 2; i++) {
+        let error
+        await failing.__callauto__().catch((e) => { error = e })
+        expect(error).to.be.instanceOf(nodePython.PythonError)
+      }
+    })
+
+    it('should validate options', () => {
+      const defaults = nodePython.configureAutoDispatch()
+      try {
+        expect(nodePython.configureAutoDispatch({ batchBudgetUs: 500 }).batchBudgetUs).to.equal(500)
+        expect(() => nodePython.configureAutoDispatch({ smoothing: 0 })).to.throw(RangeError)
+        expect(() => nodePython.configureAutoDispatch({ inlineThresholdUs: 10, offloadThresholdUs: 5 })).to.throw(RangeError)
+      } finally {
+        nodePython.configureAutoDispatch(defaults)
+      }
+    })
+  })
+
+  describe('#__memoize__', () => {
+    it('should serve repeated arguments from the cache', async () => {
+      const memo = tools.__getattr__('counted').__memoize__({ maxEntries: 2 })
+      const first = await memo.__callasync_promise__({ a: 1, b: [1, 2] })
+      const second = await memo.__callasync_promise__({ b: [1, 2], a: 1 })
+      expect(second.calls).to.equal(first.calls)
+      expect(memo.__call__({ a: 1, b: [1, 2] }).calls).to.equal(first.calls)
+      expect(memo.__call__('other').calls).to.equal(first.calls + 1)
+      expect(memo.stats()).to.include({ hits: 2, misses: 2, entries: 2 })
+    })
+
+    it('should join concurrent misses and evict past maxEntries', async () => {
+      const memo = tools.__getattr__('counted').__memoize__({ maxEntries: 1 })
+      const [a, b] = await Promise.all([memo.__callasync_promise__(1), memo.__callasync_promise__(1)])
+      expect(a.calls).to.equal(b.calls)
+      await memo.__callasync_promise__(2)
+      const c = await memo.__callasync_promise__(1)
+      expect(c.calls).to.not.equal(a.calls)
+      expect(memo.stats().evictions).to.equal(2)
+    })
+
+    it('should keep a pending async entry across a sync call', async () => {
+      const memo = tools.__getattr__('counted').__memoize__()
+      const pending = memo.__callasync_promise__(3)
+      memo.__call__(3)
+      const [a, b] = await Promise.all([pending, memo.__callasync_promise__(3)])
+      expect(b.calls).to.equal(a.calls)
+    })
+
+    it('should give every hit a copy of its own', async () => {
+      const memo = tools.__getattr__('counted').__memoize__()
+      const first = memo.__call__([4])
+      first.value.push('changed')
+      const hit = memo.__call__([4])
+      expect(hit.value).to.deep.equal([4])
+      hit.calls = -1
+      expect((await memo.__callasync_promise__([4])).calls).to.equal(first.calls)
+      expect(memo.stats().hits).to.equal(2)
+    })
+
+    it('should not cache arguments without a structural key', () => {
+      const memo = tools.__getattr__('counted').__memoize__()
+      memo.__call__(() => {})
+      expect(memo.stats().uncacheable).to.equal(1)
+    })
+  })
+
+  describe('#enableAllocationTracking', () => {
+    before(() => nodePython.enableAllocationTracking(true))
+    after(() => nodePython.enableAllocationTracking(false))
+
+    it('should charge python allocations to the call that made them', async () => {
+      await call('allocate', 1000)
+      const stats = nodePython.getAllocationStats()
+      expect(stats.enabled).to.equal(true)
+      expect(stats.last.name).to.equal('allocate')
+      expect(stats.byCallable.allocate.calls).to.equal(1)
+      expect(stats.byCallable.allocate.retained).to.be.greaterThan(1000 * 8)
+    })
+
+    it('should report temporaries in the peak but not as retained', () => {
+      tools.__getattr__('churn').__call__(1000)
+      const { churn } = nodePython.getAllocationStats().byCallable
+      expect(churn.peak).to.be.greaterThan(1000 * 8)
+      expect(churn.retained).to.be.lessThan(churn.peak / 10)
+    })
+  })
+
+  describe('#createPool', () => {
+    let pool
+    before(() => {
+      pool = createPool({ size: 2, sysPath: ['./test_files'], restartDelayMs: 10 })
+    })
+    after(() => pool.close())
+
+    const poolCall = (name, ...args) => pool.import('tools').__getattr__(name).__callasync_promise__(...args)
+
+    it('should call functions in a worker process', async () => {
+      expect(await poolCall('multiply', 2, 3)).to.equal(6)
+      expect(await poolCall('worker_pid')).to.not.equal(process.pid)
+    })
+
+    it('should return large ints as numbers like the embedded interpreter', async () => {
+      expect(await poolCall('return_immediate', 2 ** 60)).to.equal(2 ** 60)
+      expect(await call('return_immediate', 2 ** 60)).to.equal(2 ** 60)
+    })
+
+    it('should keep unconvertible results in the worker as handles', async () => {
+      const obj = await poolCall('return_class_object')
+      expect(await obj.__getattr__('t').__callasync_promise__()).to.equal('Test string')
+      expect(await obj.__getattr__('v').__resolve__()).to.equal('Test string')
+    })
+
+    it('should reject with the python error', async () => {
+      try {
+        await poolCall('undefined_function_that_does_not_exist')
+        expect.fail('should have thrown')
+      } catch (e) {
+        expect(e.pyType).to.equal('AttributeError')
+      }
+    })
+
+    it('should restart a worker that crashes', async () => {
+      const crashing = pool.import('tools', { worker: 0 })
+      const pid = await crashing.__getattr__('worker_pid').__callasync_promise__()
+      try {
+        await crashing.__getattr__('crash').__callasync_promise__()
+        expect.fail('should have thrown')
+      } catch (e) {
+        expect(e).to.be.an('error')
+      }
+      const restarted = await crashing.__getattr__('worker_pid').__callasync_promise__()
+      expect(restarted).to.not.equal(pid)
+    })
+
+    it('should kill a worker stuck in a call that holds the GIL', async () => {
+      const stuck = createPool({ size: 1, sysPath: ['./test_files'], healthCheckIntervalMs: 50, healthCheckTimeoutMs: 500, restartDelayMs: 10 })
+      try {
+        const tools = stuck.import('tools')
+        await tools.__getattr__('hold_gil').__callasync_promise__().then(() => expect.fail('should have thrown'), (e) => {
+          expect(e.message).to.match(/failed its health check/)
+        })
+        expect(await tools.__getattr__('multiply').__callasync_promise__(2, 3)).to.equal(6)
+      } finally {
+        await stuck.close()
+      }
+    })
+
+    it('should fail calls to workers that are not restarted', async () => {
+      const stopping = createPool({ size: 2, sysPath: ['./test_files'], restart: false })
+      try {
+        const pinned = stopping.import('tools', { worker: 0 })
+        await pinned.__getattr__('crash').__callasync_promise__().catch(() => {})
+        await pinned.__getattr__('worker_pid').__callasync_promise__().then(() => expect.fail('should have thrown'), (e) => {
+          expect(e.message).to.match(/has stopped/)
+        })
+        const tools = stopping.import('tools')
+        for (let i = 0; i < 3; i++) {
+          expect(await tools.__getattr__('multiply').__callasync_promise__(i, 2)).to.equal(i * 2)
+        }
+        await stopping.import('tools', { worker: 1 }).__getattr__('crash').__callasync_promise__().catch(() => {})
+        await tools.__getattr__('multiply').__callasync_promise__(1, 2).then(() => expect.fail('should have thrown'), (e) => {
+          expect(e.message).to.match(/No Python pool workers/)
+        })
+      } finally {
+        await stopping.close()
+      }
+    })
+  })
+
   // describe('stopInterpreter', () => {
   //   it('should stop the interpreter', () => {
   //     nodePython.stopInterpreter()
@@ -0,0 +1,18 @@
+def noop():
+  return None
+
+def identity(x):
+  return x
+
+def call_js(cb, n):
+  for i in range(n):
+    cb(i)
+  return n
+
+class Obj:
+  def __init__(self):
+    self.v = 1
+
+same_object = Obj()
+def return_same_object():
+  return same_object
@@ -0,0 +1,30 @@
+import sys
+
+class Item:
+  def __init__(self, i):
+    self.i = i
+
+shared = Item(0)
+
+def echo(x):
+  return x
+
+def make_object(i):
+  return Item(i)
+
+def echo_shared():
+  return shared
+
+def work(n):
+  total = 0
+  for i in range(n):
+    total += i * i
+  return total
+
+def call_back(cb, n):
+  for i in range(n):
+    cb(i)
+  return n
+
+def shared_refcount():
+  return sys.getrefcount(shared)
@@ -61,4 +61,193 @@ def return_same_object():
   return same_object
   
 def call_callback(cb):
-  cb("Hello")
\ No newline at end of file
+  cb("Hello")
+
+def drain_channel(ch):
+  return [record.decode() for record in ch]
+
+def return_records(n):
+  return [{"id": i, "name": "even" if i % 2 == 0 else "odd", "flag": i > 0, "score": None if i == 1 else i / 2} for i in range(n)]
+
+class Point:
+  def __init__(self, x, y):
+    self.x = x
+    self.y = y
+
+class Point3(Point):
+  def __init__(self, x, y, z):
+    super().__init__(x, y)
+    self.z = z
+
+def make_point(x, y, z=None):
+  return Point(x, y) if z is None else Point3(x, y, z)
+
+def register_point_converter(enable):
+  import pynode
+  pynode.register_converter(Point, (lambda p: dict(vars(p))) if enable else None)
+
+def describe(value):
+  return [type(value).__name__, value]
+
+class Holder:
+  def __init__(self, js):
+    self.js = js
+
+def make_holder(js):
+  return Holder(js)
+
+_kept = None
+def keep(obj):
+  global _kept
+  _kept = obj
+
+def kept_js_name():
+  return _kept.js.name
+
+def call_from_threads(cb, n):
+  from concurrent.futures import ThreadPoolExecutor
+  with ThreadPoolExecutor(4) as pool:
+    return sorted(pool.map(cb, range(n)))
+
+def call_from_thread_catching(cb):
+  from concurrent.futures import ThreadPoolExecutor
+  def run():
+    try:
+      return cb()
+    except RuntimeError as e:
+      return 'error: ' + str(e)
+  with ThreadPoolExecutor(1) as pool:
+    return pool.submit(run).result(timeout=5)
+
+def call_js_async_from_thread(cb, value):
+  import pynode
+  import threading
+  result = {}
+  def run():
+    try:
+      result['value'] = pynode.call_js_async(cb, value).result(timeout=5)
+    except Exception as e:
+      result['value'] = 'error: ' + str(e)
+  thread = threading.Thread(target=run)
+  thread.start()
+  thread.join()
+  return result['value']
+
+def crash():
+  import os
+  os._exit(1)
+
+def hold_gil():
+  import re
+  # Backtracks in C for ages without letting go of the GIL
+  return re.match(r'(a+)+$', 'a' * 64 + 'b')
+
+def worker_pid():
+  import os
+  return os.getpid()
+
+def allocate(n):
+  return [str(i) for i in range(n)]
+
+def churn(n):
+  temporary = [str(i) for i in range(n)]
+  return len(temporary)
+
+counted_calls = 0
+
+def counted(value):
+  global counted_calls
+  counted_calls += 1
+  return {'value': value, 'calls': counted_calls}
+
+def snapshot(obj, keys=None, depth=1):
+  import pynode
+  return pynode.snapshot(obj, keys, depth)
+
+def score(request):
+  total = sum(i * w for i, w in zip(request['ids'], request['weights']))
+  return {'tag': request['tag'], 'total': total, 'note': None}
+
+class Scored:
+  def __init__(self, tag, total):
+    self.tag = tag
+    self.total = total
+
+def score_object(tag, total):
+  return Scored(tag, total)
+
+def summarize(body, scale=1):
+  return {'count': len(body['items']), 'total': sum(body['items']) * scale, 'name': body['name']}
+
+def echo(value):
+  return value
+
+def return_set(body):
+  return {1, 2}
+
+def return_range(n):
+  return list(range(n))
+
+def sleep_ms(ms):
+  import time
+  time.sleep(ms / 1000)
+  return ms
+
+class Slotted:
+  __slots__ = ('x',)
+
+  def __init__(self):
+    self.x = 1
+
+  def value(self):
+    return self.x
+
+class Plain:
+  label = 'plain'
+
+  def __init__(self):
+    self.x = 1
+
+  def value(self):
+    return self.x
+
+class BadArrow:
+  def __arrow_c_array__(self, requested_schema=None):
+    return (None,)
+
+def return_bad_arrow():
+  return BadArrow()
+
+def make_plain():
+  return Plain()
+
+def patch_plain():
+  Plain.value = lambda self: self.x * 10
+
+def make_slotted():
+  return Slotted()
+
+def patch_slotted():
+  Slotted.value = lambda self: self.x * 10
+
+def read_stream(stream):
+  return b''.join(bytes(chunk) for chunk in stream).decode()
+
+def read_stream_split(first, second):
+  return [first is second, (first.read(1) + second.read()).decode()]
+
+def read_stream_lines(stream):
+  import io
+  return [line.rstrip('\n') for line in io.TextIOWrapper(io.BufferedReader(stream), encoding='utf-8')]
+
+def read_stream_async(stream):
+  import asyncio
+  async def collect():
+    return [bytes(chunk).decode() async for chunk in stream]
+  return asyncio.run(collect())
+
+def read_stream_error(stream):
+  try:
+    stream.read()
+  except OSError as e:
+    return str(e)